@@ -0,0 +1,216 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <sick-lms5xx/compact.hpp>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/types.hpp>
+#include <vector>
+
+namespace sick {
+
+static constexpr size_t COLA_B_HEADER_SIZE =
+    8; ///< 4 magic STX bytes and the 32 bit payload length
+static constexpr size_t COLA_B_FRAME_OVERHEAD =
+    COLA_B_HEADER_SIZE + 1; ///< header and trailing checksum byte
+static constexpr size_t COLA_B_MAX_PAYLOAD =
+    64 * 1024; ///< larger lengths mean we are not synchronized to a frame
+
+/**
+ * @brief   Read a big-endian unsigned integer of \p N bytes
+ *
+ * @param data  Pointer to the first (most significant) byte
+ *
+ * @return  Value in host byte order
+ */
+template <size_t N> inline uint32_t read_be(const char *data) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < N; ++i) {
+    value = (value << 8) | static_cast<uint8_t>(data[i]);
+  }
+  return value;
+}
+
+/**
+ * @brief   XOR checksum of a CoLa-B payload
+ *
+ * @param payload   Payload without header
+ * @param len   Number of bytes in \p payload
+ *
+ * @return  Checksum byte
+ */
+uint8_t cola_b_checksum(const char *payload, size_t len);
+
+/**
+ * @brief   Check whether \p data begins with a complete CoLa-B frame
+ *
+ * @param data  Data from scanner, must begin with the magic bytes
+ * @param len   Number of bytes in \p data
+ * @param frame_len Output, total number of bytes in the frame if complete
+ *
+ * @return  Whether the frame is complete. Check the magic bytes and checksum
+ * with \ref validate_response_binary().
+ */
+bool cola_b_frame_complete(const char *data, size_t len, size_t &frame_len);
+
+/**
+ * @brief   Find the next complete and valid CoLa-B frame. Bytes which cannot
+ * begin a frame are skipped, so this resynchronizes after joining a stream in
+ * the middle of a frame.
+ *
+ * @param data  Buffered data
+ * @param len   Number of bytes in \p data
+ * @param begin Input: where to start searching. Output: beginning of the
+ * frame if one was found, otherwise the first byte which must be kept until
+ * more data arrives.
+ * @param frame_len Output, total number of bytes of the frame if found
+ *
+ * @return  Whether a frame was found
+ */
+bool next_cola_b_frame(const char *data, size_t len, size_t &begin,
+                       size_t &frame_len);
+
+/**
+ * @brief   Check if a buffer holds exactly one well-formed CoLa-B telegram:
+ * magic bytes, a length matching \p len and a correct checksum.
+ *
+ * @param data  Data from scanner
+ * @param len   Length of \p data
+ *
+ * @return  Whether this looks like a properly formed binary SOPAS reply
+ */
+bool validate_response_binary(const char *data, size_t len);
+
+/**
+ * @brief   Parse status from binary SOPAS response
+ *
+ * @param data  Data from scanner
+ * @param len   Length of \p data
+ *
+ * @return  Error or success code for this telegram
+ */
+SickErr status_from_bytes_binary(const char *data, size_t len);
+
+/**
+ * @brief   Classify a binary SOPAS response by the command it answers and
+ * parse its status, without allocating
+ *
+ * @param data  Data from scanner
+ * @param len   Length of \p data
+ *
+ * @return  Answered command and status of this telegram
+ */
+ReplyStatus classify_reply_binary(const char *data, size_t len);
+
+/**
+ * @brief   Builder for CoLa-B command telegrams. Arguments are appended in
+ * big-endian byte order, framing and checksum are filled in by \ref data().
+ */
+class BinaryCommand {
+  std::array<char, 128> data_; ///< complete telegram
+  size_t len_;                 ///< number of bytes used in \ref data_
+  bool has_args_;              ///< whether any argument has been appended
+
+  BinaryCommand &append(uint32_t value, size_t n_bytes);
+
+public:
+  /**
+   * @param command Method and command name, e.g. `sMN SetAccessMode`
+   */
+  explicit BinaryCommand(const char *command);
+
+  BinaryCommand &u8(uint8_t value) { return append(value, 1); }
+  BinaryCommand &u16(uint16_t value) { return append(value, 2); }
+  BinaryCommand &u32(uint32_t value) { return append(value, 4); }
+  BinaryCommand &i16(int16_t value) {
+    return append(static_cast<uint16_t>(value), 2);
+  }
+  BinaryCommand &i32(int32_t value) {
+    return append(static_cast<uint32_t>(value), 4);
+  }
+
+  /**
+   * @return    Complete telegram with header and checksum
+   */
+  const char *data();
+
+  /**
+   * @return    Number of bytes in the complete telegram
+   */
+  size_t size() const { return len_ + 1; }
+};
+
+/**
+ * @brief   Binary counterpart of \ref ScanBatcher. Reassembles CoLa-B frames
+ * from arbitrary chunks and decodes `LMDscandata` frames with fixed-offset
+ * big-endian reads. Other frames (e.g. command replies) are discarded.
+ */
+class BinaryScanBatcher {
+  std::vector<char> buffer;  ///< temporary data store
+  size_t num_bytes_buffered; ///< number of bytes currently buffered
+  Scan s;                    ///< scan to return
+  PipelineStats *pipeline_stats; ///< if set, receives the timing hooks
+
+public:
+  /**
+   * @brief Default ctor with undefined values
+   */
+  BinaryScanBatcher();
+
+  /**
+   * @brief Report counters and stage timings to \p stats. The caller must
+   * call \ref PipelineStats::chunk_received() before each \ref add_data().
+   *
+   * @param stats   Statistics to update, or null to disable them. Must
+   * outlive the batcher.
+   */
+  void set_stats(PipelineStats *stats) { pipeline_stats = stats; }
+
+  /**
+   * @brief Add data, and get a scan if the data is complete.
+   *
+   * @param data_new    Data to append
+   * @param length  Number of bytes in \p data_new
+   *
+   * @return    Maybe, a parsed scan.
+   */
+  simple_optional<Scan> add_data(const char *data_new, size_t length);
+
+  /**
+   * @brief Add data, and hand each completed scan to \p sink. See
+   * \ref ScanBatcher::add_data(const char *, size_t, const ScanSink &).
+   *
+   * @param data_new    Data to append
+   * @param length  Number of bytes in \p data_new
+   * @param sink    Receiver of completed scans
+   *
+   * @return    Number of scans passed to \p sink
+   */
+  size_t add_data(const char *data_new, size_t length, const ScanSink &sink);
+
+  /**
+   * @brief Parse a complete binary scan telegram into a scan
+   *
+   * @param telegram    Complete frame, beginning with the magic bytes
+   * @param len Number of bytes in \p telegram, including the checksum
+   * @param scan    Parse scan. Contents are undefined if the parse fails.
+   *
+   * @return    Whether the parse was successful and \p scan can be used
+   */
+  static bool parse_scan_telegram(const char *telegram, size_t len,
+                                  Scan &scan);
+
+  /**
+   * @brief Parse a complete binary scan telegram, copying the raw channel
+   * values without converting them to float
+   *
+   * @param telegram    Complete frame, beginning with the magic bytes
+   * @param len Number of bytes in \p telegram, including the checksum
+   * @param scan    Parse scan. Contents are undefined if the parse fails.
+   *
+   * @return    Whether the parse was successful and \p scan can be used
+   */
+  static bool parse_scan_telegram(const char *telegram, size_t len,
+                                  CompactScan &scan);
+};
+
+} // namespace sick
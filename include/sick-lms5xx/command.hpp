@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <sick-lms5xx/types.hpp>
+#include <string>
+#include <vector>
+
+namespace sick {
+
+/**
+ * @brief   Matches command replies to outstanding requests, so that several
+ * commands can be sent before the first reply arrives. Replies are framed from
+ * arbitrary chunks of received data, which may also hold scan data. Telegrams
+ * starting with four STX bytes are CoLa-B frames, others are ASCII telegrams
+ * ending in ETX. Scan data (`sSN` telegrams) is skipped without being
+ * buffered.
+ *
+ * A reply belongs to the oldest outstanding request with the same command
+ * name and the answering method, e.g. `sAN SetAccessMode` to
+ * `sMN SetAccessMode`, and `sWA` to `sWN`. Generic errors (`sFA`), which carry
+ * no name, belong to the oldest outstanding request.
+ *
+ * Requests may be added and failed from any thread. Data must only be added
+ * by one thread at a time.
+ */
+class CommandChannel {
+  /**
+   * @brief Outstanding request
+   */
+  struct Request {
+    uint64_t id;                   ///< identifies the request to cancel()
+    std::string reply;             ///< method and name of the expected reply
+    std::promise<SickErr> promise; ///< receives the status of the reply
+  };
+
+  /**
+   * @brief Part of a telegram the next byte belongs to
+   */
+  enum class State : uint8_t {
+    Idle,  ///< waiting for STX
+    Reply, ///< buffering a telegram which may be a reply
+    Skip   ///< skipping a scan telegram
+  };
+
+  State state_;             ///< part of the telegram being received
+  bool binary_;             ///< whether the telegram is a CoLa-B frame
+  std::vector<char> frame_; ///< telegram received so far
+  size_t skip_;             ///< CoLa-B frame bytes left to skip
+
+  std::mutex mutex_;              ///< guards \ref requests_
+  std::deque<Request> requests_;  ///< outstanding requests, oldest first
+  uint64_t next_id_;              ///< id of the next request
+  std::atomic<size_t> n_pending_; ///< size of \ref requests_
+
+  /**
+   * @brief Consume the next bytes of \p data according to \ref state_
+   *
+   * @return    Number of bytes consumed, may be 0 if the state changed
+   */
+  size_t consume(const char *data, size_t len);
+
+  /**
+   * @brief Drop the bytes in \ref frame_, which do not start a CoLa-B frame,
+   * up to the next STX
+   */
+  void resync();
+
+  /**
+   * @brief Resolve the request which the complete telegram in \ref frame_
+   * answers, if any
+   */
+  void dispatch();
+
+public:
+  CommandChannel();
+
+  /**
+   * @brief Register a request before sending it
+   *
+   * @param telegram    Complete command telegram, with framing
+   * @param len Number of bytes in \p telegram
+   * @param id  Output, identifies the request to \ref cancel()
+   *
+   * @return    Future for the status of the reply
+   */
+  std::future<SickErr> expect(const char *telegram, size_t len,
+                              uint64_t &id);
+
+  /**
+   * @brief Add received data, and resolve the requests answered by it
+   *
+   * @param data    Received data
+   * @param len Number of bytes in \p data
+   */
+  void add_data(const char *data, size_t len);
+
+  /**
+   * @brief Resolve all outstanding requests with \p error, e.g. after the
+   * connection was lost
+   */
+  void fail(SickErr error);
+
+  /**
+   * @brief Resolve only the request \p id with \p error, e.g. when it could
+   * not be sent or its reply did not arrive in time. Other requests stay
+   * outstanding. Nothing happens if the request was already resolved.
+   */
+  void cancel(uint64_t id, SickErr error);
+
+  /**
+   * @brief Drop a partial telegram, before data of a new connection is added
+   */
+  void reset();
+
+  /**
+   * @return    Number of outstanding requests
+   */
+  size_t pending() const { return n_pending_.load(); }
+};
+
+/**
+ * @brief   Wait for all replies of pipelined commands
+ *
+ * @param replies Futures of the replies
+ *
+ * @return  First error in the order of \p replies, or success
+ */
+template <typename Replies> SickErr first_error(Replies &replies) {
+  SickErr result = sick_err_t::Ok;
+  for (auto &reply : replies) {
+    const SickErr status = reply.get();
+    if (result.ok() && !status.ok()) {
+      result = status;
+    }
+  }
+  return result;
+}
+
+} // namespace sick
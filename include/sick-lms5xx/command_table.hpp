@@ -0,0 +1,462 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/types.hpp>
+#include <type_traits>
+#include <utility>
+
+namespace sick {
+
+/**
+ * @brief   Argument formats of ASCII SOPAS commands. Each field writes one
+ * token and reports how many characters it needs at most, so that telegrams
+ * fit a buffer sized at compile time.
+ */
+namespace field {
+
+/**
+ * @brief   Unsigned decimal, zero-padded to \p Width digits like `%0*u`
+ */
+template <size_t Width = 1> struct Dec {
+  static constexpr size_t max_size = Width > 20 ? Width : 20;
+
+  template <typename T> static constexpr bool accepts() {
+    return std::is_integral<T>::value;
+  }
+
+  static char *write(char *out, unsigned long long value) {
+    char digits[max_size];
+    size_t n = 0;
+    do {
+      digits[n++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+    while (n < Width) {
+      digits[n++] = '0';
+    }
+    while (n > 0) {
+      *out++ = digits[--n];
+    }
+    return out;
+  }
+};
+
+/**
+ * @brief   Unsigned upper case hex, zero-padded to \p Width digits like `%0*X`
+ */
+template <size_t Width = 1> struct Hex {
+  static constexpr size_t max_size = Width > 16 ? Width : 16;
+
+  template <typename T> static constexpr bool accepts() {
+    return std::is_integral<T>::value;
+  }
+
+  static char *write(char *out, unsigned long long value) {
+    static constexpr char HEX_DIGITS[] = "0123456789ABCDEF";
+    char digits[max_size];
+    size_t n = 0;
+    do {
+      digits[n++] = HEX_DIGITS[value & 0xF];
+      value >>= 4;
+    } while (value != 0);
+    while (n < Width) {
+      digits[n++] = '0';
+    }
+    while (n > 0) {
+      *out++ = digits[--n];
+    }
+    return out;
+  }
+};
+
+/**
+ * @brief   Decimal with mandatory sign like `%+d`. SOPAS ASCII treats signs as
+ * optional, except for angles.
+ */
+struct Signed {
+  static constexpr size_t max_size = 1 + Dec<>::max_size;
+
+  template <typename T> static constexpr bool accepts() {
+    return std::is_integral<T>::value;
+  }
+
+  static char *write(char *out, long long value) {
+    *out++ = value < 0 ? '-' : '+';
+    const unsigned long long magnitude =
+        value < 0 ? 0ull - static_cast<unsigned long long>(value)
+                  : static_cast<unsigned long long>(value);
+    return Dec<>::write(out, magnitude);
+  }
+};
+
+/**
+ * @brief   IPv4 address in host byte order, as four hex bytes `C0 A8 00 01`
+ */
+struct IPv4 {
+  static constexpr size_t max_size = 4 * 2 + 3;
+
+  template <typename T> static constexpr bool accepts() {
+    return std::is_integral<T>::value;
+  }
+
+  static char *write(char *out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out = Hex<2>::write(out, (value >> shift) & 0xFF);
+      if (shift > 0) {
+        *out++ = ' ';
+      }
+    }
+    return out;
+  }
+};
+
+/**
+ * @brief   Fixed \p Value in the format of \p Field, which takes no argument
+ */
+template <typename Field, long long Value> struct Const {
+  static constexpr size_t max_size = Field::max_size;
+
+  static char *write(char *out) { return Field::write(out, Value); }
+};
+
+template <typename Field> struct is_const : std::false_type {};
+template <typename Field, long long Value>
+struct is_const<Const<Field, Value>> : std::true_type {};
+
+} // namespace field
+
+/**
+ * @brief   Formats of the arguments of a command, in order
+ */
+template <typename... Fields> struct FieldList {
+  /// Number of arguments the command takes
+  static constexpr size_t n_args = 0;
+  /// Characters of all arguments, each with a leading space
+  static constexpr size_t max_size = 0;
+};
+
+template <typename Field, typename... Fields>
+struct FieldList<Field, Fields...> {
+  static constexpr size_t n_args =
+      (field::is_const<Field>::value ? 0 : 1) +
+      FieldList<Fields...>::n_args;
+  static constexpr size_t max_size =
+      1 + Field::max_size + FieldList<Fields...>::max_size;
+};
+
+/// Reply status which means success for any command not listed otherwise
+static constexpr int STATUS_SUCCESS = 1;
+/// Reply status which is no error code, e.g. for `LMDscandata`
+static constexpr int STATUS_ANY = -1;
+
+/**
+ * @brief   Descriptor of an ASCII SOPAS command: method and name, argument
+ * formats and the reply status signalling success. Specialized for each
+ * \ref SOPASCommand.
+ */
+template <SOPASCommand Cmd> struct CommandSpec;
+
+template <> struct CommandSpec<REBOOT> {
+  static constexpr const char *name() { return "sMN mSCreboot"; }
+  using Fields = FieldList<>;
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<SETACCESSMODE> {
+  static constexpr const char *name() { return "sMN SetAccessMode"; }
+  using Fields = FieldList<field::Dec<2>,  // user level
+                           field::Hex<8>>; // password hash
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<TSCROLE> {
+  static constexpr const char *name() { return "sWN TSCRole"; }
+  using Fields = FieldList<field::Dec<2>>;
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<TSCTCINTERFACE> {
+  static constexpr const char *name() { return "sWN TSCTCInterface"; }
+  using Fields = FieldList<field::Dec<2>>;
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<TSCTCSRVADDR> {
+  static constexpr const char *name() { return "sWN TSCTCSrvAddr"; }
+  using Fields = FieldList<field::IPv4>;
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<MLMPSETSCANCFG> {
+  static constexpr const char *name() { return "sMN mLMPsetscancfg"; }
+  // retardation: the signs in sopas ascci are usually optional, but not for
+  // the start and end angles
+  using Fields = FieldList<field::Signed,                  // 1/100 Hz
+                           field::Const<field::Signed, 1>, // sectors
+                           field::Signed,                  // 1/10000 degrees
+                           field::Signed,                  // start angle
+                           field::Signed>;                 // end angle
+  static constexpr int success = 0;
+};
+
+template <> struct CommandSpec<LMDSCANDATACFG> {
+  static constexpr const char *name() { return "sWN LMDscandatacfg"; }
+  // the telegram listing has fewer values than are actually needed, so this
+  // is guesswork. this is hardcoded to make remission show up in the scan
+  // telegrams. looks like the second 00 is an unknown mystery value that is
+  // not documented. the first value selects the echoes
+  using Fields = FieldList<field::Hex<2>,                  // echoes
+                           field::Const<field::Hex<2>, 0>, // mystery value
+                           field::Const<field::Dec<>, 1>,  // remission
+                           field::Const<field::Dec<>, 0>,  // 8 bit
+                           field::Const<field::Dec<>, 0>,  // unit
+                           field::Const<field::Dec<>, 0>,  // encoder
+                           field::Const<field::Hex<2>, 0>, // encoder
+                           field::Const<field::Dec<>, 0>,  // position
+                           field::Const<field::Dec<>, 0>,  // device name
+                           field::Const<field::Dec<>, 0>,  // comment
+                           field::Const<field::Dec<>, 1>,  // time
+                           field::Const<field::Dec<>, 1>>; // output interval
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<FRECHOFILTER> {
+  static constexpr const char *name() { return "sWN FREchoFilter"; }
+  using Fields = FieldList<field::Dec<>>;
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<LMPOUTPUTRANGE_READ> {
+  static constexpr const char *name() { return "sRN LMPoutputRange"; }
+  using Fields = FieldList<>;
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<LMPOUTPUTRANGE_WRITE> {
+  static constexpr const char *name() { return "sWN LMPoutputRange"; }
+  using Fields = FieldList<field::Const<field::Dec<>, 1>, // sector
+                           field::Signed,                 // 1/10000 degrees
+                           field::Signed,                 // start angle
+                           field::Signed>;                // end angle
+  static constexpr int success = STATUS_SUCCESS;
+};
+
+template <> struct CommandSpec<MEEWRITEALL> {
+  static constexpr const char *name() { return "sMN mEEwriteall"; }
+  using Fields = FieldList<>;
+  static constexpr int success = 1;
+};
+
+template <> struct CommandSpec<RUN> {
+  static constexpr const char *name() { return "sMN Run"; }
+  using Fields = FieldList<>;
+  static constexpr int success = 1;
+};
+
+template <> struct CommandSpec<LMDSCANDATA> {
+  static constexpr const char *name() { return "sEN LMDscandata"; }
+  // 0 means stop, 1 means start, there is no error
+  using Fields = FieldList<field::Dec<>>;
+  static constexpr int success = STATUS_ANY;
+};
+
+template <> struct CommandSpec<LMCSTOPMEAS> {
+  static constexpr const char *name() { return "sMN LMCstopmeas"; }
+  using Fields = FieldList<>;
+  static constexpr int success = 0;
+};
+
+template <> struct CommandSpec<LMCSTARTMEAS> {
+  static constexpr const char *name() { return "sMN LMCstartmeas"; }
+  using Fields = FieldList<>;
+  static constexpr int success = 0;
+};
+
+/// Number of \ref SOPASCommand values, each with a \ref CommandSpec
+static constexpr size_t N_SOPAS_COMMANDS = LMCSTARTMEAS + 1;
+
+/**
+ * @return  Length of a string, at compile time
+ */
+constexpr size_t const_strlen(const char *str) {
+  size_t len = 0;
+  while (str[len] != '\0') {
+    ++len;
+  }
+  return len;
+}
+
+/**
+ * @brief   Write the remaining arguments, each after a space
+ */
+inline char *write_fields(char *out, FieldList<>) { return out; }
+
+template <typename Field, typename... Fields, typename... Args>
+typename std::enable_if<field::is_const<Field>::value, char *>::type
+write_fields(char *out, FieldList<Field, Fields...>, Args... args) {
+  *out++ = ' ';
+  out = Field::write(out);
+  return write_fields(out, FieldList<Fields...>(), args...);
+}
+
+template <typename Field, typename... Fields, typename Arg, typename... Args>
+typename std::enable_if<!field::is_const<Field>::value, char *>::type
+write_fields(char *out, FieldList<Field, Fields...>, Arg arg, Args... args) {
+  static_assert(Field::template accepts<Arg>(),
+                "Argument type does not match the SOPAS command.");
+  *out++ = ' ';
+  out = Field::write(out, arg);
+  return write_fields(out, FieldList<Fields...>(), args...);
+}
+
+/**
+ * @brief   Builder for ASCII command telegrams, the counterpart of
+ * \ref BinaryCommand. The arguments are checked against the
+ * \ref CommandSpec of \p Cmd at compile time and written into a buffer sized
+ * for the longest possible telegram, without format strings.
+ *
+ *      const AsciiCommand<SETACCESSMODE> login(3, 0xF4724744);
+ *      send(fd, login.data(), login.size(), 0);
+ */
+template <SOPASCommand Cmd> class AsciiCommand {
+  using Spec = CommandSpec<Cmd>;
+  static constexpr size_t NAME_LEN = const_strlen(Spec::name());
+
+  std::array<char, 1 + NAME_LEN + Spec::Fields::max_size + 1>
+      data_;   ///< complete telegram
+  size_t len_; ///< number of bytes used in \ref data_
+
+public:
+  /**
+   * @param args    Arguments in the order of the command's fields
+   */
+  template <typename... Args> explicit AsciiCommand(Args... args) {
+    static_assert(sizeof...(Args) == Spec::Fields::n_args,
+                  "Wrong number of arguments for the SOPAS command.");
+    char *out = data_.data();
+    *out++ = STX;
+    const char *name = Spec::name();
+    for (size_t i = 0; i < NAME_LEN; ++i) {
+      *out++ = name[i];
+    }
+    out = write_fields(out, typename Spec::Fields(), args...);
+    *out++ = ETX;
+    len_ = out - data_.data();
+  }
+
+  /**
+   * @return    Complete telegram with STX and ETX
+   */
+  const char *data() const { return data_.data(); }
+
+  /**
+   * @return    Number of bytes in the telegram
+   */
+  size_t size() const { return len_; }
+};
+
+/// Offset basis and prime of the 32 bit FNV-1a hash
+static constexpr uint32_t FNV_OFFSET = 2166136261u;
+static constexpr uint32_t FNV_PRIME = 16777619u;
+
+/**
+ * @return  32 bit FNV-1a hash of \p len bytes of \p data
+ */
+constexpr uint32_t fnv1a(const char *data, size_t len) {
+  uint32_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * @return  Character \p i of the reply to the command named \p request. Only
+ * the method differs, `sMN` is answered by `sAN`, `sWN` by `sWA`, `sRN` by
+ * `sRA` and `sEN` by `sEA`.
+ */
+constexpr char reply_char(const char *request, size_t i) {
+  return (i == 1 && request[1] == 'M') || (i == 2 && request[1] != 'M')
+             ? 'A'
+             : request[i];
+}
+
+/**
+ * @return  \ref fnv1a() hash of the method and name of the reply to
+ * \p request, e.g. of `sAN Run` for `sMN Run`
+ */
+constexpr uint32_t reply_hash(const char *request) {
+  uint32_t hash = FNV_OFFSET;
+  for (size_t i = 0; request[i] != '\0'; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(reply_char(request, i))) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * @brief   Name of a command and the reply status which means success
+ */
+struct CommandStatus {
+  const char *request; ///< method and name of the command, e.g. `sMN Run`
+  size_t len;          ///< number of characters in \ref request
+  uint32_t hash;       ///< \ref reply_hash() of \ref request
+  int success;         ///< status of a successful reply, or STATUS_ANY
+};
+
+/**
+ * @return  Reply status of \p Cmd from its \ref CommandSpec
+ */
+template <SOPASCommand Cmd> constexpr CommandStatus command_status() {
+  return CommandStatus{CommandSpec<Cmd>::name(),
+                       const_strlen(CommandSpec<Cmd>::name()),
+                       reply_hash(CommandSpec<Cmd>::name()),
+                       CommandSpec<Cmd>::success};
+}
+
+/**
+ * @return  Reply status of every \ref SOPASCommand, in enum order
+ */
+template <size_t... I>
+constexpr std::array<CommandStatus, sizeof...(I)>
+command_status_table(std::index_sequence<I...>) {
+  return {{command_status<static_cast<SOPASCommand>(I)>()...}};
+}
+
+/// Slots of a \ref ReplyIndex, a power of two
+static constexpr size_t REPLY_INDEX_SIZE = 32;
+static_assert(REPLY_INDEX_SIZE >= 2 * N_SOPAS_COMMANDS,
+              "Reply index too small for the number of commands.");
+
+/**
+ * @brief   Hash table from the method and name of a reply to the command it
+ * answers, with linear probing. Built at compile time by \ref reply_index(),
+ * it is at most half full, so lookups take one or two probes.
+ */
+struct ReplyIndex {
+  int8_t slots[REPLY_INDEX_SIZE]; ///< \ref SOPASCommand, -1 if empty
+};
+
+/**
+ * @return  Index of the replies to the commands in \p statuses, which are in
+ * enum order
+ */
+template <size_t N>
+constexpr ReplyIndex
+reply_index(const std::array<CommandStatus, N> &statuses) {
+  ReplyIndex index{};
+  for (size_t slot = 0; slot < REPLY_INDEX_SIZE; ++slot) {
+    index.slots[slot] = -1;
+  }
+  for (size_t cmd = 0; cmd < N; ++cmd) {
+    size_t slot = statuses[cmd].hash % REPLY_INDEX_SIZE;
+    while (index.slots[slot] != -1) {
+      slot = (slot + 1) % REPLY_INDEX_SIZE;
+    }
+    index.slots[slot] = static_cast<int8_t>(cmd);
+  }
+  return index;
+}
+
+} // namespace sick
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <sick-lms5xx/parsing.hpp>
+
+namespace sick {
+
+/// Raw 16 bit distances of all echoes, one row per echo
+using RawRangeMatrix =
+    Eigen::Matrix<uint16_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+/// Raw 8 bit remissions of all echoes, one row per echo
+using RawIntensityMatrix =
+    Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+/**
+ * @brief   Scan with the values kept as sent by the scanner: 16 bit distances
+ * and 8 bit remissions with the scaling of their channel. Takes a quarter
+ * (remissions) to half (distances) of the memory of a \ref Scan, for logging
+ * and passing many scans around. Values are converted to float when accessed,
+ * see \ref decode_ranges() and \ref expand_scan().
+ */
+struct CompactScan : ScanInfo {
+  RawRangeMatrix ranges;          ///< raw distances, echoes x points
+  RawIntensityMatrix intensities; ///< raw remissions, echoes x points
+
+  /**
+   * @brief Default init the scan with 0 points
+   */
+  CompactScan() {}
+
+  /**
+   * @return    Distance of \p ray in meters
+   */
+  float range(unsigned int echo, size_t ray) const {
+    return range_scaling[echo](ranges(echo, ray));
+  }
+
+  /**
+   * @return    Reflectivity of \p ray
+   */
+  float intensity(unsigned int echo, size_t ray) const {
+    return intensity_scaling[echo](intensities(echo, ray));
+  }
+};
+
+/**
+ * @brief   Counterpart of \ref update_scan_geometry() for compact scans
+ */
+void update_scan_geometry(CompactScan &scan, unsigned int n_values,
+                          deg start_angle, deg ang_incr,
+                          unsigned int n_echoes = 1);
+
+/**
+ * @brief   Convert raw 16 bit values to float, with the widest SIMD
+ * instructions enabled at compile time like \ref project_polar()
+ *
+ * @param raw Raw values
+ * @param n   Number of values
+ * @param scaling Conversion of the raw values
+ * @param out Converted values, may not alias \p raw
+ */
+void decode_u16(const uint16_t *raw, size_t n, ChannelScaling scaling,
+                float *out);
+
+/**
+ * @brief   Convert raw 8 bit values to float, see \ref decode_u16()
+ */
+void decode_u8(const uint8_t *raw, size_t n, ChannelScaling scaling,
+               float *out);
+
+/**
+ * @brief   Reference implementations of \ref decode_u16() and
+ * \ref decode_u8() without SIMD
+ */
+void decode_u16_scalar(const uint16_t *raw, size_t n, ChannelScaling scaling,
+                       float *out);
+void decode_u8_scalar(const uint8_t *raw, size_t n, ChannelScaling scaling,
+                      float *out);
+
+/**
+ * @brief   Convert distances of rays `[begin, begin + n)` to meters
+ *
+ * @param scan  Compact scan
+ * @param echo  Echo to convert
+ * @param begin First ray
+ * @param n Number of rays
+ * @param out   Receives \p n distances
+ *
+ * @throws std::out_of_range  if the rays or the echo do not exist
+ */
+void decode_ranges(const CompactScan &scan, unsigned int echo, size_t begin,
+                   size_t n, float *out);
+
+/**
+ * @brief   Convert reflectivities of rays `[begin, begin + n)`, see
+ * \ref decode_ranges()
+ */
+void decode_intensities(const CompactScan &scan, unsigned int echo,
+                        size_t begin, size_t n, float *out);
+
+/**
+ * @brief   Store \p scan with the channel scaling of its telegram, see
+ * \ref ScanInfo::range_scaling. Lossless for scans parsed from telegrams.
+ * Values which do not fit the raw types, e.g. of scans modified or built by
+ * hand, are clamped.
+ *
+ * @param scan  Scan to convert
+ * @param compact   Receives the values, reusing its buffers
+ *
+ * @return  Number of clamped values
+ */
+size_t compact_scan(const Scan &scan, CompactScan &compact);
+
+/**
+ * @brief   Convert all values of \p compact to float
+ *
+ * @param compact   Compact scan
+ * @param scan  Receives the values, reusing its buffers
+ */
+void expand_scan(const CompactScan &compact, Scan &scan);
+
+} // namespace sick
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 // Marker types
 // TODO: use boost::unit
@@ -9,6 +10,15 @@ using hz = double;
 namespace sick {
 namespace lms5xx {
 
+/**
+ * @brief   Echoes reported per ray, values of `FREchoFilter`
+ */
+enum class EchoFilter : uint8_t {
+  First = 0, ///< first echo only
+  All = 1,   ///< all echoes, up to five, e.g. for rain and dust filtering
+  Last = 2   ///< last echo only
+};
+
 /**
  * @brief   Struct to hold parameters for LMS scanner
  */
@@ -17,9 +27,17 @@ struct LMSConfigParams {
   rad resolution;  ///< scan resolution (0.1667, 0.25, 0.5, 1)
   rad start_angle; ///< begin scan angle, from -95° to 95°
   rad end_angle;   ///< end scan angle, from -95° to 95°
-
-  // echo config?
+  EchoFilter echo_filter = EchoFilter::Last; ///< echoes reported per ray
 };
+
+/**
+ * @return  Bit mask of the output channels (echoes) for `LMDscandatacfg`. 0
+ * leaves the choice to `FREchoFilter`.
+ */
+inline uint8_t echo_output_channels(EchoFilter filter) {
+  // one bit per echo
+  return filter == EchoFilter::All ? 0x1F : 0x00;
+}
 } // namespace lms5xx
 
 } // namespace sick
@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <sick-lms5xx/types.hpp>
+
+namespace sick {
+
+/**
+ * @brief   State of the connection of a \ref SOPASProtocol while scanning
+ */
+enum class ConnectionState : uint8_t {
+  Connected,    ///< connected, scans are received
+  Disconnected, ///< connection lost, waiting before the next attempt
+  Reconnecting, ///< connecting and restoring the session
+  Failed        ///< gave up, see \ref ReconnectPolicy::max_attempts
+};
+
+/**
+ * @brief   Change of the connection state, passed to a
+ * \ref ConnectionCallback
+ */
+struct ConnectionEvent {
+  ConnectionState state; ///< new state
+  unsigned int attempt;  ///< reconnect attempts since the connection was lost
+  SickErr error; ///< why the connection or the last attempt failed, if so
+  std::chrono::milliseconds
+      retry_in; ///< when \ref ConnectionState::Disconnected, delay before the
+                ///< next attempt
+};
+
+using ConnectionCallback = std::function<void(
+    const ConnectionEvent &)>; ///< Receiver of connection state changes
+
+/**
+ * @brief   When to reconnect after the connection to a scanner was lost
+ */
+struct ReconnectPolicy {
+  bool enabled = true; ///< whether to reconnect at all
+  std::chrono::milliseconds initial_delay{
+      100}; ///< delay before the first attempt
+  std::chrono::milliseconds max_delay{10000}; ///< upper bound of the delay
+  double multiplier = 2; ///< growth of the delay per failed attempt
+  unsigned int max_attempts =
+      0; ///< attempts before giving up, 0 to retry forever
+  std::chrono::milliseconds liveness_timeout{
+      5000}; ///< no data for this long while scan data is requested counts as
+             ///< a lost connection, 0 to disable. Checked whenever the
+             ///< socket timeout expires, so detection can take up to one
+             ///< socket timeout longer.
+};
+
+/**
+ * @return  Delay before reconnect attempt \p attempt, counting from 1:
+ * exponential backoff from \ref ReconnectPolicy::initial_delay up to
+ * \ref ReconnectPolicy::max_delay
+ */
+inline std::chrono::milliseconds reconnect_delay(const ReconnectPolicy &policy,
+                                                 unsigned int attempt) {
+  double delay = policy.initial_delay.count();
+  for (unsigned int i = 1; i < attempt && delay < policy.max_delay.count();
+       ++i) {
+    delay *= policy.multiplier;
+  }
+  return std::chrono::milliseconds(static_cast<int64_t>(
+      std::min(delay, static_cast<double>(policy.max_delay.count()))));
+}
+
+} // namespace sick
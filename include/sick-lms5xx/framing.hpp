@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace sick {
+
+/// Value of \ref FrameSpan::stx for spans without STX
+static constexpr size_t NO_STX = static_cast<size_t>(-1);
+
+/**
+ * @brief   Part of a chunk of ASCII SOPAS data, up to and including an ETX.
+ * Offsets are relative to the start of the chunk.
+ */
+struct FrameSpan {
+  size_t begin;    ///< first byte after the previous ETX, 0 for the first span
+  size_t stx;      ///< first STX in the span, or \ref NO_STX
+  size_t end;      ///< one past the ETX, or the length of the chunk
+  bool terminated; ///< whether the span ends with ETX. If not, it is the last
+                   ///< span and its telegram continues in the next chunk.
+};
+
+/**
+ * @brief   Split a chunk of received data into telegrams at each ETX, finding
+ * all STX and ETX bytes in a single pass. Blocks of the chunk are compared
+ * with the widest SIMD instructions enabled at compile time like
+ * \ref project_polar(), without SIMD, the bytes are searched with memchr().
+ *
+ * @param data  Received data
+ * @param len   Number of bytes in \p data
+ * @param frames    Output, spans in order, which together cover \p data. It
+ * is cleared first and keeps its capacity, so that reusing it does not
+ * allocate.
+ */
+void find_frames(const char *data, size_t len, std::vector<FrameSpan> &frames);
+
+/**
+ * @brief   Count the STX and ETX bytes of \p data in a single pass, like
+ * \ref find_frames()
+ *
+ * @param data  Received data
+ * @param len   Number of bytes in \p data
+ * @param n_stx Output, number of STX bytes
+ * @param n_etx Output, number of ETX bytes
+ */
+void count_delimiters(const char *data, size_t len, size_t &n_stx,
+                      size_t &n_etx);
+
+/**
+ * @brief   Reference implementations of \ref find_frames() and
+ * \ref count_delimiters(), which look at one byte at a time
+ */
+void find_frames_scalar(const char *data, size_t len,
+                        std::vector<FrameSpan> &frames);
+void count_delimiters_scalar(const char *data, size_t len, size_t &n_stx,
+                             size_t &n_etx);
+
+} // namespace sick
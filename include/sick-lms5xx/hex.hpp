@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace sick {
+
+/**
+ * @brief   Value of a single hex digit, or -1 if \p c is not one
+ */
+inline int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  // fold to lower case
+  const char lc = c | 0x20;
+  if (lc >= 'a' && lc <= 'f') {
+    return lc - 'a' + 10;
+  }
+  return -1;
+}
+
+/**
+ * @brief   Decode a run of hex values, like the distances and remissions of
+ * CoLa-A scan telegrams. Each value has 1 to 8 digits and is followed by a
+ * single space. Blocks of the input are classified into digits and spaces with
+ * the widest SIMD instructions enabled at compile time like
+ * \ref project_polar(), and the digits of each value are combined in a 64 bit
+ * register instead of one at a time.
+ *
+ * Decoding stops at the first token which does not have this format, e.g.
+ * with a sign, more than 8 digits or not followed by a space, so that the
+ * caller can decode it with \ref parse_hex().
+ *
+ * @param data  Values separated by spaces
+ * @param len   Number of bytes in \p data
+ * @param out   Receives up to \p n values
+ * @param n Maximum number of values to decode
+ * @param consumed  Output, number of bytes of the decoded values and their
+ * spaces
+ *
+ * @return  Number of decoded values
+ */
+size_t decode_hex_values(const char *data, size_t len, uint32_t *out, size_t n,
+                         size_t &consumed);
+
+/**
+ * @brief   Reference implementation of \ref decode_hex_values(), which looks
+ * at one character at a time
+ */
+size_t decode_hex_values_scalar(const char *data, size_t len, uint32_t *out,
+                                size_t n, size_t &consumed);
+
+} // namespace sick
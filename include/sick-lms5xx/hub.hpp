@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sick-lms5xx/sopas.hpp>
+#include <thread>
+#include <vector>
+
+// ScannerHub is built on epoll and therefore only available on Linux
+#ifndef __linux__
+#error "sick-lms5xx/hub.hpp requires Linux"
+#endif
+
+namespace sick {
+
+using HubScanCallback = std::function<void(
+    size_t, const Scan &)>; ///< Callback type for scans with a scanner id
+
+/**
+ * @brief   Reactor which receives scans from many scanners on a fixed number of
+ * threads, instead of one polling thread per \ref SOPASProtocol.
+ *
+ * The sockets of all registered scanners are watched by one epoll instance.
+ * Worker threads receive from whichever socket is readable and feed the data
+ * to the scanner's telegram batcher. A socket is armed one-shot, so each
+ * scanner is served by at most one worker at a time and its batcher, ring or
+ * pool sees a single producer.
+ *
+ * When the scanner closes a connection or it breaks, the scanner reconnects
+ * according to its \ref ReconnectPolicy and reports connection events like
+ * with \ref SOPASProtocol::start_scan(), then the hub watches the new socket.
+ * Since the workers do not time out, a silent connection, e.g. with a pulled
+ * cable, is only detected once the kernel reports an error.
+ */
+class ScannerHub {
+  /**
+   * @brief   Registered scanner
+   */
+  struct Entry {
+    size_t id;                               ///< id passed to the callback
+    SOPASProtocol::SOPASProtocolPtr scanner; ///< the scanner
+    ScanSink sink;                           ///< receiver of completed scans
+    std::mutex mutex; ///< orders batcher access between workers
+    bool active;      ///< false while the connection is lost
+    std::thread recovery; ///< reconnects after the connection was lost
+  };
+
+  const size_t n_threads_;   ///< number of workers, 0 to choose automatically
+  HubScanCallback callback_; ///< callback, if empty scanners deliver themselves
+  std::vector<std::unique_ptr<Entry>> entries_; ///< registered scanners
+  std::vector<std::thread> workers_;            ///< worker threads
+  std::atomic<bool> running_; ///< whether workers have been started
+  std::atomic<bool> stopping_; ///< cancels reconnects on \ref stop()
+  int epoll_fd_;              ///< epoll instance watching all sockets
+  int wakeup_fd_;             ///< eventfd to wake up workers on \ref stop()
+
+  /**
+   * @brief Worker thread main loop
+   */
+  void work();
+
+  /**
+   * @brief Receive from a readable socket and rearm it
+   *
+   * @param entry   Scanner whose socket is readable
+   * @param buffer  Receive buffer of the calling worker
+   */
+  void receive(Entry &entry, std::vector<char> &buffer);
+
+  /**
+   * @brief Reconnect a scanner whose connection was lost, see
+   * \ref SOPASProtocol::recover(), and watch its new socket. Runs on the
+   * recovery thread of \p entry, so that the workers keep serving the other
+   * scanners.
+   *
+   * @param entry   Scanner which lost its connection, no longer watched
+   * @param error   Why the connection was lost
+   */
+  void recover(Entry &entry, SickErr error);
+
+public:
+  /**
+   * @param fn  Callback invoked with the scanner id for each scan. If empty,
+   * each scanner delivers to its own callback, ring or pool.
+   * @param n_threads   Number of worker threads. 0 uses one per core, but no
+   * more than there are scanners.
+   */
+  explicit ScannerHub(const HubScanCallback &fn = HubScanCallback(),
+                      size_t n_threads = 0);
+
+  ScannerHub(const ScannerHub &other) = delete;
+  ScannerHub &operator=(const ScannerHub &other) = delete;
+
+  /**
+   * @brief Register a scanner. Call \ref SOPASProtocol::run() on it, but not
+   * \ref SOPASProtocol::start_scan(), since the hub takes over receiving. Must
+   * be called before \ref start().
+   *
+   * @param scanner Connected scanner
+   *
+   * @return    Id of the scanner, counting up from 0 in order of registration
+   */
+  size_t add(const SOPASProtocol::SOPASProtocolPtr &scanner);
+
+  /**
+   * @brief Register all sockets and start the workers
+   *
+   * @return    Error or success
+   */
+  SickErr start();
+
+  /**
+   * @brief Stop and join the workers. Must be called before stopping any of
+   * the scanners, since those read from their sockets when stopped.
+   */
+  void stop();
+
+  /**
+   * @return    Number of worker threads, valid after \ref start()
+   */
+  size_t n_threads() const { return workers_.size(); }
+
+  ~ScannerHub();
+};
+
+} // namespace sick
@@ -31,4 +31,34 @@ std::string ip_addr_to_hex_str(const std::string &ip_str);
 int connect_with_timeout(int sockfd, const struct sockaddr *addr,
                          socklen_t addrlen,
                          const std::chrono::system_clock::duration &timeout);
+
+/**
+ * @brief Ask the kernel to time stamp received data on \p sockfd, for
+ * \ref recv_timestamped(). Software time stamps are taken when the packet
+ * enters the network stack, hardware time stamps by the NIC. The latter are in
+ * the time base of the NIC's clock, so they are only comparable to the system
+ * clock if it is synchronized to the NIC (e.g. with `phc2sys`). Hardware time
+ * stamping must also be enabled on the interface (`SIOCSHWTSTAMP`).
+ * @param   sockfd  File descriptor of the socket
+ * @param   hardware    Whether to request hardware time stamps as well
+ * @return 0 On success, -1 on error or if the platform does not support
+ * `SO_TIMESTAMPING`. errno gets set.
+ */
+int enable_receive_timestamps(int sockfd, bool hardware);
+
+/**
+ * @brief Wrapper around recv() which also returns the time at which the data
+ * was received. Uses the kernel time stamp if enabled with
+ * \ref enable_receive_timestamps(), preferring the hardware one, and the
+ * current time otherwise. For a stream socket, this is the time stamp of the
+ * last segment read.
+ * @param   sockfd  File descriptor of the socket
+ * @param   buf Buffer to receive into
+ * @param   len Size of \p buf
+ * @param   flags   Flags as passed to `recv()`
+ * @param   received    Receive time
+ * @return Number of bytes received as returned by `recv()`
+ */
+ssize_t recv_timestamped(int sockfd, void *buf, size_t len, int flags,
+                         std::chrono::system_clock::time_point &received);
 } // namespace sick
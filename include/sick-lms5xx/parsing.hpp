@@ -1,7 +1,13 @@
 #pragma once
 #include <Eigen/Core>
+#include <array>
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <sick-lms5xx/config.hpp>
+#include <sick-lms5xx/framing.hpp>
+#include <sick-lms5xx/hex.hpp>
+#include <sick-lms5xx/stats.hpp>
 #include <sick-lms5xx/util.hpp>
 #include <string>
 #include <vector>
@@ -39,30 +45,242 @@ public:
 };
 
 /**
- * @brief   Struct for scan data
+ * @brief   Non-owning view of a single token inside a telegram. The token is
+ * **not** null-terminated.
+ */
+struct TokenView {
+  const char *data; ///< first character of the token
+  size_t size;      ///< number of characters in the token
+
+  /**
+   * @param needle  Null-terminated string to search for
+   *
+   * @return    Whether \p needle occurs anywhere in the token
+   */
+  bool contains(const char *needle) const;
+
+  /**
+   * @param str Null-terminated string to compare to
+   *
+   * @return    Whether the token is exactly \p str
+   */
+  bool operator==(const char *str) const;
+};
+
+/**
+ * @brief   Decode a hexadecimal token. Behaves like `strtol(..., 16)` for
+ * CoLa-A values: optional sign, upper or lower case digits, decoding stops at
+ * the first non-hex character.
+ *
+ * @param data  First character of the token
+ * @param len   Number of characters in the token
+ *
+ * @return  Decoded value, 0 if there are no hex digits
+ */
+long parse_hex(const char *data, size_t len);
+
+/**
+ * @brief   Allocation-free counterpart of \ref TokenBuffer. Tokenizes in place
+ * over the input, which must outlive the cursor. Instead of throwing when
+ * running out of tokens, it returns empty tokens and remembers the failure, so
+ * a whole telegram can be consumed and checked once with \ref ok().
+ */
+class TokenCursor {
+  const char *pos_; ///< beginning of the next token
+  const char *end_; ///< one past the last input character
+  char delim_;      ///< token delimiter
+  bool exhausted_;  ///< whether next() was called without tokens left
+
+public:
+  /**
+   * @param tokens  Input string of tokens delimited by \p delim
+   * @param len Length of the \p tokens input string **not number of tokens**
+   * @param delim   Delimiter between the tokens
+   */
+  TokenCursor(const char *tokens, size_t len, char delim = ' ');
+
+  /**
+   * @return    Whether there are more tokens
+   */
+  bool has_next() const { return pos_ < end_; }
+
+  /**
+   * @return    Number of input characters left
+   */
+  size_t remaining() const { return end_ - pos_; }
+
+  /**
+   * @return    Whether all tokens requested so far existed
+   */
+  bool ok() const { return !exhausted_; }
+
+  /**
+   * @return    View of the next token, empty if there are no more tokens
+   */
+  TokenView next();
+
+  /**
+   * @return    Next token decoded with \ref parse_hex()
+   */
+  long next_hex() {
+    const TokenView tok = next();
+    return parse_hex(tok.data, tok.size);
+  }
+
+  /**
+   * @brief Decode the next tokens in bulk with \ref decode_hex_values(), as
+   * long as they are plain hex values
+   *
+   * @param out Receives the values
+   * @param n   Maximum number of tokens to decode
+   *
+   * @return    Number of decoded tokens. If fewer than \p n, the next token
+   * must be decoded with \ref next_hex().
+   */
+  size_t next_hex_values(uint32_t *out, size_t n);
+
+  /**
+   * @brief Skip \p n tokens
+   */
+  void skip(size_t n = 1);
+};
+
+/// Most values per channel, as the CoLa-B field is 16 bit. Larger counts in
+/// ASCII telegrams are corrupt.
+constexpr unsigned int MAX_CHANNEL_VALUES = 65535;
+
+/**
+ * @brief   Immutable sine and cosine coefficients for each ray of one scan
+ * geometry. Tables are cached and shared by all scans with the same geometry,
+ * so scans only carry a pointer to them. A table is freed with the last scan
+ * using it.
  */
-struct Scan {
-  unsigned int size;           ///< Number of points
-  Eigen::VectorXf ranges;      ///< vector of distances in meters
-  Eigen::VectorXf intensities; ///< vector of reflectivities
-  rad start_angle;             ///< begin angle of the scan plane
-  rad end_angle;               ///< end angle of the scan plane
-  rad ang_increment;           ///< angular increment between rays
-  Eigen::VectorXf
-      sin_map; ///< reuseable map of sine coefficients for each angle
-  Eigen::VectorXf
-      cos_map; ///< reuseable map of cosine coefficients for each angle
+struct AngleTable {
+  unsigned int size;       ///< Number of rays
+  deg start_angle;         ///< angle of the first ray in LMS degrees
+  deg ang_increment;       ///< angular step between rays in degrees
+  Eigen::VectorXf sin_map; ///< sine coefficient for each angle
+  Eigen::VectorXf cos_map; ///< cosine coefficient for each angle
+
+  /**
+   * @return    Whether the table was computed for this geometry
+   */
+  bool matches(unsigned int n_values, deg start, deg incr) const {
+    return size == n_values && start_angle == start && ang_increment == incr;
+  }
+
+  /**
+   * @brief Get the table for a geometry from the cache, computing it the
+   * first time. Thread-safe.
+   *
+   * @param n_values    Number of rays
+   * @param start   Angle of the first ray in LMS degrees
+   * @param incr    Angular step between rays in degrees
+   *
+   * @return    Shared table
+   */
+  static std::shared_ptr<const AngleTable> get(unsigned int n_values, deg start,
+                                               deg incr);
+};
+
+/**
+ * @brief   Origin of \ref Scan::time
+ */
+enum class ScanTimeSource : uint8_t {
+  None,     ///< no time known, \ref Scan::time is the epoch
+  Device,   ///< date/time block of the telegram, i.e. the scanner's NTP time
+  Receive,  ///< receive time, corrected by the scanner's processing time
+  Estimated ///< scanner clock mapped to host time by \ref DeviceClockEstimator
+};
+
+/// Most echoes the scanner reports per ray
+constexpr unsigned int MAX_ECHOES = 5;
+
+/// Values of all echoes of a scan, one row per echo and one column per ray.
+/// Rows are contiguous, so the first echo can be used like a vector.
+using EchoMatrix =
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+/**
+ * @brief   Conversion of raw channel values: `offset + scale * raw`
+ */
+struct ChannelScaling {
+  float scale;  ///< multiplier for the raw values
+  float offset; ///< offset added to the scaled values
+
+  float operator()(float raw) const { return offset + scale * raw; }
+};
+
+/**
+ * @brief   Geometry, timing and time stamps of a scan, shared by \ref Scan and
+ * \ref CompactScan
+ */
+struct ScanInfo {
+  unsigned int size;     ///< Number of points
+  unsigned int n_echoes; ///< Number of echoes per point, 1 to MAX_ECHOES
+  rad start_angle;       ///< begin angle of the scan plane
+  rad end_angle;         ///< end angle of the scan plane
+  rad ang_increment;     ///< angular increment between rays
+  std::shared_ptr<const AngleTable>
+      angles; ///< shared sine and cosine coefficients for each ray
 
   std::chrono::system_clock::time_point time; ///< timestamp of scan acquisition
+  ScanTimeSource time_source; ///< where \ref time comes from
+  uint32_t time_since_boot_us; ///< scanner clock at the start of the scan
+  uint32_t
+      time_of_transmission_us; ///< scanner clock when the telegram was sent
+  std::chrono::system_clock::time_point
+      receive_time; ///< host time at which the telegram was received, if known
+  hz scan_frequency;        ///< mirror revolutions per second
+  hz measurement_frequency; ///< measurement shots per second, 0 if unknown
+  float time_increment; ///< time between two rays in s, see \ref time_offset()
+  std::array<ChannelScaling, MAX_ECHOES>
+      range_scaling; ///< raw distance to meters as sent, per echo
+  std::array<ChannelScaling, MAX_ECHOES>
+      intensity_scaling; ///< raw remission to reflectivity as sent, per echo
+
+  /**
+   * @brief Default init the info of a scan with 0 points, with distances in
+   * 1 mm steps
+   */
+  ScanInfo()
+      : size(0), n_echoes(1), time_source(ScanTimeSource::None),
+        time_since_boot_us(0), time_of_transmission_us(0), scan_frequency(0),
+        measurement_frequency(0), time_increment(0) {
+    range_scaling.fill(ChannelScaling{0.001f, 0});
+    intensity_scaling.fill(ChannelScaling{1, 0});
+  }
+
+  /**
+   * @param ray Index of a ray
+   *
+   * @return    Time at which \p ray was measured, in s after \ref time, i.e.
+   * after the first ray
+   */
+  float time_offset(size_t ray) const { return ray * time_increment; }
+};
+
+/**
+ * @brief   Struct for scan data
+ */
+struct Scan : ScanInfo {
+  EchoMatrix ranges;      ///< distances in meters, echoes x points
+  EchoMatrix intensities; ///< reflectivities, echoes x points
 
   /**
    * @brief Default init the scan with 0 points
    */
-  Scan() { size = 0; }
+  Scan() {}
 
   Scan(const Scan &other) = default;
+  Scan(Scan &&other) = default;
+  Scan &operator=(const Scan &other) = default;
+  Scan &operator=(Scan &&other) = default;
 };
 
+using ScanSink = std::function<void(
+    Scan &)>; ///< Receiver of completed scans which may take over the buffers
+
 /**
  * @brief   Trivial optional type
  *
@@ -87,6 +305,16 @@ public:
 
   bool has_value() const { return has_value_; }
 
+  /**
+   * @return    Reference to the wrapped value, without copying it
+   */
+  const T &value() const {
+    if (!has_value()) {
+      throw std::invalid_argument("optional has no content.");
+    }
+    return t_;
+  }
+
   operator T() const {
     if (!has_value()) {
       throw std::invalid_argument("optional has no content.");
@@ -124,13 +352,95 @@ struct Channel {
   bool valid() const;
 };
 
+/**
+ * @brief   Metadata preceding the values of one channel in a scan telegram
+ */
+struct ChannelHeader {
+  TokenView description;     ///< name of the channel, e.g. RSSI1, DIST1
+  unsigned int scale_factor; ///< 1 or 2, multiplier for the raw values
+  long offset;               ///< offset added to the scaled values
+  double start_angle;        ///< angle of the first value, LMS degrees
+  double ang_incr;           ///< angular step between values, degrees
+  long n_values;             ///< number of values following the header
+};
+
+/**
+ * @brief   Set the fields of \p info which only depend on the scan geometry
+ * (angles, \ref AngleTable). Does nothing if \p info already has this
+ * geometry.
+ *
+ * @param info  Scan info to update
+ * @param n_values  Number of rays
+ * @param start_angle   Angle of the first ray in LMS degrees
+ * @param ang_incr  Angular step between rays in degrees
+ * @param n_echoes  Number of echoes per ray
+ */
+void update_scan_angles(ScanInfo &info, unsigned int n_values,
+                        deg start_angle, deg ang_incr,
+                        unsigned int n_echoes = 1);
+
+/**
+ * @brief   Make sure \p scan is sized for \p n_echoes echoes of \p n_values
+ * rays and has the fields which only depend on the scan geometry (angles,
+ * \ref AngleTable) set. Does nothing if the scan already has this geometry,
+ * so it is cheap to call for every telegram.
+ *
+ * @param scan  Scan to update
+ * @param n_values  Number of rays
+ * @param start_angle   Angle of the first ray in LMS degrees
+ * @param ang_incr  Angular step between rays in degrees
+ * @param n_echoes  Number of echoes per ray
+ */
+void update_scan_geometry(Scan &scan, unsigned int n_values, deg start_angle,
+                          deg ang_incr, unsigned int n_echoes = 1);
+
+/**
+ * @brief   Set the timing fields of \p scan from the frequencies in the
+ * telegram header. The time between two rays is the inverse of the
+ * measurement frequency, or if that is not reported, the time the mirror takes
+ * to turn by the angular increment. Call after \ref update_scan_geometry().
+ *
+ * @param scan  Scan to update
+ * @param scan_frequency    Scan frequency in Hz
+ * @param measurement_frequency Measurement frequency in Hz
+ */
+void update_scan_timing(ScanInfo &scan, hz scan_frequency,
+                        hz measurement_frequency);
+
+/**
+ * @brief   Convert the date/time block of a scan telegram to a time point.
+ * Interpreted as local time, like the scanner's NTP client reports it. The
+ * result of `mktime()` is cached per hour, so consecutive scans only pay for
+ * adding the minutes and seconds.
+ *
+ * @return  Time point of the scan
+ */
+std::chrono::system_clock::time_point scan_time(long year, long month,
+                                                long day, long hour,
+                                                long minute, long second,
+                                                long microsecond);
+
 /**
  * @brief   Helper class to feed data telegrams to and assemble them to scans
  */
 class ScanBatcher {
-  std::vector<char> buffer;  ///< temporary data store
+  std::vector<char> buffer;  ///< partial telegram, size() is the capacity
   size_t num_bytes_buffered; ///< number of bytes currently buffered
   Scan s;                    ///< scan to return
+  PipelineStats *pipeline_stats; ///< if set, receives the timing hooks
+  std::vector<FrameSpan> frames;  ///< telegrams of the chunk being added
+
+  /**
+   * @brief Append to the buffered partial telegram
+   */
+  void append(const char *data, size_t length);
+
+  /**
+   * @brief Parse a complete telegram and pass the scan to \p sink
+   *
+   * @return    Whether a scan was passed to \p sink
+   */
+  bool handle_telegram(const char *telegram, size_t len, const ScanSink &sink);
 
 public:
   /**
@@ -138,10 +448,20 @@ public:
    */
   ScanBatcher();
 
+  /**
+   * @brief Report counters and stage timings to \p stats. The caller must
+   * call \ref PipelineStats::chunk_received() before each \ref add_data().
+   *
+   * @param stats   Statistics to update, or null to disable them. Must
+   * outlive the batcher.
+   */
+  void set_stats(PipelineStats *stats) { pipeline_stats = stats; }
+
   /**
    * @brief Add data, and get a scan if the data is complete. Function will
    * ingest new data and check if it completes currently buffered data to parse
-   * an entire scan.
+   * an entire scan. If the data completes several scans, the last one is
+   * returned.
    *
    * @param data_new    Data to append
    * @param length  Number of bytes in \p data_new
@@ -150,6 +470,22 @@ public:
    */
   simple_optional<Scan> add_data(const char *data_new, size_t length);
 
+  /**
+   * @brief Add data, and hand each completed scan to \p sink instead of
+   * copying it out. All telegrams completed by the data are parsed; those
+   * which lie completely within \p data_new are parsed in place. Bytes
+   * between telegrams, before STX, are skipped. The scan passed to \p sink is
+   * the batcher's own; the sink may swap it with storage of its own (e.g. a
+   * ring buffer slot) and the batcher continues with whatever was swapped in.
+   *
+   * @param data_new    Data to append
+   * @param length  Number of bytes in \p data_new
+   * @param sink    Receiver of completed scans
+   *
+   * @return    Number of scans passed to \p sink
+   */
+  size_t add_data(const char *data_new, size_t length, const ScanSink &sink);
+
   /**
    * @brief Helper function to parse a channel from a token buffer pointing to
    * the beginning of the channel's SOPA data
@@ -160,6 +496,18 @@ public:
    */
   static Channel parse_channel(TokenBuffer &buf);
 
+  /**
+   * @brief Helper function to parse the header of a channel from a token cursor
+   * pointing to the beginning of the channel's SOPAS data. Afterwards, \p cur
+   * points to the first value.
+   *
+   * @param cur Cursor that delivers the subsequent tokens
+   * @param header  Parsed header
+   *
+   * @return    Whether all header tokens were present
+   */
+  static bool parse_channel_header(TokenCursor &cur, ChannelHeader &header);
+
   /**
    * @brief Parse a complete scan telegram. Into a scan
    *
@@ -172,6 +520,23 @@ public:
    */
   static bool parse_scan_telegram(const std::vector<char> &buffer,
                                   size_t last_valid_idx, Scan &scan);
+
+  /**
+   * @brief Parse a complete scan telegram into a scan. Tokenizes in place and
+   * decodes the values straight into \p scan, so this does not allocate unless
+   * the scan geometry needs to be (re)initialized. Telegrams without a
+   * date/time block parse as well, with \ref ScanTimeSource::None. Each echo
+   * needs a distance (DIST) and a remission (RSSI) channel, up to
+   * \ref MAX_ECHOES.
+   *
+   * @param telegram    Telegram beginning with STX and ending with ETX
+   * @param len Number of bytes in \p telegram, including STX and ETX
+   * @param scan    Parse scan. Contents are undefined if the parse fails.
+   *
+   * @return    Whether the parse was successful and \p scan can be used
+   */
+  static bool parse_scan_telegram(const char *telegram, size_t len,
+                                  Scan &scan);
 };
 
 /**
@@ -192,7 +557,17 @@ enum SOPASCommand {
   RUN,
   LMDSCANDATA,
   LMCSTOPMEAS,
-  LMCSTARTMEAS
+  LMCSTARTMEAS,
+  UNKNOWN_COMMAND ///< reply to none of the above, or a generic error
+};
+
+/**
+ * @brief   Reply telegram classified by \ref classify_reply_ascii() or
+ * \ref classify_reply_binary()
+ */
+struct ReplyStatus {
+  SOPASCommand command; ///< command the reply answers
+  SickErr status;       ///< error or success code of the reply
 };
 
 /**
@@ -206,18 +581,31 @@ enum SOPASCommand {
  */
 std::string method(const char *sopas_reply, size_t len);
 
+/**
+ * @brief   Look up the command a reply answers from the method and name of
+ * the reply, e.g. `sAN SetAccessMode`, with a hash table built at compile time
+ * from the \ref CommandSpec of each command. Does not allocate.
+ *
+ * @param reply Method and name of the reply, without framing
+ * @param len   Number of bytes in \p reply
+ *
+ * @return  Answered command, or UNKNOWN_COMMAND
+ */
+SOPASCommand reply_command(const char *reply, size_t len);
+
 /**
  * @brief   Check command status code for validity for a fixed list of commands.
  * Some SOPAS methods need special handling, as a status of 1 usually means
  * success, but for some it's 0. This applies to e.g. `mEEwriteall` and `Run`.
- * That's pretty insane, but i guess it's legacy interest.
+ * That's pretty insane, but i guess it's legacy interest. The status of each
+ * command comes from its \ref CommandSpec, unknown commands succeed with 1.
  *
- * @param cmd_name  SOPAS command name
+ * @param command   Command answered by the reply
  * @param status_code   Status code parsed from telegram
  *
  * @return  Whether the status code signals an error for the given command
  */
-bool status_ok(const std::string &cmd_name, int status_code);
+bool status_ok(SOPASCommand command, int status_code);
 
 /**
  * @brief   Check if a string can constitute a valid SOPAS response. It must
@@ -240,4 +628,15 @@ bool validate_response(const char *data, size_t len);
  */
 SickErr status_from_bytes_ascii(const char *data, size_t len);
 
+/**
+ * @brief   Classify an ascii SOPAS response by the command it answers and
+ * parse its status, without allocating
+ *
+ * @param data  Data from scanner
+ * @param len   Length of \p data
+ *
+ * @return  Answered command and status of this telegram
+ */
+ReplyStatus classify_reply_ascii(const char *data, size_t len);
+
 } // namespace sick
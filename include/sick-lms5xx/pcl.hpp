@@ -9,7 +9,8 @@ class Scan;
 namespace pcl {
 
 /**
- * @brief   Convert Scan struct into PCL point cloud
+ * @brief   Convert Scan struct into PCL point cloud, using the first echo of
+ * multi-echo scans
  *
  * @param scan  Scan structure
  *
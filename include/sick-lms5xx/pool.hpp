@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sick-lms5xx/parsing.hpp>
+#include <vector>
+
+namespace sick {
+
+class ScanPool;
+
+/**
+ * @brief   Reference-counted handle to a scan living in a \ref ScanPool.
+ * Copying a handle only increments an atomic counter, and the slot returns to
+ * the pool when the last handle is destroyed. The pool must outlive all
+ * handles.
+ */
+class ScanPtr {
+  ScanPool *pool_; ///< owning pool, null for empty handles
+  uint32_t slot_;  ///< slot index in \ref pool_
+
+  friend class ScanPool;
+  ScanPtr(ScanPool *pool, uint32_t slot) : pool_(pool), slot_(slot) {}
+
+public:
+  /**
+   * @brief Empty handle
+   */
+  ScanPtr() : pool_(nullptr), slot_(0) {}
+
+  ScanPtr(const ScanPtr &other);
+  ScanPtr(ScanPtr &&other) noexcept;
+  ScanPtr &operator=(const ScanPtr &other);
+  ScanPtr &operator=(ScanPtr &&other) noexcept;
+  ~ScanPtr() { reset(); }
+
+  /**
+   * @brief Drop this reference, returning the slot to the pool if it was the
+   * last one
+   */
+  void reset();
+
+  /**
+   * @return    Pointer to the scan, null for empty handles
+   */
+  const Scan *get() const;
+
+  const Scan &operator*() const { return *get(); }
+  const Scan *operator->() const { return get(); }
+
+  /**
+   * @return    Whether the handle refers to a scan
+   */
+  explicit operator bool() const { return pool_ != nullptr; }
+};
+
+/**
+ * @brief   Fixed-size pool of scans which are handed out as \ref ScanPtr.
+ * Publishing swaps the producer's scan into a free slot, so neither the
+ * scan data nor the handle allocate or copy. Acquiring and releasing slots is
+ * lock-free and may happen on any thread.
+ */
+class ScanPool {
+  std::vector<Scan> slots_; ///< pooled scans
+  std::unique_ptr<std::atomic<uint32_t>[]>
+      refcounts_;                   ///< number of handles per slot
+  std::atomic<uint64_t> free_;      ///< bit i is set if slot i is free
+  std::atomic<uint64_t> exhausted_; ///< publishes which found no free slot
+
+  friend class ScanPtr;
+
+  void retain(uint32_t slot);
+  void release(uint32_t slot);
+
+public:
+  static constexpr size_t MAX_SIZE = 64; ///< maximum number of slots
+
+  /**
+   * @param size    Number of scans in the pool, at most \ref MAX_SIZE. This
+   * bounds the number of scans consumers can hold on to at the same time.
+   */
+  explicit ScanPool(size_t size);
+
+  ScanPool(const ScanPool &other) = delete;
+  ScanPool &operator=(const ScanPool &other) = delete;
+
+  /**
+   * @brief Move a scan into a free slot. \p scan is swapped with the slot's
+   * previous contents, so it keeps buffers which can be reused.
+   *
+   * @param scan    Scan to publish
+   *
+   * @return    Handle to the pooled scan, empty if all slots are in use
+   */
+  ScanPtr publish(Scan &scan);
+
+  /**
+   * @return    Number of slots not referenced by any handle
+   */
+  size_t available() const;
+
+  /**
+   * @return    Number of slots
+   */
+  size_t size() const { return slots_.size(); }
+
+  /**
+   * @return    Number of scans which could not be published because all
+   * slots were in use
+   */
+  uint64_t exhausted() const { return exhausted_.load(); }
+};
+
+using PooledScanCallback =
+    std::function<void(ScanPtr)>; ///< Callback type for pooled scans
+
+} // namespace sick
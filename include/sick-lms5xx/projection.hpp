@@ -0,0 +1,145 @@
+#pragma once
+#include <Eigen/Geometry>
+#include <chrono>
+#include <cstddef>
+#include <sick-lms5xx/parsing.hpp>
+
+namespace sick {
+
+/**
+ * @brief   Convert polar ranges to Cartesian coordinates, `x = r * cos`,
+ * `y = r * sin`. Uses the widest SIMD kernel the library was compiled for
+ * (AVX, SSE or NEON) and a scalar loop for the remainder. No alignment is
+ * required of any of the buffers.
+ *
+ * @param ranges    Ranges in meters
+ * @param cos_map   Cosine of each ray's angle
+ * @param sin_map   Sine of each ray's angle
+ * @param n Number of rays
+ * @param x Output, n x coordinates
+ * @param y Output, n y coordinates
+ */
+void project_polar(const float *ranges, const float *cos_map,
+                   const float *sin_map, size_t n, float *x, float *y);
+
+/**
+ * @brief   Scalar reference implementation of \ref project_polar()
+ */
+void project_polar_scalar(const float *ranges, const float *cos_map,
+                          const float *sin_map, size_t n, float *x, float *y);
+
+/**
+ * @return  Name of the kernel used by \ref project_polar(), e.g. `avx`
+ */
+const char *projection_kernel();
+
+/**
+ * @brief   Project a range of rays of a scan into structure-of-arrays
+ * buffers provided by the caller
+ *
+ * @param scan  Scan with valid geometry
+ * @param begin Index of the first ray
+ * @param n Number of rays, `begin + n` must not exceed the scan size
+ * @param x Output, n x coordinates in meters
+ * @param y Output, n y coordinates in meters
+ * @param intensity Optional output, n intensities. Skipped if null.
+ * @param echo  Echo to project, less than `scan.n_echoes`
+ */
+void project_scan(const Scan &scan, size_t begin, size_t n, float *x,
+                  float *y, float *intensity = nullptr, unsigned int echo = 0);
+
+/**
+ * @brief   Project all rays of a scan, see \ref project_scan(const Scan &,
+ * size_t, size_t, float *, float *, float *, unsigned int)
+ *
+ * @param scan  Scan with valid geometry
+ * @param x Output, `scan.size` x coordinates in meters
+ * @param y Output, `scan.size` y coordinates in meters
+ * @param intensity Optional output, `scan.size` intensities
+ * @param echo  Echo to project, less than `scan.n_echoes`
+ */
+void project_scan(const Scan &scan, float *x, float *y,
+                  float *intensity = nullptr, unsigned int echo = 0);
+
+/**
+ * @brief   Motion of the scanner at constant velocity between two poses, for
+ * \ref deskew_scan(). Rotation is interpolated along the shortest arc and
+ * translation linearly. Before the first and after the second pose, the
+ * motion is extrapolated.
+ */
+class PoseInterpolator {
+  Eigen::Isometry3f begin_; ///< pose at \ref begin_time_
+  std::chrono::system_clock::time_point begin_time_; ///< time of \ref begin_
+  double duration_s_;           ///< time from the first to the second pose
+  Eigen::Vector3f axis_;        ///< rotation axis, in the frame of \ref begin_
+  float angle_;                 ///< rotation angle from the first to the second
+  Eigen::Vector3f translation_; ///< translation, in the frame of \ref begin_
+
+public:
+  /**
+   * @param begin   Pose of the scanner at \p begin_time
+   * @param begin_time  Time of \p begin
+   * @param end Pose of the scanner at \p end_time
+   * @param end_time    Time of \p end
+   */
+  PoseInterpolator(const Eigen::Isometry3f &begin,
+                   std::chrono::system_clock::time_point begin_time,
+                   const Eigen::Isometry3f &end,
+                   std::chrono::system_clock::time_point end_time);
+
+  /**
+   * @brief Motion during \p scan, from its first to its last ray
+   *
+   * @param scan    Scan with valid geometry and timing
+   * @param begin   Pose of the scanner at the first ray
+   * @param end Pose of the scanner at the last ray
+   */
+  PoseInterpolator(const Scan &scan, const Eigen::Isometry3f &begin,
+                   const Eigen::Isometry3f &end);
+
+  /**
+   * @return    Interpolated pose at \p time
+   */
+  Eigen::Isometry3f at(std::chrono::system_clock::time_point time) const;
+
+  /**
+   * @return    Fraction of the motion from the first to the second pose
+   * completed at \p time, 0 if both poses are at the same time
+   */
+  double fraction(std::chrono::system_clock::time_point time) const;
+
+  /**
+   * @return    Fraction of the motion completed per second
+   */
+  double rate() const { return duration_s_ > 0 ? 1 / duration_s_ : 0; }
+
+  const Eigen::Isometry3f &begin() const { return begin_; }
+  const Eigen::Vector3f &axis() const { return axis_; }
+  float angle() const { return angle_; }
+  const Eigen::Vector3f &translation() const { return translation_; }
+};
+
+/**
+ * @brief   Project all rays of a scan to 3D and compensate the motion of the
+ * scanner while it sweeps. Each ray is transformed by the pose at the time it
+ * was measured (\ref Scan::time_offset()), so the points are in the frame in
+ * which \p motion is given. Pass the identity as first pose to get the points
+ * in the frame of the scanner at the first ray.
+ *
+ * The rays are processed in blocks of eight with Eigen's fixed-size
+ * vectorization. The rotation angle of each ray is advanced by a recurrence
+ * instead of evaluating sine and cosine per ray. Nothing is allocated.
+ *
+ * @param scan  Scan with valid geometry and timing
+ * @param motion    Motion of the scanner
+ * @param x Output, `scan.size` x coordinates in meters
+ * @param y Output, `scan.size` y coordinates in meters
+ * @param z Output, `scan.size` z coordinates in meters
+ * @param intensity Optional output, `scan.size` intensities
+ * @param echo  Echo to project, less than `scan.n_echoes`
+ */
+void deskew_scan(const Scan &scan, const PoseInterpolator &motion, float *x,
+                 float *y, float *z, float *intensity = nullptr,
+                 unsigned int echo = 0);
+
+} // namespace sick
@@ -0,0 +1,255 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sick {
+
+/*
+ * Recording file layout, all integers little-endian:
+ *
+ *   header   magic "SICKREC1", u32 version, u32 index interval in ms
+ *   records  u64 receive time in ns (steady clock), u32 length, data
+ *   index    entries of u64 time, u64 record offset, u64 telegram offset
+ *   footer   u64 index offset, u64 number of index entries, magic "SICKIDX1"
+ *
+ * Index and footer are appended when the recording is closed. If they are
+ * missing, e.g. after a crash, the index is rebuilt from the records.
+ */
+
+static constexpr size_t RECORDING_HEADER_SIZE = 16; ///< file header bytes
+static constexpr size_t RECORD_HEADER_SIZE = 12; ///< time and length bytes
+static constexpr size_t RECORDING_INDEX_ENTRY_SIZE = 24; ///< index entry bytes
+static constexpr size_t RECORDING_FOOTER_SIZE = 24;      ///< footer bytes
+
+/**
+ * @brief   Read a little-endian unsigned integer of \p N bytes
+ *
+ * @param data  Pointer to the first (least significant) byte
+ *
+ * @return  Value in host byte order
+ */
+template <size_t N> inline uint64_t read_le(const char *data) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < N; ++i) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * @brief   Check whether data begins with the header of a recording written
+ * by \ref TelegramRecorder
+ *
+ * @param data  Beginning of a file
+ * @param len   Number of bytes in \p data
+ *
+ * @return  Whether magic bytes and version match
+ */
+bool is_recording(const char *data, size_t len);
+
+/**
+ * @brief   Seek point in a recording
+ */
+struct RecordingIndexEntry {
+  uint64_t timestamp_ns;    ///< receive time of the record
+  uint64_t record_offset;   ///< file offset of the record header
+  uint64_t telegram_offset; ///< file offset of the first telegram start (STX)
+                            ///< in the record's data
+};
+
+/**
+ * @brief   Records raw data received from a scanner into an indexed file, for
+ * replaying it later.
+ *
+ * \ref record() only copies the data into a preallocated single-producer
+ * single-consumer byte ring, so it never blocks the caller on disk I/O. A
+ * background thread drains the ring with large buffered writes and keeps a
+ * seek index with one telegram boundary per index interval. If the writer
+ * falls behind and the ring fills up, data is dropped and counted.
+ */
+class TelegramRecorder {
+  std::unique_ptr<char[]> ring_;      ///< byte ring between caller and writer
+  const size_t ring_capacity_;        ///< size of \ref ring_, a power of two
+  std::atomic<uint64_t> ring_head_;   ///< next byte to write (caller)
+  char pad0_[64];
+  std::atomic<uint64_t> ring_tail_;   ///< next byte to read (writer)
+  char pad1_[64];
+
+  const uint64_t index_interval_ns_; ///< minimum time between index entries
+  std::vector<RecordingIndexEntry> index_; ///< seek index written at close
+  std::vector<char> write_buffer_;         ///< data staged for writing
+  uint64_t file_offset_;                   ///< bytes written to the file
+  int fd_;                                 ///< output file
+
+  std::thread writer_;         ///< background writer thread
+  std::atomic<bool> stop_;     ///< stop flag for \ref writer_
+  std::atomic<bool> failed_;   ///< set if writing to the file failed
+  std::atomic<uint64_t> recorded_;
+  std::atomic<uint64_t> dropped_;
+
+  /**
+   * @brief Writer thread main loop
+   */
+  void write_loop();
+
+  /**
+   * @brief Move all records from the ring into \ref write_buffer_ and update
+   * the index
+   *
+   * @return    Whether any data was taken from the ring
+   */
+  bool drain();
+
+  /**
+   * @brief Write \p len bytes to the file, retrying partial writes
+   */
+  bool write_fully(const char *data, size_t len);
+
+public:
+  /**
+   * @brief Create or truncate a recording and start the writer thread
+   *
+   * @param path    File to record to
+   * @param buffer_size Bytes which can be buffered between the caller and the
+   * writer. Rounded up to a power of two.
+   * @param index_interval  Minimum time between seek index entries
+   */
+  explicit TelegramRecorder(
+      const std::string &path, size_t buffer_size = 4 << 20,
+      std::chrono::milliseconds index_interval = std::chrono::seconds(1));
+
+  TelegramRecorder(const TelegramRecorder &other) = delete;
+  TelegramRecorder &operator=(const TelegramRecorder &other) = delete;
+
+  /**
+   * @brief Record a chunk of received data with the current steady clock
+   * time. Must only be called from a single thread. Does not block.
+   *
+   * @param data    Received data
+   * @param len Number of bytes in \p data
+   *
+   * @return    Whether the data was queued. False if the buffer was full, the
+   * recorder was closed or writing failed.
+   */
+  bool record(const char *data, size_t len);
+
+  /**
+   * @brief Write all queued data and the seek index, and close the file.
+   * Called by the destructor.
+   *
+   * @return    Whether all data was written successfully
+   */
+  bool close();
+
+  /**
+   * @return    Number of recorded chunks
+   */
+  uint64_t recorded() const { return recorded_.load(); }
+
+  /**
+   * @return    Number of chunks dropped because the buffer was full
+   */
+  uint64_t dropped() const { return dropped_.load(); }
+
+  /**
+   * @return    Whether writing the file has failed
+   */
+  bool failed() const { return failed_.load(); }
+
+  ~TelegramRecorder();
+};
+
+/**
+ * @brief   Chunk of data read from a recording
+ */
+struct RecordedChunk {
+  uint64_t timestamp_ns;  ///< receive time in ns on the steady clock
+  std::vector<char> data; ///< received bytes
+};
+
+/**
+ * @brief   Sequential reader for files written by \ref TelegramRecorder
+ */
+class RecordingReader {
+  std::FILE *file_;                        ///< open recording
+  std::vector<RecordingIndexEntry> index_; ///< seek index
+  bool index_rebuilt_; ///< whether the index was missing from the file
+  uint64_t data_end_;  ///< end of the last complete record
+  uint64_t pos_;       ///< file offset of the next record
+  uint64_t skip_to_;   ///< data before this offset is not returned by next()
+
+  /**
+   * @brief Read the index from the footer, or rebuild it from the records
+   *
+   * @param index_interval_ns   Interval from the file header
+   */
+  void load_index(uint64_t index_interval_ns);
+
+  /**
+   * @brief Read \p len bytes at \p offset
+   */
+  bool read_at(uint64_t offset, char *data, size_t len);
+
+public:
+  /**
+   * @param path    Recording to open
+   */
+  explicit RecordingReader(const std::string &path);
+
+  RecordingReader(const RecordingReader &other) = delete;
+  RecordingReader &operator=(const RecordingReader &other) = delete;
+
+  /**
+   * @return    Seek index, sorted by time
+   */
+  const std::vector<RecordingIndexEntry> &index() const { return index_; }
+
+  /**
+   * @return    Whether the index had to be rebuilt because the recording was
+   * not closed properly
+   */
+  bool index_rebuilt() const { return index_rebuilt_; }
+
+  /**
+   * @return    File offset of the first record
+   */
+  uint64_t data_begin() const { return RECORDING_HEADER_SIZE; }
+
+  /**
+   * @return    File offset behind the last complete record
+   */
+  uint64_t data_end() const { return data_end_; }
+
+  /**
+   * @brief Continue reading from the last telegram boundary in the index at
+   * or before \p timestamp_ns. Data preceding that telegram in its record is
+   * skipped, so the next chunk starts with a complete telegram.
+   *
+   * @param timestamp_ns    Receive time to seek to
+   */
+  void seek(uint64_t timestamp_ns);
+
+  /**
+   * @brief Seek to the beginning of the recording
+   */
+  void rewind();
+
+  /**
+   * @brief Read the next chunk
+   *
+   * @param chunk   Output chunk, its buffer is reused
+   *
+   * @return    False at the end of the recording
+   */
+  bool next(RecordedChunk &chunk);
+
+  ~RecordingReader();
+};
+
+} // namespace sick
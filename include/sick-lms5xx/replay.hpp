@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sick-lms5xx/binary.hpp>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/sopas.hpp>
+#include <string>
+
+namespace sick {
+
+/**
+ * @brief   Replays captured scanner data through the telegram batchers and a
+ * scan callback, without a scanner. Useful for regression tests and for
+ * benchmarking the parse-to-callback pipeline.
+ *
+ * The file is memory-mapped and fed to the batcher straight from the mapped
+ * pages. Telegrams which lie completely within one chunk are parsed in place,
+ * only telegrams split across chunks are copied.
+ *
+ * Two kinds of files are accepted: recordings written by
+ * \ref TelegramRecorder, which are replayed chunk by chunk with their receive
+ * times, and raw captures, e.g. concatenated telegrams, which are paced by
+ * the time stamps in the scans, or by the scanner clock if the telegrams have
+ * no date/time block. Binary (CoLa-B) data is detected by its magic bytes.
+ */
+class ReplaySource {
+  const char *data_;       ///< mapped file
+  size_t size_;            ///< size of the mapping
+  bool recording_;         ///< whether the file is a recording
+  bool binary_;            ///< whether the data is CoLa-B
+  uint64_t data_begin_;    ///< offset of the captured data
+  uint64_t data_end_;      ///< end of the captured data
+  ScanCallback callback_;  ///< callback for complete scans
+  double speed_;           ///< replay speed factor, 0 for unpaced
+  std::atomic<bool> stop_; ///< set by \ref stop()
+
+  ScanBatcher batcher_;              ///< batcher for ASCII data
+  BinaryScanBatcher binary_batcher_; ///< batcher for binary data
+
+  std::chrono::steady_clock::time_point
+      start_wall_;          ///< wall time at which the replay started
+  uint64_t start_data_ns_;  ///< data time at which the replay started
+  bool started_;            ///< whether the first time stamp was seen
+
+  /**
+   * @brief Wait until data with time stamp \p data_ns is due
+   */
+  void pace(uint64_t data_ns);
+
+  /**
+   * @brief Pass a chunk of captured data to the batcher
+   *
+   * @return    Number of completed scans
+   */
+  size_t feed(const char *data, size_t len, const ScanSink &sink);
+
+public:
+  /**
+   * @brief Map a capture file
+   *
+   * @param path    Recording or raw capture
+   * @param fn  Callback for complete scans
+   */
+  ReplaySource(const std::string &path, const ScanCallback &fn);
+
+  ReplaySource(const ReplaySource &other) = delete;
+  ReplaySource &operator=(const ReplaySource &other) = delete;
+
+  /**
+   * @brief Set the replay speed
+   *
+   * @param speed   1 for real time, e.g. 4 for four times as fast, 0 to
+   * replay as fast as possible
+   */
+  void set_speed(double speed);
+
+  /**
+   * @brief Replay the whole file on the calling thread
+   *
+   * @return    Number of scans passed to the callback
+   */
+  size_t run();
+
+  /**
+   * @brief Make a running \ref run() return after the current chunk. Can be
+   * called from any thread.
+   */
+  void stop();
+
+  /**
+   * @return    Whether the file is a recording rather than a raw capture
+   */
+  bool is_recording() const { return recording_; }
+
+  /**
+   * @return    Whether the file contains binary (CoLa-B) telegrams
+   */
+  bool is_binary() const { return binary_; }
+
+  ~ReplaySource();
+};
+
+} // namespace sick
@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <sick-lms5xx/parsing.hpp>
+#include <vector>
+
+namespace sick {
+
+/**
+ * @brief   What to do when a scan is pushed into a full \ref ScanRing
+ */
+enum class OverrunPolicy {
+  DropOldest, ///< discard the oldest unread scan, never stall the producer
+  Block       ///< wait until the consumer frees a slot
+};
+
+/**
+ * @brief   Counters of a \ref ScanRing
+ */
+struct ScanRingStats {
+  uint64_t pushed;   ///< scans accepted from the producer
+  uint64_t popped;   ///< scans handed to the consumer
+  uint64_t overruns; ///< scans dropped because the ring was full
+  uint64_t blocked;  ///< pushes which had to wait for a free slot
+};
+
+/**
+ * @brief   Bounded, preallocated, lock-free single-producer single-consumer
+ * ring of scans. Decouples the socket poller from slow consumers.
+ *
+ * Scans are not copied: \ref push() swaps the producer's scan with a free
+ * slot, and \ref try_pop() lends the consumer a slot which stays valid until
+ * its next pop. The ring only passes slot indices around, so a dropped scan
+ * is reclaimed by the producer with a single compare-and-swap.
+ */
+class ScanRing {
+  const size_t capacity_;     ///< number of scans the ring can queue
+  const OverrunPolicy policy_; ///< behaviour when full
+  std::vector<Scan> slots_;   ///< storage, queue plus producer/consumer slots
+
+  std::unique_ptr<std::atomic<uint32_t>[]>
+      queue_; ///< slot indices of queued scans, in order
+  std::unique_ptr<std::atomic<uint32_t>[]>
+      free_; ///< slot indices returned by the consumer
+
+  std::atomic<uint64_t> head_; ///< next queue position to write (producer)
+  char pad0_[64];
+  std::atomic<uint64_t> tail_; ///< next queue position to read (both)
+  char pad1_[64];
+  std::atomic<uint64_t> free_head_; ///< next free list position to write
+  char pad2_[64];
+  uint64_t free_tail_;    ///< next free list position to read (producer)
+  uint32_t producer_slot_; ///< slot the producer swaps into next
+  uint32_t consumer_slot_; ///< slot lent to the consumer
+  bool consumer_has_slot_; ///< whether \ref consumer_slot_ is lent out
+
+  std::atomic<bool> closed_; ///< set by \ref close()
+
+  std::atomic<uint64_t> pushed_;
+  std::atomic<uint64_t> popped_;
+  std::atomic<uint64_t> overruns_;
+  std::atomic<uint64_t> blocked_;
+
+  /**
+   * @brief Take a slot from the free list. Producer side only.
+   */
+  uint32_t take_free_slot();
+
+public:
+  /**
+   * @param capacity    Number of scans which can be queued
+   * @param policy  Behaviour when a scan is pushed into a full ring
+   */
+  explicit ScanRing(size_t capacity, OverrunPolicy policy =
+                                          OverrunPolicy::DropOldest);
+
+  ScanRing(const ScanRing &other) = delete;
+  ScanRing &operator=(const ScanRing &other) = delete;
+
+  /**
+   * @brief Queue a scan. Must only be called from a single producer thread.
+   * The contents of \p scan are swapped with a free slot, so afterwards it
+   * holds the buffers of an old scan which can be reused.
+   *
+   * @param scan    Scan to queue
+   *
+   * @return    False if the ring was closed, true otherwise (also if an old
+   * scan had to be dropped)
+   */
+  bool push(Scan &scan);
+
+  /**
+   * @brief Get the oldest queued scan, if any. Must only be called from a
+   * single consumer thread.
+   *
+   * @return    Pointer to the scan, valid until the next pop. Null if the ring
+   * is empty.
+   */
+  const Scan *try_pop();
+
+  /**
+   * @brief Like \ref try_pop(), but wait up to \p timeout for a scan
+   *
+   * @param timeout Maximum time to wait
+   *
+   * @return    Pointer to the scan, valid until the next pop. Null if no scan
+   * arrived in time or the ring was closed and is empty.
+   */
+  const Scan *pop(std::chrono::microseconds timeout);
+
+  /**
+   * @brief Wake up a blocked producer and make further pushes fail. Queued
+   * scans can still be popped.
+   */
+  void close();
+
+  /**
+   * @return    Whether \ref close() has been called
+   */
+  bool closed() const { return closed_.load(); }
+
+  /**
+   * @return    Number of queued scans
+   */
+  size_t size() const;
+
+  /**
+   * @return    Maximum number of queued scans
+   */
+  size_t capacity() const { return capacity_; }
+
+  /**
+   * @return    Snapshot of the counters. Can be called from any thread.
+   */
+  ScanRingStats stats() const;
+};
+
+} // namespace sick
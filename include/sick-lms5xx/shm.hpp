@@ -0,0 +1,258 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sick-lms5xx/compact.hpp>
+#include <sick-lms5xx/parsing.hpp>
+#include <string>
+
+namespace sick {
+
+/// Rays of the densest scan: 190 degrees at 0.1667 degrees
+static constexpr unsigned int SHM_DEFAULT_MAX_RAYS = 1141;
+
+struct ShmSegmentHeader;
+struct ShmSlot;
+
+/**
+ * @brief   Zero-copy view of a scan in a shared memory segment, see
+ * \ref ScanSubscriber::next(). The values are those of a \ref CompactScan.
+ * Everything read through the view must be discarded unless \ref valid()
+ * confirms afterwards that the publisher has not overwritten the slot in the
+ * meantime:
+ *
+ *      ShmScanView view;
+ *      while (subscriber.next(view)) {
+ *        decode_u16(view.ranges(), view.size(), view.range_scaling(), x);
+ *        if (view.valid()) {
+ *          use(x);
+ *        }
+ *      }
+ */
+class ShmScanView {
+  friend class ScanSubscriber;
+
+  const ShmSlot *slot_;        ///< slot in the segment
+  const uint16_t *ranges_;     ///< raw distances of the slot
+  const uint8_t *intensities_; ///< raw remissions of the slot
+  unsigned int max_rays_;      ///< row stride of the values
+  uint64_t sequence_;          ///< seqlock sequence when the view was made
+  uint64_t index_;             ///< publication number of the scan
+
+public:
+  ShmScanView();
+
+  /**
+   * @return    Publication number of the scan, counting from 0
+   */
+  uint64_t index() const { return index_; }
+
+  /**
+   * @return    Number of rays, at most the rays of a slot even if torn
+   */
+  unsigned int size() const;
+
+  /**
+   * @return    Number of echoes per ray, at most MAX_ECHOES even if torn
+   */
+  unsigned int n_echoes() const;
+
+  /**
+   * @return    Raw distances of \p echo, \ref size() values
+   */
+  const uint16_t *ranges(unsigned int echo = 0) const {
+    return ranges_ + static_cast<size_t>(echo) * max_rays_;
+  }
+
+  /**
+   * @return    Raw remissions of \p echo, \ref size() values
+   */
+  const uint8_t *intensities(unsigned int echo = 0) const {
+    return intensities_ + static_cast<size_t>(echo) * max_rays_;
+  }
+
+  /**
+   * @return    Conversion of the distances of \p echo to meters
+   */
+  ChannelScaling range_scaling(unsigned int echo = 0) const;
+
+  /**
+   * @return    Conversion of the remissions of \p echo
+   */
+  ChannelScaling intensity_scaling(unsigned int echo = 0) const;
+
+  /**
+   * @return    Whether everything read through the view so far is
+   * consistent, i.e. the publisher has not started to overwrite the slot
+   */
+  bool valid() const;
+
+  /**
+   * @brief Fill geometry, timing, time stamps and channel scaling of the scan
+   * into \p info
+   *
+   * @return    False if the slot was overwritten, \p info is unchanged then
+   */
+  bool info(ScanInfo &info) const;
+};
+
+/**
+ * @brief   Publishes scans into a POSIX shared memory segment (`/dev/shm` on
+ * Linux), from which any number of local processes can read them with
+ * \ref ScanSubscriber, e.g. from the scan callback:
+ *
+ *      ScanPublisher publisher("/lms-front");
+ *      SOPASProtocolBinary proto(ip, port, [&](const Scan &scan) {
+ *        publisher.publish(scan);
+ *      });
+ *
+ * The segment is a ring of fixed-size slots which hold the values like a
+ * \ref CompactScan. Each slot is guarded by a sequence lock: the publisher
+ * never waits for subscribers, and subscribers detect a scan which was
+ * overwritten while they read it. Subscribers which fall behind by more than
+ * the ring skip the oldest scans.
+ *
+ * Only one thread may publish. The segment is removed when the publisher is
+ * destroyed; attached subscribers keep their mapping and see
+ * \ref ScanSubscriber::closed().
+ */
+class ScanPublisher {
+  std::string name_;         ///< name of the segment
+  void *base_;               ///< start of the mapping
+  size_t size_;              ///< length of the mapping
+  ShmSegmentHeader *header_; ///< header at the start of the mapping
+  uint64_t published_;       ///< scans published so far
+  CompactScan compact_;      ///< buffer for converting float scans
+
+  /**
+   * @brief Claim the next slot: make it odd so readers back off, and fill
+   * the fields shared by both scan types
+   *
+   * @return    The slot, or null if the scan does not fit
+   */
+  ShmSlot *begin_write(const ScanInfo &info);
+
+  /**
+   * @brief Release a slot claimed by \ref begin_write() to readers
+   */
+  void end_write(ShmSlot *slot);
+
+public:
+  /**
+   * @brief Create the segment, replacing one of the same name which was left
+   * behind by a publisher that shut down or crashed
+   *
+   * @param name    Segment name, starting with a slash, e.g. `/lms-front`
+   * @param n_slots Number of scans kept in the ring
+   * @param max_rays    Most rays per scan, with up to MAX_ECHOES echoes each
+   *
+   * @throws std::runtime_error if the segment cannot be created or mapped,
+   * e.g. with EEXIST while another live publisher uses \p name
+   */
+  explicit ScanPublisher(const std::string &name, size_t n_slots = 16,
+                         unsigned int max_rays = SHM_DEFAULT_MAX_RAYS);
+
+  ~ScanPublisher();
+
+  ScanPublisher(const ScanPublisher &other) = delete;
+  ScanPublisher &operator=(const ScanPublisher &other) = delete;
+
+  /**
+   * @brief Publish \p scan, stored with the channel scaling of its telegram
+   * like \ref compact_scan(). Values which do not fit are clamped.
+   *
+   * @return    False if the scan has more rays than the slots hold
+   */
+  bool publish(const Scan &scan);
+
+  /**
+   * @brief Publish \p scan with its raw values and scaling
+   *
+   * @return    False if the scan has more rays than the slots hold
+   */
+  bool publish(const CompactScan &scan);
+
+  /**
+   * @return    Number of scans published
+   */
+  uint64_t published() const { return published_; }
+};
+
+/**
+ * @brief   Reads the scans of a \ref ScanPublisher from shared memory. Reading
+ * takes no system calls and, with \ref next(), no copies. A subscriber starts
+ * with the first scan published after it attached.
+ *
+ * A subscriber must only be used by one thread at a time.
+ */
+class ScanSubscriber {
+  const void *base_;               ///< start of the mapping
+  size_t size_;                    ///< length of the mapping
+  const ShmSegmentHeader *header_; ///< header at the start of the mapping
+  uint64_t next_;                  ///< publication number to read next
+  uint64_t dropped_; ///< scans overwritten before they were read
+
+  /**
+   * @return    Slot of publication number \p index
+   */
+  const ShmSlot *slot(uint64_t index) const;
+
+public:
+  /**
+   * @brief Attach to the segment of a publisher
+   *
+   * @param name    Segment name passed to the publisher
+   *
+   * @throws std::runtime_error if the segment does not exist or is not a
+   * scan segment of this version
+   */
+  explicit ScanSubscriber(const std::string &name);
+
+  ~ScanSubscriber();
+
+  ScanSubscriber(const ScanSubscriber &other) = delete;
+  ScanSubscriber &operator=(const ScanSubscriber &other) = delete;
+
+  /**
+   * @brief Point \p view at the next unread scan, skipping scans which were
+   * already overwritten
+   *
+   * @return    False if no new scan has been published
+   */
+  bool next(ShmScanView &view);
+
+  /**
+   * @brief Copy the next unread scan into \p scan, reusing its buffers
+   *
+   * @return    False if no new scan has been published
+   */
+  bool read(CompactScan &scan);
+
+  /**
+   * @brief Poll until a new scan is published, first spinning, then sleeping
+   * in short steps
+   *
+   * @param timeout Maximum time to wait
+   *
+   * @return    Whether a new scan is available
+   */
+  bool wait(std::chrono::microseconds timeout) const;
+
+  /**
+   * @return    Whether a new scan is available
+   */
+  bool available() const;
+
+  /**
+   * @return    Whether the publisher has shut down
+   */
+  bool closed() const;
+
+  /**
+   * @return    Number of scans which were overwritten before this subscriber
+   * read them
+   */
+  uint64_t dropped() const { return dropped_; }
+};
+
+} // namespace sick
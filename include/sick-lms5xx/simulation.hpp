@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <sick-lms5xx/config.hpp>
+#include <vector>
+
+namespace sick {
+
+/**
+ * @brief   Geometry and rate of synthetic scans
+ */
+struct SimulationConfig {
+  hz frequency;       ///< scan frequency
+  deg resolution;     ///< angular increment between rays
+  deg start_angle;    ///< angle of the first ray, in LMS coordinates
+  unsigned int n_points; ///< number of rays
+  bool time_block; ///< whether telegrams carry the date/time block, as with NTP
+  unsigned int n_echoes; ///< echoes per ray, each farther than the previous
+
+  /**
+   * @brief Full 190° field of view at 25 Hz and 0.1667° resolution
+   */
+  SimulationConfig();
+
+  /**
+   * @brief Cover the field of view from \p start_angle to \p end_angle
+   *
+   * @param frequency   Scan frequency
+   * @param resolution  Angular increment
+   * @param start_angle First angle in LMS coordinates
+   * @param end_angle   Last angle in LMS coordinates
+   */
+  SimulationConfig(hz frequency, deg resolution, deg start_angle = -5,
+                   deg end_angle = 185);
+
+  /**
+   * @return    Angle of the last ray, in LMS coordinates
+   */
+  deg end_angle() const;
+};
+
+/**
+ * @brief   Synthesize an ASCII (CoLa-A) `LMDscandata` telegram with a 16 bit
+ * distance and an 8 bit remission channel per echo, in the layout the scanner
+ * uses with this library's data configuration. Ranges describe a slowly
+ * changing room outline.
+ *
+ * @param config    Scan geometry
+ * @param counter   Scan counter, also varies the ranges
+ * @param time  Time stamp of the scan
+ * @param telegram  Output, STX to ETX. Its capacity is reused.
+ */
+void synthesize_scan_ascii(const SimulationConfig &config, uint16_t counter,
+                           std::chrono::system_clock::time_point time,
+                           std::vector<char> &telegram);
+
+/**
+ * @brief   Binary (CoLa-B) counterpart of \ref synthesize_scan_ascii()
+ *
+ * @param config    Scan geometry
+ * @param counter   Scan counter, also varies the ranges
+ * @param time  Time stamp of the scan
+ * @param telegram  Output, complete frame with checksum
+ */
+void synthesize_scan_binary(const SimulationConfig &config, uint16_t counter,
+                            std::chrono::system_clock::time_point time,
+                            std::vector<char> &telegram);
+
+} // namespace sick
@@ -1,10 +1,20 @@
 #pragma once
 #include <atomic>
 #include <iostream>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <sick-lms5xx/binary.hpp>
+#include <sick-lms5xx/command.hpp>
+#include <sick-lms5xx/command_table.hpp>
+#include <sick-lms5xx/connection.hpp>
 #include <sick-lms5xx/network.hpp>
 #include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/pool.hpp>
+#include <sick-lms5xx/recorder.hpp>
+#include <sick-lms5xx/ring.hpp>
+#include <sick-lms5xx/stats.hpp>
+#include <sick-lms5xx/streaming.hpp>
+#include <sick-lms5xx/timesync.hpp>
 #include <thread>
 #include <unistd.h>
 
@@ -18,6 +28,8 @@ using ScanCallback =
  */
 class SOPASProtocol {
 
+  friend class ScannerHub; ///< receives on behalf of the poller
+
 protected:
   const std::string sensor_ip_; ///< ip address of the sensor
   const uint32_t
@@ -25,9 +37,201 @@ protected:
   ScanCallback callback_;  ///< callback for complete scans
   std::atomic<bool> stop_; ///< stop flag for thread
   std::thread poller_;     ///< scanner polling thread
-  ScanBatcher batcher_;    ///< batcher for partial telegrams
+  StreamingScanBatcher
+      batcher_; ///< parses ASCII telegrams while they arrive
+
+  std::shared_ptr<ScanRing>
+      ring_; ///< if set, scans are published here instead of \ref callback_
+  std::shared_ptr<ScanPool>
+      pool_; ///< if set, scans are handed out from here to \ref pool_callback_
+  PooledScanCallback pool_callback_; ///< callback for pooled scans
+  std::shared_ptr<TelegramRecorder>
+      recorder_; ///< if set, received data is recorded here
+  std::shared_ptr<PipelineStats>
+      stats_; ///< if set, the receive path is instrumented
+
+  int sock_fd_;                  ///< socket file descriptor
+  const unsigned int timeout_s_; ///< socket timeout for connect and receive
+
+  /**
+   * @brief Setup which succeeded on the current connection, replayed after a
+   * reconnect
+   */
+  struct Session {
+    bool has_access_mode = false;          ///< whether to log in
+    uint8_t access_mode = 0;               ///< user level to log in with
+    uint32_t pw_hash = 0;                  ///< password hash to log in with
+    bool has_scan_config = false;          ///< whether to configure the scan
+    lms5xx::LMSConfigParams scan_config{}; ///< scan configuration
+    std::string ntp_server;                ///< NTP server, if configured
+    bool running = false;                  ///< whether scan data was requested
+    bool receive_timestamps = false;       ///< whether the kernel stamps data
+    bool hardware_timestamps = false;      ///< whether the NIC stamps data
+  };
+  Session session_; ///< setup to restore after a reconnect
+
+  CommandChannel commands_;     ///< matches replies to pipelined commands
+  std::atomic<bool> receiving_; ///< whether a receive thread reads replies
+  std::mutex send_mutex_;       ///< keeps telegrams and their requests in order
+  std::mutex receive_mutex_;    ///< serializes reading replies without receiver
+
+  std::atomic<bool>
+      data_requested_; ///< whether scan data was requested, see \ref run()
+
+  ReconnectPolicy reconnect_policy_;       ///< when to reconnect
+  ConnectionCallback connection_callback_; ///< receiver of state changes
+  std::atomic<ConnectionState> connection_state_; ///< current state
+
+  DeviceClockEstimator clock_; ///< maps the scanner clock to host time
+  std::atomic<double> clock_skew_ppm_; ///< last \ref clock_ skew, for readers
+  std::chrono::system_clock::time_point
+      received_;                ///< receive time of the chunk being parsed
+  const ScanSink *outer_sink_;  ///< sink for the chunk being parsed
+  ScanSink stamping_sink_; ///< stamps scans and passes them to \ref outer_sink_
+
+  /**
+   * @brief Set the receive time of \p scan, feed its transmission time to
+   * \ref clock_, and set its time from the host clock if the telegram had no
+   * date/time block
+   */
+  void stamp(Scan &scan);
+
+  /**
+   * @brief Feed data received by the poller to the telegram batcher of the
+   * concrete protocol. The default uses the ASCII \ref batcher_.
+   *
+   * @param data    Received data
+   * @param len Number of bytes in \p data
+   * @param sink    Receiver of completed scans
+   *
+   * @return    Number of completed scans
+   */
+  virtual size_t add_scan_data(const char *data, size_t len,
+                               const ScanSink &sink);
+
+  /**
+   * @brief Handle data received from the socket: record it if a recorder is
+   * set, and pass it to \ref add_scan_data(). Completed scans are stamped
+   * with \p received, see \ref stamp().
+   *
+   * @param data    Received data
+   * @param len Number of bytes in \p data
+   * @param received    Time at which \p data was received
+   * @param sink    Receiver of completed scans
+   *
+   * @return    Number of completed scans
+   */
+  size_t receive_scan_data(const char *data, size_t len,
+                           std::chrono::system_clock::time_point received,
+                           const ScanSink &sink);
+
+  /**
+   * @brief Pass \p stats to the telegram batcher of the concrete protocol.
+   * The default uses the ASCII \ref batcher_.
+   *
+   * @param stats   Statistics to update, or null
+   */
+  virtual void set_batcher_stats(PipelineStats *stats);
+
+  /**
+   * @brief Hand a completed scan to the consumer, via the ring, the pool or the
+   * callback, in this order of precedence
+   *
+   * @param scan    Completed scan, may be swapped with a ring slot
+   */
+  void deliver(Scan &scan);
+
+  /**
+   * @brief Send a complete command telegram without waiting for the reply
+   *
+   * @param telegram    Telegram with framing
+   * @param len Number of bytes in \p telegram
+   *
+   * @return    Deferred future for the status of the reply, see
+   * \ref await_reply()
+   */
+  std::future<SickErr> send_telegram_async(const char *telegram, size_t len);
+
+  /**
+   * @brief Wait for a reply. While a receive thread runs, it reads the
+   * replies; otherwise they are read here, skipping scan data. If no reply
+   * arrives within \ref timeout_s_, the request fails with
+   * CustomErrorSocketRecv.
+   *
+   * @param reply   Future from \ref CommandChannel::expect()
+   * @param id  Request of \p reply
+   *
+   * @return    Status of the reply, or the error which lost the connection
+   */
+  SickErr await_reply(std::future<SickErr> reply, uint64_t id);
+
+  /**
+   * @brief Let a receive thread read the replies from now on. Waits until no
+   * command reads a reply itself, so that only one thread reads the socket.
+   */
+  void start_receiving();
+
+  /**
+   * @brief Open a TCP connection to the scanner with \ref timeout_s_ for
+   * connecting, sending and receiving
+   *
+   * @return    Socket, or -1 with errno set
+   */
+  int connect_socket() const;
+
+  /**
+   * @brief Drop a partial telegram of a lost connection. The default resets
+   * the ASCII \ref batcher_.
+   */
+  virtual void reset_batcher();
+
+  /**
+   * @brief Update \ref connection_state_ and notify the connection callback
+   */
+  void notify(const ConnectionEvent &event);
+
+  /**
+   * @return    Whether \ref stop() was called or \p cancel is set
+   */
+  bool stopping(const std::atomic<bool> *cancel) const {
+    return stop_.load() || (cancel != nullptr && cancel->load());
+  }
 
-  int sock_fd_; ///< socket file descriptor
+  /**
+   * @brief Wait for \p delay unless \ref stop() is called or \p cancel is
+   * set
+   *
+   * @return    Whether \ref stop() was called or \p cancel is set
+   */
+  bool wait_for_stop(std::chrono::milliseconds delay,
+                     const std::atomic<bool> *cancel = nullptr) const;
+
+  /**
+   * @brief Replay the setup recorded in \ref session_ on a new connection
+   *
+   * @return    Error or success
+   */
+  SickErr restore_session();
+
+  /**
+   * @brief Replace the socket with a new connection and restore the session
+   *
+   * @return    Error or success
+   */
+  SickErr reconnect();
+
+  /**
+   * @brief Reconnect with backoff according to \ref reconnect_policy_ after
+   * the connection was lost
+   *
+   * @param error   Why the connection was lost
+   * @param cancel  If set, also gives up once this becomes true, e.g. when
+   * a \ref ScannerHub stops
+   *
+   * @return    Whether the connection was restored, false if stopped or
+   * given up
+   */
+  bool recover(SickErr error, const std::atomic<bool> *cancel = nullptr);
 
 public:
   using SOPASProtocolPtr = std::shared_ptr<SOPASProtocol>;
@@ -94,7 +298,113 @@ public:
   virtual SickErr reboot() = 0;
 
   /**
-   * @brief Start the thread to receive scan data and get the callback invoked
+   * @brief Publish scans into \p ring instead of invoking the callback on the
+   * receive thread, so that slow consumers do not stall the socket. Consumers
+   * pull scans from the ring on their own thread. Must be called before
+   * \ref start_scan(). The ring is closed by \ref stop().
+   *
+   * @param ring    Ring to publish to, or null to use the callback again
+   */
+  void set_scan_ring(const std::shared_ptr<ScanRing> &ring);
+
+  /**
+   * @brief Deliver scans as reference-counted handles into \p pool instead of
+   * as references to the poller's scan. Consumers can keep a \ref ScanPtr
+   * beyond the callback, e.g. to pass it to another thread, without copying
+   * the scan. If all slots are held by consumers, scans are dropped. Must be
+   * called before \ref start_scan().
+   *
+   * @param pool    Pool to take slots from, or null to use the callback again
+   * @param fn  Callback for pooled scans
+   */
+  void set_scan_pool(const std::shared_ptr<ScanPool> &pool,
+                     const PooledScanCallback &fn);
+
+  /**
+   * @brief Record everything received while scanning, e.g. to reproduce
+   * problems offline. Recording does not block the receive thread. Must be
+   * called before \ref start_scan().
+   *
+   * @param recorder    Recorder to write to, or null to stop recording
+   */
+  void record_to(const std::shared_ptr<TelegramRecorder> &recorder);
+
+  /**
+   * @brief Measure the receive path: counters for received bytes, telegrams,
+   * parse failures and framing errors, and latency histograms from the
+   * completion of recv() to the end of the callback. Costs a few clock reads
+   * per telegram. Must be called before \ref start_scan().
+   *
+   * @param enable  Whether to collect statistics
+   */
+  void enable_stats(bool enable = true);
+
+  /**
+   * @return    Snapshot of the receive path statistics, all zero unless
+   * enabled with \ref enable_stats(). Can be called from any thread while
+   * scanning.
+   */
+  ScanStats stats() const;
+
+  /**
+   * @brief Stamp received data in the kernel, or also in the NIC, instead of
+   * after recv() returns. This removes the scheduling delay of the receive
+   * thread from \ref Scan::receive_time and from the scanner clock estimate.
+   *
+   * Scans whose telegrams carry a date/time block (the scanner is configured
+   * as NTP client) keep that time. Otherwise, \ref Scan::time is derived from
+   * the scanner's microsecond clock, mapped to host time by an online
+   * estimate (\ref ScanTimeSource::Estimated), or while the estimate is
+   * settling from the receive time (\ref ScanTimeSource::Receive). This
+   * happens with and without receive time stamps.
+   *
+   * @param hardware    Whether to use NIC time stamps. See
+   * \ref sick::enable_receive_timestamps() for the prerequisites.
+   *
+   * @return    Error or success
+   */
+  SickErr enable_receive_timestamps(bool hardware = false);
+
+  /**
+   * @return    Estimated rate difference of the scanner clock to the host
+   * clock in parts per million, 0 until enough scans were received. Can be
+   * called from any thread while scanning.
+   */
+  double clock_skew_ppm() const {
+    return clock_skew_ppm_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Set when to reconnect if the connection is lost while scanning. On
+   * a reconnect, the login, NTP and scan configuration and the scan data
+   * request which succeeded before are sent again, and scans resume. By
+   * default, reconnects are attempted forever with exponential backoff. Must
+   * be called before \ref start_scan().
+   *
+   * @param policy  Reconnect policy
+   */
+  void set_reconnect_policy(const ReconnectPolicy &policy);
+
+  /**
+   * @brief Get notified on the receive thread when the connection is lost,
+   * reconnect attempts start and the connection is restored. Must be called
+   * before \ref start_scan().
+   *
+   * @param fn  Callback for connection events
+   */
+  void set_connection_callback(const ConnectionCallback &fn);
+
+  /**
+   * @return    Current connection state. Can be called from any thread.
+   */
+  ConnectionState connection_state() const { return connection_state_.load(); }
+
+  /**
+   * @brief Start the thread to receive scan data and get the callback invoked.
+   * The thread detects a lost connection when the scanner closes it, on
+   * socket errors, and when no data arrives within
+   * \ref ReconnectPolicy::liveness_timeout after \ref run(), and then
+   * reconnects, see \ref set_reconnect_policy().
    *
    * @return    Error or success
    */
@@ -131,17 +441,23 @@ int receive_sopas_reply(int sock_fd, char *data_out, size_t len);
  */
 int send_sopas_command(int sock_fd, const char *data, size_t len);
 
+using StatusParser = SickErr (*)(
+    const char *, size_t); ///< Function to get the status from a reply
+
 /**
  * @brief   Send a command and parse the answer for success
  *
  * @param sock_fd   Socket file descroptor
  * @param data       data buffer to send
  * @param len   number of bytes to write
+ * @param parse_status  Function to get the status from the reply, depending on
+ * the protocol flavour
  *
  * @return  Error code or success
  */
-SickErr send_sopas_command_and_check_answer(int sock_fd, const char *data,
-                                            size_t len);
+SickErr send_sopas_command_and_check_answer(
+    int sock_fd, const char *data, size_t len,
+    StatusParser parse_status = status_from_bytes_ascii);
 
 /**
  * @brief   Implementation of the ASCII sopas protocol. This protocol is
@@ -152,75 +468,42 @@ class SOPASProtocolASCII : public SOPASProtocol {
 
   using SOPASProtocol::SOPASProtocol;
 
-  std::map<SOPASCommand, std::string> command_masks_ = {
-      {REBOOT, "\x02sMN mSCreboot\x03"},
-      {SETACCESSMODE, "\x02sMN SetAccessMode %02d %08X\x03"},
-      {TSCROLE, "\x02sWN TSCRole %02d\x03"},
-      {TSCTCINTERFACE, "\x02sWN TSCTCInterface %02d\x03"},
-      {TSCTCSRVADDR, "\x02sWN TSCTCSrvAddr %s\x03"},
-      // retardation: the signs in sopas ascci are usually optional, but not for
-      // the start and end angles
-      {MLMPSETSCANCFG, "\x02sMN mLMPsetscancfg +%4u +1 +%4u %+d %+d\x03"},
-      // the telegram listing has fewer values than are actually needed, so this
-      // is guesswork. this is hardcoded to make remission show up in the scan
-      // telegrams. looks like the second 00 is an unknown mystery value that is
-      // not documented
-      {LMDSCANDATACFG, "\x02sWN LMDscandatacfg 00 00 1 0 0 0 00 0 0 0 1 1\x03"},
-      {FRECHOFILTER, "\x02sWN FREchoFilter %u\x03"},
-      {LMPOUTPUTRANGE_WRITE, "\x02sWN LMPoutputRange 1 +%4u %+d %+d\x03"},
-      {LMPOUTPUTRANGE_READ, "\x02sRN LMPoutputRange\x03"},
-      {MEEWRITEALL, "\x02sMN mEEwriteall\x03"},
-      {RUN, "\x02sMN Run\x03"},
-      {LMDSCANDATA, "\x02sEN LMDscandata %u\x03"},
-      {LMCSTOPMEAS, "\x02sMN LMCstopmeas\x03"},
-      {LMCSTARTMEAS,
-       "\x02sMN LMCstartmeas\x03"}}; ///<    map from commands to format strings
-                                     ///<    to fill arguments into
-
 public:
   SickErr set_access_mode(const uint8_t mode = 3,
                           const uint32_t pw_hash = 0xF4724744) override;
 
   /**
-   * @brief Function to assemble a command message with the use of `sprintf()`
+   * @brief Send a SOPAS command to the socket
    *
-   * @tparam Args   Argument types
-   * @param data_out    Output argument with the command
-   * @param cmd SOPAS Command
-   * @param args    Argument values
+   * @tparam Cmd    Command to send
+   * @tparam Args   Command parameter types, checked against the
+   * \ref CommandSpec of \p Cmd
+   * @param args    Command parameter values
    *
-   * @return    Sprintf return value (number of chars printed)
+   * @return    Error or success from the reply
    */
-  template <typename... Args>
-  int make_command_msg(char *data_out, SOPASCommand cmd, Args... args) {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-security"
-    int bytes_written =
-        std::sprintf(data_out, command_masks_[cmd].c_str(), args...);
-#pragma GCC diagnostic pop
-    if (bytes_written < 0) {
-      throw std::runtime_error("sprintf fail");
-    }
-    return bytes_written;
+  template <SOPASCommand Cmd, typename... Args>
+  SickErr send_command(Args... args) {
+    return send_command_async<Cmd>(args...).get();
   }
 
   /**
-   * @brief Send a SOPAS command to the socket
+   * @brief Send a SOPAS command without waiting for the reply, so that
+   * several commands can be in flight on the socket at once
    *
-   * @tparam Args   Command parameter types
-   * @param cmd     Command to send
+   * @tparam Cmd    Command to send
+   * @tparam Args   Command parameter types, checked against the
+   * \ref CommandSpec of \p Cmd
    * @param args    Command parameter values
    *
-   * @return    Error result from `send_sopas_command_and_check_answer()`
+   * @return    Deferred future for the result. While scanning, the receive
+   * thread reads the reply, otherwise it is read when the future is waited
+   * for.
    */
-  template <typename... Args>
-  SickErr send_command(SOPASCommand cmd, Args... args) {
-    std::array<char, 4096> buffer;
-    int bytes_written = make_command_msg(buffer.data(), cmd, args...);
-
-    SickErr result = send_sopas_command_and_check_answer(
-        sock_fd_, buffer.data(), bytes_written);
-    return result;
+  template <SOPASCommand Cmd, typename... Args>
+  std::future<SickErr> send_command_async(Args... args) {
+    const AsciiCommand<Cmd> cmd(args...);
+    return send_telegram_async(cmd.data(), cmd.size());
   }
 
   SickErr configure_ntp_client(const std::string &ip) override;
@@ -238,4 +521,62 @@ public:
   ~SOPASProtocolASCII() {}
 };
 
+/**
+ * @brief   Implementation of the binary (CoLa-B) sopas protocol, usually on port
+ * 2112. Values are sent as big-endian integers instead of hex strings, which
+ * roughly halves the number of bytes on the wire and makes scan telegrams
+ * decodable with fixed-offset reads.
+ */
+class SOPASProtocolBinary : public SOPASProtocol {
+
+  using SOPASProtocol::SOPASProtocol;
+
+  BinaryScanBatcher binary_batcher_; ///< batcher for partial binary telegrams
+
+protected:
+  size_t add_scan_data(const char *data, size_t len,
+                       const ScanSink &sink) override;
+
+  void set_batcher_stats(PipelineStats *stats) override;
+
+  void reset_batcher() override;
+
+public:
+  /**
+   * @brief Send a SOPAS command to the socket
+   *
+   * @param cmd     Assembled command
+   *
+   * @return    Error or success from the reply
+   */
+  SickErr send_command(BinaryCommand &cmd);
+
+  /**
+   * @brief Send a SOPAS command without waiting for the reply, see
+   * \ref SOPASProtocolASCII::send_command_async()
+   *
+   * @param cmd     Assembled command
+   *
+   * @return    Deferred future for the result
+   */
+  std::future<SickErr> send_command_async(BinaryCommand &cmd);
+
+  SickErr set_access_mode(const uint8_t mode = 3,
+                          const uint32_t pw_hash = 0xF4724744) override;
+
+  SickErr configure_ntp_client(const std::string &ip) override;
+
+  SickErr set_scan_config(const lms5xx::LMSConfigParams &params) override;
+
+  SickErr save_params() override;
+
+  SickErr run() override;
+
+  SickErr reboot() override;
+
+  void stop(bool stop_laser = false) override;
+
+  ~SOPASProtocolBinary() {}
+};
+
 } // namespace sick
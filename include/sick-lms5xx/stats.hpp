@@ -0,0 +1,203 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace sick {
+
+/**
+ * @brief   Copy of the buckets of a \ref LatencyHistogram, for queries
+ */
+class LatencySnapshot {
+  std::vector<uint64_t> buckets_; ///< number of values in each bucket
+  uint64_t count_;                ///< number of values
+  uint64_t sum_ns_;               ///< sum of all values
+  uint64_t max_ns_;               ///< largest value
+
+  friend class LatencyHistogram;
+
+public:
+  LatencySnapshot() : count_(0), sum_ns_(0), max_ns_(0) {}
+
+  /**
+   * @return    Number of recorded values
+   */
+  uint64_t count() const { return count_; }
+
+  /**
+   * @return    Mean in ns, 0 without values
+   */
+  double mean_ns() const {
+    return count_ > 0 ? static_cast<double>(sum_ns_) / count_ : 0;
+  }
+
+  /**
+   * @return    Largest value in ns
+   */
+  uint64_t max_ns() const { return max_ns_; }
+
+  /**
+   * @brief Get a percentile. Accurate to the bucket width, about 3 %.
+   *
+   * @param percentile  Percentile in [0, 100], e.g. 99.9
+   *
+   * @return    Upper bound of the bucket containing the percentile, in ns. 0
+   * without values.
+   */
+  uint64_t percentile_ns(double percentile) const;
+};
+
+/**
+ * @brief   Lock-free histogram of durations with logarithmic buckets in the
+ * style of HdrHistogram: each power of two is split into 32 linear buckets,
+ * so values from 1 ns to about a minute are kept with a relative error of
+ * about 3 % in constant memory. Recording is wait-free and can happen while
+ * other threads take snapshots.
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned int SUB_BUCKET_BITS =
+      5; ///< log2 of the number of buckets per power of two
+  static constexpr unsigned int MAX_EXPONENT =
+      36; ///< values from 2^MAX_EXPONENT ns on go into the last bucket
+  static constexpr size_t N_BUCKETS =
+      (MAX_EXPONENT - SUB_BUCKET_BITS + 1)
+      << SUB_BUCKET_BITS; ///< number of buckets
+
+  LatencyHistogram();
+
+  LatencyHistogram(const LatencyHistogram &other) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &other) = delete;
+
+  /**
+   * @brief Record a duration
+   *
+   * @param ns  Duration in ns
+   */
+  void record(uint64_t ns);
+
+  /**
+   * @return    Copy of the current contents. Can be called from any thread.
+   */
+  LatencySnapshot snapshot() const;
+
+  /**
+   * @return    Index of the bucket for \p ns
+   */
+  static size_t bucket(uint64_t ns);
+
+  /**
+   * @return    Largest value which falls into bucket \p idx
+   */
+  static uint64_t bucket_upper_bound(size_t idx);
+
+private:
+  std::atomic<uint64_t> buckets_[N_BUCKETS];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_ns_;
+  std::atomic<uint64_t> max_ns_;
+};
+
+/**
+ * @brief   Snapshot of the receive path statistics of one scanner. Latencies
+ * are measured per telegram, from the end of the recv() which completed it.
+ */
+struct ScanStats {
+  uint64_t bytes_received;  ///< bytes read from the socket
+  uint64_t chunks_received; ///< successful reads from the socket
+  uint64_t telegrams;       ///< complete telegrams found in the stream
+  uint64_t scans;           ///< telegrams parsed into scans
+  uint64_t parse_failures;  ///< telegrams which did not parse as scans
+  uint64_t framing_errors;  ///< telegrams with invalid STX/ETX framing, or
+                            ///< bytes skipped to find the next binary frame
+
+  LatencySnapshot recv_to_framed; ///< recv completion to end of telegram found
+  LatencySnapshot framed_to_parse; ///< end of telegram found to parse start
+  LatencySnapshot parse;           ///< parse start to parse end
+  LatencySnapshot callback; ///< delivery of the scan, e.g. the user callback
+  LatencySnapshot total;    ///< recv completion to callback end
+};
+
+/**
+ * @brief   Collects counters and per-stage latencies on the receive path. The
+ * timing hooks must be called from one thread at a time (the thread that
+ * receives for the scanner), \ref snapshot() can be called from any thread
+ * at any time.
+ */
+class PipelineStats {
+public:
+  using clock = std::chrono::steady_clock;
+
+  PipelineStats();
+
+  PipelineStats(const PipelineStats &other) = delete;
+  PipelineStats &operator=(const PipelineStats &other) = delete;
+
+  /**
+   * @brief A read from the socket completed
+   *
+   * @param bytes   Number of bytes read
+   */
+  void chunk_received(size_t bytes);
+
+  /**
+   * @brief The end of a telegram was found in the current chunk
+   */
+  void telegram_framed();
+
+  /**
+   * @brief The current telegram is not framed by STX and ETX
+   */
+  void framing_error() {
+    framing_errors_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Parsing of the current telegram starts
+   */
+  void parse_started();
+
+  /**
+   * @brief Parsing of the current telegram ended
+   *
+   * @param ok  Whether the telegram was parsed into a scan
+   */
+  void parse_finished(bool ok);
+
+  /**
+   * @brief The parsed scan is about to be handed to the sink
+   */
+  void callback_started();
+
+  /**
+   * @brief The sink returned
+   */
+  void callback_finished();
+
+  /**
+   * @return    Current counters and histograms
+   */
+  ScanStats snapshot() const;
+
+private:
+  clock::time_point received_;       ///< completion of the last read
+  clock::time_point framed_;         ///< end of the current telegram found
+  clock::time_point parse_started_;  ///< parse start of the current telegram
+  clock::time_point callback_started_; ///< start of the current delivery
+
+  std::atomic<uint64_t> bytes_received_;
+  std::atomic<uint64_t> chunks_received_;
+  std::atomic<uint64_t> telegrams_;
+  std::atomic<uint64_t> scans_;
+  std::atomic<uint64_t> parse_failures_;
+  std::atomic<uint64_t> framing_errors_;
+
+  LatencyHistogram recv_to_framed_;
+  LatencyHistogram framed_to_parse_;
+  LatencyHistogram parse_;
+  LatencyHistogram callback_;
+  LatencyHistogram total_;
+};
+
+} // namespace sick
@@ -0,0 +1,163 @@
+#pragma once
+#include <cstdint>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/stats.hpp>
+
+namespace sick {
+
+/**
+ * @brief   ASCII counterpart of \ref ScanBatcher which parses telegrams while
+ * they arrive. Each chunk is tokenized as it comes in and the channel values
+ * are decoded straight into the scan, so when ETX arrives only the time stamp
+ * remains to be converted. Nothing is buffered except the token
+ * which a chunk ends in, so any number of telegrams per chunk and telegrams
+ * split across any number of chunks are handled alike.
+ *
+ * Accepts the same telegrams as \ref ScanBatcher::parse_scan_telegram().
+ */
+class StreamingScanBatcher {
+  /**
+   * @brief Part of the telegram the next token belongs to
+   */
+  enum class State : uint8_t {
+    Idle,             ///< waiting for STX
+    Method,           ///< SOPAS method, e.g. sSN
+    Command,          ///< command name, LMDscandata
+    Header,           ///< device and scan info up to the channel count
+    RangeChannel,     ///< header of a 16 bit distance channel
+    Ranges,           ///< distance values of one echo
+    IntensityCount,   ///< number of 8 bit channels
+    IntensityChannel, ///< header of an 8 bit remission channel
+    Intensities,      ///< remission values of one echo
+    Trailer,          ///< position, name, comment and time blocks
+    Done,             ///< everything needed parsed, ignore until ETX
+    Skip,             ///< malformed scan telegram, ignore until ETX
+    Other             ///< not a scan telegram, e.g. a reply, ignore until ETX
+  };
+
+  /**
+   * @brief Channel header fields, see \ref ChannelHeader
+   */
+  struct ChannelFields {
+    unsigned int scale_factor; ///< 1 or 2, multiplier for the raw values
+    long offset;               ///< offset added to the scaled values
+    double start_angle;        ///< angle of the first value, LMS degrees
+    double ang_incr;           ///< angular step between values, degrees
+    long n_values;             ///< number of values following the header
+  };
+
+  static constexpr size_t TOKEN_CAPACITY =
+      16; ///< characters of a token kept for string comparisons
+
+  State state_;       ///< part of the telegram being parsed
+  unsigned int field_; ///< index of the next token within \ref state_
+
+  char token_[TOKEN_CAPACITY]; ///< first characters of the current token
+  size_t token_len_;           ///< length of the current token
+  unsigned long value_;        ///< hex value of the current token
+  bool negative_;              ///< whether the current token has a minus sign
+  bool hex_ended_; ///< whether a non-hex character ended the hex value
+
+  ChannelFields range_;     ///< header of the current distance channel
+  ChannelFields intensity_; ///< header of the current remission channel
+  unsigned int n_echoes_;   ///< number of distance and remission channels
+  unsigned int echo_;       ///< echo of the current channel
+  unsigned int value_idx_;  ///< index of the next channel value
+  long time_[7];            ///< year, month, day, hour, minute, second, us
+  bool has_time_;           ///< whether the telegram has a date/time block
+  hz scan_frequency_;        ///< scan frequency from the header
+  hz measurement_frequency_; ///< measurement frequency from the header
+
+  Scan s;                        ///< scan being parsed
+  PipelineStats *pipeline_stats; ///< if set, receives the timing hooks
+
+  /**
+   * @brief Reset the token state for the next token
+   */
+  void reset_token() {
+    token_len_ = 0;
+    value_ = 0;
+    negative_ = false;
+    hex_ended_ = false;
+  }
+
+  /**
+   * @return    Value of the current token, like \ref parse_hex()
+   */
+  long token_value() const {
+    return negative_ ? -static_cast<long>(value_) : static_cast<long>(value_);
+  }
+
+  /**
+   * @return    Whether the current token is exactly \p str
+   */
+  bool token_is(const char *str) const;
+
+  /**
+   * @return    Whether the current token contains \p needle
+   */
+  bool token_contains(const char *needle) const;
+
+  /**
+   * @brief Process the current token according to \ref state_
+   */
+  void end_token();
+
+  /**
+   * @brief Process a token of a channel header
+   *
+   * @param fields  Header being parsed
+   *
+   * @return    Whether the header is complete
+   */
+  bool channel_field(ChannelFields &fields);
+
+  /**
+   * @brief Move on to the next channel after the last value of a channel
+   */
+  void end_channel();
+
+  /**
+   * @brief Fast path for channel values: decode plain hex tokens separated by
+   * single spaces into the scan
+   *
+   * @param pos First character to decode
+   * @param end One past the last character of the chunk
+   *
+   * @return    First character not consumed, e.g. the next token after the
+   * last value of the channel, or an unusual character which the general path
+   * has to handle
+   */
+  const char *decode_values(const char *pos, const char *end);
+
+  /**
+   * @brief Handle ETX: hand the scan to \p sink if the telegram parsed
+   *
+   * @return    Whether a scan was passed to \p sink
+   */
+  bool end_telegram(const ScanSink &sink);
+
+public:
+  StreamingScanBatcher();
+
+  /**
+   * @brief Report counters and stage timings to \p stats, see
+   * \ref ScanBatcher::set_stats(). The parse stage only covers the work left
+   * after ETX.
+   */
+  void set_stats(PipelineStats *stats) { pipeline_stats = stats; }
+
+  /**
+   * @brief Add data, and hand each completed scan to \p sink. See
+   * \ref ScanBatcher::add_data(const char *, size_t, const ScanSink &).
+   *
+   * @param data_new    Data to append
+   * @param length  Number of bytes in \p data_new
+   * @param sink    Receiver of completed scans
+   *
+   * @return    Number of scans passed to \p sink
+   */
+  size_t add_data(const char *data_new, size_t length, const ScanSink &sink);
+};
+
+} // namespace sick
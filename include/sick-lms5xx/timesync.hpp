@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace sick {
+
+/**
+ * @brief   Online estimate of the mapping from a scanner's microsecond clock
+ * (`time_since_boot_us`, `time_of_transmission_us`) to host time, from pairs
+ * of transmission and receive times. Does not need the scanner's date and time
+ * to be configured.
+ *
+ * The clock rate (drift) is fit by exponentially weighted least squares. As
+ * network and scheduling delays only ever add to the receive time, the offset
+ * follows the lower envelope of the residuals, i.e. the fastest deliveries.
+ * The device clock is unwrapped across its 32 bit overflow, and a jump back in
+ * time (a scanner reboot) restarts the estimate.
+ */
+class DeviceClockEstimator {
+  const double forgetting_; ///< weight factor applied to old samples
+
+  bool started_;      ///< whether a sample was added
+  uint32_t last_raw_; ///< last raw device time
+  int64_t device_us_; ///< unwrapped device time of the last sample
+  int64_t device0_us_; ///< device time of the first sample
+  int64_t host0_ns_;   ///< host time of the first sample
+  size_t n_samples_;   ///< samples since the last restart
+
+  double weight_; ///< sum of the sample weights
+  double mean_x_; ///< weighted mean device time since the first sample, us
+  double mean_y_; ///< weighted mean host minus device time, ns
+  double cov_xx_; ///< weighted co-moments
+  double cov_xy_;
+  double min_residual_ns_; ///< lower envelope of the residuals
+
+  /**
+   * @return    Unwrapped device time of \p raw, near the last sample
+   */
+  int64_t unwrap(uint32_t raw) const {
+    return device_us_ + static_cast<int32_t>(raw - last_raw_);
+  }
+
+  /**
+   * @return    Modeled host minus device time at device time \p x, in ns
+   */
+  double model(double x) const;
+
+public:
+  /// Samples needed before \ref ready() returns true
+  static constexpr size_t MIN_SAMPLES = 8;
+
+  /**
+   * @param forgetting  Weight factor per sample, e.g. 0.999 to average
+   * roughly over the last 1000 samples
+   */
+  explicit DeviceClockEstimator(double forgetting = 0.999);
+
+  /**
+   * @brief Add an observation
+   *
+   * @param transmission_us Scanner clock when the telegram was sent
+   * @param received    Host time at which the telegram was received
+   */
+  void update(uint32_t transmission_us,
+              std::chrono::system_clock::time_point received);
+
+  /**
+   * @brief Map a reading of the scanner clock close to the last observation
+   * to host time
+   *
+   * @param device_us   Scanner clock, e.g. `time_since_boot_us` of a scan
+   *
+   * @return    Host time, only meaningful if \ref ready()
+   */
+  std::chrono::system_clock::time_point to_host(uint32_t device_us) const;
+
+  /**
+   * @return    Whether enough samples were added for \ref to_host()
+   */
+  bool ready() const { return n_samples_ >= MIN_SAMPLES && cov_xx_ > 0; }
+
+  /**
+   * @return    Rate of the scanner clock relative to the host clock, in parts
+   * per million. Positive if the scanner clock is slow.
+   */
+  double skew_ppm() const;
+
+  /**
+   * @brief Forget all samples
+   */
+  void reset();
+};
+
+} // namespace sick
@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <sick-lms5xx/binary.hpp>
+#include <sick-lms5xx/compact.hpp>
+#include <sick-lms5xx/framing.hpp>
+#include <sick-lms5xx/hex.hpp>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/projection.hpp>
+#include <sick-lms5xx/simulation.hpp>
+#include <sick-lms5xx/streaming.hpp>
+
+#ifdef WITH_PCL
+#include <sick-lms5xx/pcl.hpp>
+#endif
+
+// Benchmarks for the receive path: tokenizing, parsing, reassembling telegrams
+// from recv() sized chunks and converting scans to clouds. Inputs are
+// synthetic telegrams (see simulation.hpp) at the resolutions the scanner
+// supports. Besides the time per iteration, every benchmark reports
+//   time/scan    seconds per scan, with SI prefix (e.g. 25u = 25 µs)
+//   allocs/scan  heap allocations per scan
+//   bytes/s      telegram bytes processed per second
+//
+// Run e.g. `benchmarks --benchmark_filter=AddData` to select benchmarks.
+
+using namespace sick;
+
+static std::atomic<size_t> n_allocations{0};
+
+#ifdef __GLIBC__
+// count every heap allocation, including Eigen's, which bypass operator new
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+#else
+void *operator new(size_t size) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size > 0 ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+#endif
+
+static constexpr deg RESOLUTIONS[] = {0.1667, 0.25, 0.5, 1.0};
+static constexpr size_t N_STREAM_SCANS =
+    32; ///< scans in the stream fed to the batchers per iteration
+
+static SimulationConfig config(int resolution_idx) {
+  return SimulationConfig(25, RESOLUTIONS[resolution_idx]);
+}
+
+static std::vector<char> ascii_telegram(int resolution_idx) {
+  std::vector<char> telegram;
+  synthesize_scan_ascii(config(resolution_idx), 0,
+                        std::chrono::system_clock::now(), telegram);
+  return telegram;
+}
+
+/**
+ * @brief   Consecutive scan telegrams, as received from the scanner
+ */
+static std::vector<char> telegram_stream(int resolution_idx, bool binary) {
+  const SimulationConfig cfg = config(resolution_idx);
+  auto time = std::chrono::system_clock::now();
+  std::vector<char> stream, telegram;
+  for (uint16_t counter = 0; counter < N_STREAM_SCANS; ++counter) {
+    if (binary) {
+      synthesize_scan_binary(cfg, counter, time, telegram);
+    } else {
+      synthesize_scan_ascii(cfg, counter, time, telegram);
+    }
+    stream.insert(stream.end(), telegram.begin(), telegram.end());
+    time +=
+        std::chrono::microseconds(static_cast<int64_t>(1e6 / cfg.frequency));
+  }
+  return stream;
+}
+
+static Scan parsed_scan(int resolution_idx) {
+  const std::vector<char> telegram = ascii_telegram(resolution_idx);
+  Scan scan;
+  ScanBatcher::parse_scan_telegram(telegram.data(), telegram.size(), scan);
+  return scan;
+}
+
+/**
+ * @brief   Set the reported counters
+ *
+ * @param state Benchmark state
+ * @param n_scans   Number of scans processed in all iterations
+ * @param allocations   Number of allocations in all iterations
+ * @param bytes Number of telegram bytes processed in all iterations
+ */
+static void report(benchmark::State &state, size_t n_scans,
+                   size_t allocations, size_t bytes) {
+  state.counters["time/scan"] = benchmark::Counter(
+      n_scans, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  state.counters["allocs/scan"] =
+      n_scans > 0 ? static_cast<double>(allocations) / n_scans : 0;
+  state.SetBytesProcessed(bytes);
+}
+
+static void resolution_args(benchmark::internal::Benchmark *b) {
+  b->ArgName("res_idx")->DenseRange(0, 3);
+}
+
+static void chunk_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"res_idx", "chunk"});
+  for (int res = 0; res < 4; ++res) {
+    for (int chunk : {1024, 4096, 8192}) {
+      b->Args({res, chunk});
+    }
+  }
+}
+
+static void BM_TokenBuffer(benchmark::State &state) {
+  const std::vector<char> telegram = ascii_telegram(state.range(0));
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    TokenBuffer buf(telegram.data() + 1, telegram.size() - 2);
+    benchmark::DoNotOptimize(buf);
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * telegram.size());
+}
+BENCHMARK(BM_TokenBuffer)->Apply(resolution_args);
+
+static void BM_ParseChannel(benchmark::State &state) {
+  const std::vector<char> telegram = ascii_telegram(state.range(0));
+  static constexpr char dist[] = "DIST1", rssi[] = "RSSI1";
+  const char *end = telegram.data() + telegram.size();
+  const char *channel =
+      std::search(telegram.data(), end, dist, dist + sizeof(dist) - 1);
+  // only the distance channel, up to the remission channel
+  const size_t len =
+      std::search(channel, end, rssi, rssi + sizeof(rssi) - 1) - channel;
+  size_t allocations = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    TokenBuffer buf(channel, len);
+    const size_t allocs_begin = n_allocations.load();
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(ScanBatcher::parse_channel(buf));
+    allocations += n_allocations.load() - allocs_begin;
+  }
+  report(state, state.iterations(), allocations, state.iterations() * len);
+}
+BENCHMARK(BM_ParseChannel)->Apply(resolution_args);
+
+/**
+ * @brief   Distance values of a telegram, each followed by a space
+ *
+ * @param n_values  Output, number of values
+ *
+ * @return  First value
+ */
+static const char *distance_values(const std::vector<char> &telegram,
+                                   size_t &n_values) {
+  TokenCursor cur(telegram.data() + 1, telegram.size() - 2);
+  while (cur.has_next() && !(cur.next() == "DIST1")) {
+  }
+  // scale factor, offset, start angle, angular step
+  cur.skip(4);
+  n_values = cur.next_hex();
+  return cur.next().data;
+}
+
+/**
+ * @brief   Decode the distance channel of a telegram with \p decode, which
+ * is \ref decode_hex_values() or its scalar reference
+ */
+static void decode_hex(benchmark::State &state,
+                       size_t (*decode)(const char *, size_t, uint32_t *,
+                                        size_t, size_t &)) {
+  const std::vector<char> telegram = ascii_telegram(state.range(0));
+  size_t n_values;
+  const char *values = distance_values(telegram, n_values);
+  const size_t len = telegram.data() + telegram.size() - values;
+  std::vector<uint32_t> out(n_values);
+  size_t consumed = 0;
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    decode(values, len, out.data(), n_values, consumed);
+    benchmark::DoNotOptimize(out.data());
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * consumed);
+}
+
+static void BM_DecodeHexValues(benchmark::State &state) {
+  decode_hex(state, decode_hex_values);
+}
+BENCHMARK(BM_DecodeHexValues)->Apply(resolution_args);
+
+static void BM_DecodeHexValuesScalar(benchmark::State &state) {
+  decode_hex(state, decode_hex_values_scalar);
+}
+BENCHMARK(BM_DecodeHexValuesScalar)->Apply(resolution_args);
+
+static void BM_DecodeHexStrtol(benchmark::State &state) {
+  const std::vector<char> telegram = ascii_telegram(state.range(0));
+  size_t n_values;
+  const char *values = distance_values(telegram, n_values);
+  std::vector<uint32_t> out(n_values);
+  const char *end = values;
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    char *pos = const_cast<char *>(values);
+    for (size_t i = 0; i < n_values; ++i) {
+      out[i] = std::strtol(pos, &pos, 16);
+    }
+    end = pos;
+    benchmark::DoNotOptimize(out.data());
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * (end - values));
+}
+BENCHMARK(BM_DecodeHexStrtol)->Apply(resolution_args);
+
+static void BM_ParseScanTelegram(benchmark::State &state) {
+  const std::vector<char> telegram = ascii_telegram(state.range(0));
+  Scan scan;
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ScanBatcher::parse_scan_telegram(
+        telegram.data(), telegram.size(), scan));
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * telegram.size());
+}
+BENCHMARK(BM_ParseScanTelegram)->Apply(resolution_args);
+
+/**
+ * @brief   Parse a binary telegram into a \ref Scan or a \ref CompactScan
+ */
+template <typename ScanType>
+static void parse_binary(benchmark::State &state) {
+  std::vector<char> telegram;
+  synthesize_scan_binary(config(state.range(0)), 0,
+                         std::chrono::system_clock::now(), telegram);
+  ScanType scan;
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(BinaryScanBatcher::parse_scan_telegram(
+        telegram.data(), telegram.size(), scan));
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * telegram.size());
+}
+
+static void BM_ParseBinaryTelegram(benchmark::State &state) {
+  parse_binary<Scan>(state);
+}
+BENCHMARK(BM_ParseBinaryTelegram)->Apply(resolution_args);
+
+static void BM_ParseBinaryTelegramCompact(benchmark::State &state) {
+  parse_binary<CompactScan>(state);
+}
+BENCHMARK(BM_ParseBinaryTelegramCompact)->Apply(resolution_args);
+
+static void BM_ExpandCompactScan(benchmark::State &state) {
+  CompactScan compact;
+  compact_scan(parsed_scan(state.range(0)), compact);
+  Scan scan;
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    expand_scan(compact, scan);
+    benchmark::DoNotOptimize(scan.ranges.data());
+    benchmark::DoNotOptimize(scan.intensities.data());
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * compact.size * (sizeof(uint16_t) + 1));
+}
+BENCHMARK(BM_ExpandCompactScan)->Apply(resolution_args);
+
+/**
+ * @brief   Feed a stream of telegrams to a batcher in recv() sized chunks
+ */
+template <typename Batcher>
+static void add_data(benchmark::State &state, bool binary) {
+  const std::vector<char> stream = telegram_stream(state.range(0), binary);
+  const size_t chunk = state.range(1);
+  Batcher batcher;
+  size_t n_scans = 0;
+  const ScanSink sink = [&n_scans](Scan &scan) {
+    benchmark::DoNotOptimize(scan.ranges.data());
+    ++n_scans;
+  };
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    for (size_t begin = 0; begin < stream.size(); begin += chunk) {
+      batcher.add_data(stream.data() + begin,
+                       std::min(chunk, stream.size() - begin), sink);
+    }
+  }
+  report(state, n_scans, n_allocations.load() - allocs_begin,
+         state.iterations() * stream.size());
+  // a regression in telegram reassembly shows as lost scans
+  state.counters["scans/iteration"] =
+      static_cast<double>(n_scans) / state.iterations();
+}
+
+/**
+ * @brief   Split a stream of ASCII telegrams into frames in recv() sized
+ * chunks, with \p find being \ref find_frames() or its scalar reference
+ */
+static void find_frames(benchmark::State &state,
+                        void (*find)(const char *, size_t,
+                                     std::vector<FrameSpan> &)) {
+  const std::vector<char> stream = telegram_stream(state.range(0), false);
+  const size_t chunk = state.range(1);
+  std::vector<FrameSpan> frames;
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    for (size_t begin = 0; begin < stream.size(); begin += chunk) {
+      find(stream.data() + begin, std::min(chunk, stream.size() - begin),
+           frames);
+      benchmark::DoNotOptimize(frames.data());
+    }
+  }
+  report(state, state.iterations() * N_STREAM_SCANS,
+         n_allocations.load() - allocs_begin,
+         state.iterations() * stream.size());
+}
+
+static void BM_FindFrames(benchmark::State &state) {
+  find_frames(state, sick::find_frames);
+}
+BENCHMARK(BM_FindFrames)->Apply(chunk_args);
+
+static void BM_FindFramesScalar(benchmark::State &state) {
+  find_frames(state, find_frames_scalar);
+}
+BENCHMARK(BM_FindFramesScalar)->Apply(chunk_args);
+
+static void BM_AddData(benchmark::State &state) {
+  add_data<ScanBatcher>(state, false);
+}
+BENCHMARK(BM_AddData)->Apply(chunk_args);
+
+static void BM_StreamingAddData(benchmark::State &state) {
+  add_data<StreamingScanBatcher>(state, false);
+}
+BENCHMARK(BM_StreamingAddData)->Apply(chunk_args);
+
+static void BM_AddDataBinary(benchmark::State &state) {
+  add_data<BinaryScanBatcher>(state, true);
+}
+BENCHMARK(BM_AddDataBinary)->Apply(chunk_args);
+
+static void BM_ProjectScan(benchmark::State &state) {
+  const Scan scan = parsed_scan(state.range(0));
+  std::vector<float> x(scan.size), y(scan.size);
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    project_scan(scan, x.data(), y.data());
+    benchmark::DoNotOptimize(x.data());
+    benchmark::DoNotOptimize(y.data());
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * scan.size * sizeof(float));
+  state.SetLabel(projection_kernel());
+}
+BENCHMARK(BM_ProjectScan)->Apply(resolution_args);
+
+static void BM_DeskewScan(benchmark::State &state) {
+  const Scan scan = parsed_scan(state.range(0));
+  std::vector<float> x(scan.size), y(scan.size), z(scan.size);
+  // turning and driving forward during the scan
+  Eigen::Isometry3f end = Eigen::Isometry3f::Identity();
+  end.rotate(Eigen::AngleAxisf(0.02f, Eigen::Vector3f::UnitZ()));
+  end.translation() = Eigen::Vector3f(0.05f, 0, 0);
+  const PoseInterpolator motion(scan, Eigen::Isometry3f::Identity(), end);
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    deskew_scan(scan, motion, x.data(), y.data(), z.data());
+    benchmark::DoNotOptimize(x.data());
+    benchmark::DoNotOptimize(y.data());
+    benchmark::DoNotOptimize(z.data());
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * scan.size * sizeof(float));
+}
+BENCHMARK(BM_DeskewScan)->Apply(resolution_args);
+
+#ifdef WITH_PCL
+static void BM_CloudFromScan(benchmark::State &state) {
+  const Scan scan = parsed_scan(state.range(0));
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sick::pcl::cloud_from_scan(scan));
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * scan.size * sizeof(float));
+}
+BENCHMARK(BM_CloudFromScan)->Apply(resolution_args);
+
+static void BM_CloudPtrFromScan(benchmark::State &state) {
+  const Scan scan = parsed_scan(state.range(0));
+  const size_t allocs_begin = n_allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sick::pcl::cloud_ptr_from_scan(scan));
+  }
+  report(state, state.iterations(), n_allocations.load() - allocs_begin,
+         state.iterations() * scan.size * sizeof(float));
+}
+BENCHMARK(BM_CloudPtrFromScan)->Apply(resolution_args);
+#endif
+
+BENCHMARK_MAIN();
@@ -0,0 +1,493 @@
+#include <cstring>
+#include <sick-lms5xx/binary.hpp>
+
+namespace sick {
+
+static constexpr char COLA_B_MAGIC[] = {STX, STX, STX, STX};
+static constexpr char SCANDATA_PREFIX[] = "sSN LMDscandata ";
+
+/**
+ * @brief   Bounds-checked big-endian reader over a CoLa-B payload. Like
+ * \ref TokenCursor, reading past the end returns 0 and sets a sticky error
+ * flag which is checked once at the end.
+ */
+class BinaryReader {
+  const char *pos_;
+  const char *end_;
+  bool exhausted_;
+
+  const char *take(size_t n) {
+    if (static_cast<size_t>(end_ - pos_) < n) {
+      exhausted_ = true;
+      pos_ = end_;
+      return nullptr;
+    }
+    const char *p = pos_;
+    pos_ += n;
+    return p;
+  }
+
+public:
+  BinaryReader(const char *data, size_t len)
+      : pos_(data), end_(data + len), exhausted_(false) {}
+
+  bool ok() const { return !exhausted_; }
+
+  void skip(size_t n) { take(n); }
+
+  uint8_t u8() {
+    const char *p = take(1);
+    return p ? static_cast<uint8_t>(*p) : 0;
+  }
+
+  uint16_t u16() {
+    const char *p = take(2);
+    return p ? read_be<2>(p) : 0;
+  }
+
+  uint32_t u32() {
+    const char *p = take(4);
+    return p ? read_be<4>(p) : 0;
+  }
+
+  int32_t i32() { return static_cast<int32_t>(u32()); }
+
+  float f32() {
+    const uint32_t bits = u32();
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /**
+   * @brief Get a pointer to the next \p n bytes and advance past them
+   */
+  const char *bytes(size_t n) { return take(n); }
+};
+
+/**
+ * @brief   Scaling and location of the values of one channel
+ */
+struct BinaryChannel {
+  float scale;      ///< multiplier for the raw values
+  float offset;     ///< offset added to the scaled values
+  const char *data; ///< first value
+};
+
+uint8_t cola_b_checksum(const char *payload, size_t len) {
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < len; ++i) {
+    checksum ^= static_cast<uint8_t>(payload[i]);
+  }
+  return checksum;
+}
+
+bool cola_b_frame_complete(const char *data, size_t len, size_t &frame_len) {
+  if (len < COLA_B_HEADER_SIZE) {
+    return false;
+  }
+  frame_len = read_be<4>(data + 4) + COLA_B_FRAME_OVERHEAD;
+  return len >= frame_len;
+}
+
+bool validate_response_binary(const char *data, size_t len) {
+  size_t frame_len;
+  if (!cola_b_frame_complete(data, len, frame_len) || frame_len != len ||
+      std::memcmp(data, COLA_B_MAGIC, sizeof(COLA_B_MAGIC)) != 0) {
+    return false;
+  }
+  const size_t payload_len = len - COLA_B_FRAME_OVERHEAD;
+  return cola_b_checksum(data + COLA_B_HEADER_SIZE, payload_len) ==
+         static_cast<uint8_t>(data[len - 1]);
+}
+
+bool next_cola_b_frame(const char *data, size_t len, size_t &begin,
+                       size_t &frame_len) {
+  while (len - begin >= COLA_B_HEADER_SIZE) {
+    const char *frame = data + begin;
+    if (std::memcmp(frame, COLA_B_MAGIC, sizeof(COLA_B_MAGIC)) != 0 ||
+        read_be<4>(frame + 4) > COLA_B_MAX_PAYLOAD) {
+      // not synchronized to a frame, skip ahead
+      ++begin;
+      continue;
+    }
+    if (!cola_b_frame_complete(frame, len - begin, frame_len)) {
+      return false;
+    }
+    if (validate_response_binary(frame, frame_len)) {
+      return true;
+    }
+    // magic bytes were part of the payload of another frame
+    ++begin;
+  }
+  return false;
+}
+
+SickErr status_from_bytes_binary(const char *data, size_t len) {
+  return classify_reply_binary(data, len).status;
+}
+
+ReplyStatus classify_reply_binary(const char *data, size_t len) {
+  if (!validate_response_binary(data, len)) {
+    return {UNKNOWN_COMMAND, sick_err_t::CustomErrorInvalidDatagram};
+  }
+  const char *payload = data + COLA_B_HEADER_SIZE;
+  const size_t payload_len = len - COLA_B_FRAME_OVERHEAD;
+  if (payload_len < 3) {
+    return {UNKNOWN_COMMAND, sick_err_t::CustomErrorInvalidDatagram};
+  }
+  if (std::memcmp(payload, "sFA", 3) == 0) {
+    // generic errors, optionally separated by a space from the code
+    size_t idx = 3;
+    if (idx < payload_len && payload[idx] == ' ') {
+      ++idx;
+    }
+    const size_t n_code_bytes = payload_len - idx;
+    unsigned int status = 0;
+    if (n_code_bytes == 1) {
+      status = read_be<1>(payload + idx);
+    } else if (n_code_bytes == 2) {
+      status = read_be<2>(payload + idx);
+    } else {
+      return {UNKNOWN_COMMAND, sick_err_t::CustomError};
+    }
+    if (status >= static_cast<unsigned int>(sick_err_t::_LAST)) {
+      return {UNKNOWN_COMMAND, sick_err_t::CustomError};
+    }
+    return {UNKNOWN_COMMAND, static_cast<sick_err_t>(status)};
+  }
+
+  // method, space, command name, then optionally space and status byte
+  const char *name_begin = payload + 4;
+  const char *payload_end = payload + payload_len;
+  if (name_begin >= payload_end) {
+    return {UNKNOWN_COMMAND, sick_err_t::Ok};
+  }
+  const char *name_end = static_cast<const char *>(
+      std::memchr(name_begin, ' ', payload_end - name_begin));
+  if (name_end == nullptr) {
+    name_end = payload_end;
+  }
+  const SOPASCommand command = reply_command(payload, name_end - payload);
+  if (name_end + 1 >= payload_end) {
+    return {command, sick_err_t::Ok};
+  }
+  const int status_code = static_cast<uint8_t>(name_end[1]);
+  if (status_ok(command, status_code)) {
+    return {command, sick_err_t::Ok};
+  } else {
+    return {command, sick_err_t::CustomErrorCommandFailure};
+  }
+}
+
+BinaryCommand::BinaryCommand(const char *command) : has_args_(false) {
+  std::memcpy(data_.data(), COLA_B_MAGIC, sizeof(COLA_B_MAGIC));
+  len_ = COLA_B_HEADER_SIZE;
+  const size_t command_len = strlen(command);
+  if (len_ + command_len + 1 > data_.size()) {
+    throw std::runtime_error("CoLa-B command name too long.");
+  }
+  std::memcpy(data_.data() + len_, command, command_len);
+  len_ += command_len;
+}
+
+BinaryCommand &BinaryCommand::append(uint32_t value, size_t n_bytes) {
+  // the first argument is separated from the command name by a space
+  const bool first_arg = !has_args_;
+  if (len_ + first_arg + n_bytes + 1 > data_.size()) {
+    throw std::runtime_error("CoLa-B command too long.");
+  }
+  if (first_arg) {
+    data_[len_++] = ' ';
+    has_args_ = true;
+  }
+  for (size_t i = 0; i < n_bytes; ++i) {
+    data_[len_++] = static_cast<char>(value >> (8 * (n_bytes - 1 - i)));
+  }
+  return *this;
+}
+
+const char *BinaryCommand::data() {
+  const uint32_t payload_len = len_ - COLA_B_HEADER_SIZE;
+  for (size_t i = 0; i < 4; ++i) {
+    data_[4 + i] = static_cast<char>(payload_len >> (8 * (3 - i)));
+  }
+  data_[len_] = static_cast<char>(
+      cola_b_checksum(data_.data() + COLA_B_HEADER_SIZE, payload_len));
+  return data_.data();
+}
+
+BinaryScanBatcher::BinaryScanBatcher()
+    : num_bytes_buffered(0), pipeline_stats(nullptr) {}
+
+simple_optional<Scan> BinaryScanBatcher::add_data(const char *data_new,
+                                                  size_t length) {
+  simple_optional<Scan> result;
+  add_data(data_new, length,
+           [&result](Scan &scan) { result = simple_optional<Scan>(scan); });
+  return result;
+}
+
+size_t BinaryScanBatcher::add_data(const char *data_new, size_t length,
+                                   const ScanSink &sink) {
+  if (length < 1) {
+    return 0;
+  }
+  // without buffered data, frames complete in data_new are parsed in place
+  const char *data = data_new;
+  size_t len = length;
+  if (num_bytes_buffered > 0) {
+    if (buffer.size() < num_bytes_buffered + length) {
+      buffer.resize(num_bytes_buffered + length);
+    }
+    std::memcpy(buffer.data() + num_bytes_buffered, data_new, length);
+    num_bytes_buffered += length;
+    data = buffer.data();
+    len = num_bytes_buffered;
+  }
+
+  size_t n_scans = 0;
+  size_t begin = 0;
+  size_t frame_len;
+  size_t expected_begin = begin;
+  while (next_cola_b_frame(data, len, begin, frame_len)) {
+    if (!pipeline_stats) {
+      if (parse_scan_telegram(data + begin, frame_len, s)) {
+        sink(s);
+        ++n_scans;
+      }
+    } else {
+      if (begin != expected_begin) {
+        // bytes had to be skipped to find the frame
+        pipeline_stats->framing_error();
+      }
+      pipeline_stats->telegram_framed();
+      pipeline_stats->parse_started();
+      const bool ok = parse_scan_telegram(data + begin, frame_len, s);
+      pipeline_stats->parse_finished(ok);
+      if (ok) {
+        pipeline_stats->callback_started();
+        sink(s);
+        pipeline_stats->callback_finished();
+        ++n_scans;
+      }
+    }
+    begin += frame_len;
+    expected_begin = begin;
+  }
+
+  // keep the incomplete remainder at the front of the buffer
+  num_bytes_buffered = len - begin;
+  if (buffer.size() < num_bytes_buffered) {
+    buffer.resize(num_bytes_buffered);
+  }
+  if (num_bytes_buffered > 0 && (data != buffer.data() || begin > 0)) {
+    std::memmove(buffer.data(), data + begin, num_bytes_buffered);
+  }
+  return n_scans;
+}
+
+/**
+ * @brief   Fields of a binary scan telegram, with the channel values left in
+ * the telegram
+ */
+struct BinaryScanTelegram {
+  uint32_t time_since_boot_us;
+  uint32_t time_of_transmission_us;
+  double scan_frequency;          ///< Hz
+  uint32_t measurement_frequency; ///< in units of 100 Hz
+  unsigned int n_echoes;
+  unsigned int n_values;
+  double start_angle; ///< LMS degrees
+  double ang_incr;
+  BinaryChannel ranges[MAX_ECHOES];
+  BinaryChannel intensities[MAX_ECHOES];
+  bool has_time;
+  uint16_t year;
+  uint8_t month, day, hour, minute, second;
+  uint32_t us;
+};
+
+/**
+ * @brief   Parse everything but the channel values of a scan telegram
+ *
+ * @return  Whether \p telegram is a complete scan telegram
+ */
+static bool parse_binary_scan(const char *telegram, size_t len,
+                              BinaryScanTelegram &out) {
+  if (len < COLA_B_FRAME_OVERHEAD + sizeof(SCANDATA_PREFIX) - 1 ||
+      std::memcmp(telegram + COLA_B_HEADER_SIZE, SCANDATA_PREFIX,
+                  sizeof(SCANDATA_PREFIX) - 1) != 0) {
+    return false;
+  }
+  const size_t prefix_len = COLA_B_HEADER_SIZE + sizeof(SCANDATA_PREFIX) - 1;
+  BinaryReader reader(telegram + prefix_len, len - prefix_len - 1);
+
+  // version, device number, serial number, device status, telegram counter,
+  // scan counter
+  reader.skip(2 + 2 + 4 + 2 + 2 + 2);
+  out.time_since_boot_us = reader.u32();
+  out.time_of_transmission_us = reader.u32();
+  // digital input and output pins, layer angle
+  reader.skip(2 + 2 + 2);
+  out.scan_frequency = reader.u32() / 100.0;
+  out.measurement_frequency = reader.u32();
+  const uint16_t num_encoders = reader.u16();
+  // encoder position and speed
+  reader.skip(num_encoders * (4 + 2));
+
+  // one distance channel per echo
+  const uint16_t num_16bit_channels = reader.u16();
+  if (num_16bit_channels < 1 || num_16bit_channels > MAX_ECHOES) {
+    return false;
+  }
+  out.n_echoes = num_16bit_channels;
+  for (unsigned int echo = 0; echo < out.n_echoes; ++echo) {
+    BinaryChannel &range = out.ranges[echo];
+    const char *range_name = reader.bytes(5);
+    range.scale = reader.f32();
+    range.offset = reader.f32();
+    const double channel_start_angle = reader.i32() / 10000.0;
+    const double channel_ang_incr = reader.u16() / 10000.0;
+    const unsigned int channel_n_values = reader.u16();
+    range.data = reader.bytes(2 * channel_n_values);
+    if (!reader.ok() || channel_n_values < 1 ||
+        std::memcmp(range_name, "DIST", 4)) {
+      return false;
+    }
+    if (echo == 0) {
+      out.start_angle = channel_start_angle;
+      out.ang_incr = channel_ang_incr;
+      out.n_values = channel_n_values;
+    } else if (channel_n_values != out.n_values) {
+      return false;
+    }
+  }
+
+  // one remission channel per echo
+  const uint16_t num_8bit_channels = reader.u16();
+  if (num_8bit_channels != num_16bit_channels) {
+    return false;
+  }
+  for (unsigned int echo = 0; echo < out.n_echoes; ++echo) {
+    BinaryChannel &intensity = out.intensities[echo];
+    const char *intensity_name = reader.bytes(5);
+    intensity.scale = reader.f32();
+    intensity.offset = reader.f32();
+    // start angle, angular step
+    reader.skip(4 + 2);
+    const unsigned int n_intensities = reader.u16();
+    intensity.data = reader.bytes(n_intensities);
+    if (!reader.ok() || n_intensities != out.n_values ||
+        std::memcmp(intensity_name, "RSSI", 4)) {
+      return false;
+    }
+  }
+
+  const uint16_t position_exists = reader.u16();
+  if (position_exists != 0) {
+    // position block is not supported
+    return false;
+  }
+  const uint16_t name_exists = reader.u16();
+  if (name_exists == 1) {
+    reader.skip(reader.u16());
+  }
+  const uint16_t comment_exists = reader.u16();
+  if (comment_exists == 1) {
+    reader.skip(reader.u16());
+  }
+  out.has_time = reader.u16() == 1;
+  if (out.has_time) {
+    out.year = reader.u16();
+    out.month = reader.u8();
+    out.day = reader.u8();
+    out.hour = reader.u8();
+    out.minute = reader.u8();
+    out.second = reader.u8();
+    out.us = reader.u32();
+  }
+  return reader.ok();
+}
+
+/**
+ * @brief   Set the timing and time stamp of \p info from \p telegram. Call
+ * after the geometry is set.
+ */
+static void set_scan_time(const BinaryScanTelegram &telegram, ScanInfo &info) {
+  // measurement frequency is sent in units of 100 Hz
+  update_scan_timing(info, telegram.scan_frequency,
+                     telegram.measurement_frequency * 100.0);
+  info.time_since_boot_us = telegram.time_since_boot_us;
+  info.time_of_transmission_us = telegram.time_of_transmission_us;
+  if (telegram.has_time) {
+    info.time = scan_time(telegram.year, telegram.month, telegram.day,
+                          telegram.hour, telegram.minute, telegram.second,
+                          telegram.us);
+    info.time_source = ScanTimeSource::Device;
+  } else {
+    // no NTP configured, the receiver may stamp the scan
+    info.time = std::chrono::system_clock::time_point();
+    info.time_source = ScanTimeSource::None;
+  }
+}
+
+bool BinaryScanBatcher::parse_scan_telegram(const char *telegram, size_t len,
+                                            Scan &scan) {
+  BinaryScanTelegram parsed;
+  if (!parse_binary_scan(telegram, len, parsed)) {
+    return false;
+  }
+  const unsigned int n_values = parsed.n_values;
+  update_scan_geometry(scan, n_values, parsed.start_angle, parsed.ang_incr,
+                       parsed.n_echoes);
+  for (unsigned int echo = 0; echo < parsed.n_echoes; ++echo) {
+    const BinaryChannel &range = parsed.ranges[echo];
+    const BinaryChannel &intensity = parsed.intensities[echo];
+    float *range_out = scan.ranges.row(echo).data();
+    float *intensity_out = scan.intensities.row(echo).data();
+    // ranges are sent in mm
+    scan.range_scaling[echo] =
+        ChannelScaling{range.scale / 1000, range.offset / 1000};
+    scan.intensity_scaling[echo] =
+        ChannelScaling{intensity.scale, intensity.offset};
+    for (unsigned int i = 0; i < n_values; ++i) {
+      range_out[i] =
+          range.offset + range.scale * read_be<2>(range.data + 2 * i);
+      intensity_out[i] =
+          intensity.offset + intensity.scale * read_be<1>(intensity.data + i);
+    }
+  }
+  scan.ranges /= 1000;
+  set_scan_time(parsed, scan);
+  return true;
+}
+
+bool BinaryScanBatcher::parse_scan_telegram(const char *telegram, size_t len,
+                                            CompactScan &scan) {
+  BinaryScanTelegram parsed;
+  if (!parse_binary_scan(telegram, len, parsed)) {
+    return false;
+  }
+  const unsigned int n_values = parsed.n_values;
+  update_scan_geometry(scan, n_values, parsed.start_angle, parsed.ang_incr,
+                       parsed.n_echoes);
+  for (unsigned int echo = 0; echo < parsed.n_echoes; ++echo) {
+    const BinaryChannel &range = parsed.ranges[echo];
+    const BinaryChannel &intensity = parsed.intensities[echo];
+    // ranges are sent in mm
+    scan.range_scaling[echo] =
+        ChannelScaling{range.scale / 1000, range.offset / 1000};
+    scan.intensity_scaling[echo] =
+        ChannelScaling{intensity.scale, intensity.offset};
+    uint16_t *range_out = scan.ranges.row(echo).data();
+    for (unsigned int i = 0; i < n_values; ++i) {
+      range_out[i] = read_be<2>(range.data + 2 * i);
+    }
+    std::memcpy(scan.intensities.row(echo).data(), intensity.data, n_values);
+  }
+  set_scan_time(parsed, scan);
+  return true;
+}
+
+} // namespace sick
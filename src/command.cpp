@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstring>
+#include <sick-lms5xx/binary.hpp>
+#include <sick-lms5xx/command.hpp>
+#include <sick-lms5xx/parsing.hpp>
+
+namespace sick {
+
+static constexpr size_t METHOD_LEN = 3; ///< e.g. sMN
+
+/**
+ * @brief   Payload of a complete telegram, without framing
+ *
+ * @param telegram  ASCII telegram or CoLa-B frame
+ * @param len   Number of bytes in \p telegram
+ * @param payload_len   Output, number of bytes of the payload
+ *
+ * @return  Start of the payload
+ */
+static const char *telegram_payload(const char *telegram, size_t len,
+                                    size_t &payload_len) {
+  if (len >= COLA_B_FRAME_OVERHEAD && telegram[1] == STX) {
+    payload_len = len - COLA_B_FRAME_OVERHEAD;
+    return telegram + COLA_B_HEADER_SIZE;
+  }
+  payload_len = len >= 2 ? len - 2 : 0;
+  return telegram + 1;
+}
+
+/**
+ * @return  Number of bytes of the method and command name at the start of a
+ * payload, e.g. of `sMN SetAccessMode`
+ */
+static size_t telegram_name_len(const char *payload, size_t len) {
+  if (len <= METHOD_LEN + 1) {
+    return len;
+  }
+  const char *name_end = static_cast<const char *>(
+      std::memchr(payload + METHOD_LEN + 1, ' ', len - METHOD_LEN - 1));
+  return name_end == nullptr ? len : name_end - payload;
+}
+
+/**
+ * @return  Whether \p payload is scan data or another event
+ */
+static bool is_event(const char *payload) {
+  return std::memcmp(payload, "sSN", METHOD_LEN) == 0;
+}
+
+CommandChannel::CommandChannel()
+    : state_(State::Idle), binary_(false), skip_(0), next_id_(0),
+      n_pending_(0) {}
+
+std::future<SickErr> CommandChannel::expect(const char *telegram, size_t len,
+                                            uint64_t &id) {
+  size_t payload_len;
+  const char *payload = telegram_payload(telegram, len, payload_len);
+  std::string reply(payload, telegram_name_len(payload, payload_len));
+  if (reply.size() >= METHOD_LEN) {
+    // sMN is answered by sAN, sWN by sWA, sRN by sRA and sEN by sEA
+    if (reply[1] == 'M') {
+      reply[1] = 'A';
+    } else {
+      reply[2] = 'A';
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  id = next_id_++;
+  requests_.push_back(Request{id, std::move(reply), std::promise<SickErr>()});
+  n_pending_.store(requests_.size());
+  return requests_.back().promise.get_future();
+}
+
+void CommandChannel::add_data(const char *data, size_t len) {
+  size_t pos = 0;
+  while (pos < len) {
+    pos += consume(data + pos, len - pos);
+  }
+}
+
+size_t CommandChannel::consume(const char *data, size_t len) {
+  if (state_ == State::Idle) {
+    const char *stx = static_cast<const char *>(std::memchr(data, STX, len));
+    if (stx == nullptr) {
+      return len;
+    }
+    frame_.clear();
+    state_ = State::Reply;
+    return stx - data;
+  }
+  if (state_ == State::Skip) {
+    if (binary_) {
+      const size_t n = std::min(skip_, len);
+      skip_ -= n;
+      if (skip_ == 0) {
+        state_ = State::Idle;
+      }
+      return n;
+    }
+    const char *etx = static_cast<const char *>(std::memchr(data, ETX, len));
+    if (etx == nullptr) {
+      return len;
+    }
+    state_ = State::Idle;
+    return etx - data + 1;
+  }
+
+  if (frame_.size() < 2) {
+    // a second STX starts a CoLa-B frame
+    frame_.push_back(*data);
+    binary_ = frame_.size() == 2 && frame_[1] == STX;
+    if (frame_.back() == ETX) {
+      state_ = State::Idle;
+    }
+    return 1;
+  }
+  // buffer up to the method first, which tells replies from scan data
+  if (binary_) {
+    const size_t method_end = COLA_B_HEADER_SIZE + METHOD_LEN;
+    if (frame_.size() < method_end) {
+      const size_t n = std::min(len, method_end - frame_.size());
+      frame_.insert(frame_.end(), data, data + n);
+      if (frame_.size() < method_end) {
+        return n;
+      }
+      const uint32_t payload_len = read_be<4>(frame_.data() + 4);
+      if (frame_[2] != STX || frame_[3] != STX ||
+          payload_len > COLA_B_MAX_PAYLOAD || payload_len < METHOD_LEN) {
+        resync();
+      } else if (is_event(frame_.data() + COLA_B_HEADER_SIZE)) {
+        skip_ = payload_len + COLA_B_FRAME_OVERHEAD - frame_.size();
+        state_ = State::Skip;
+      }
+      return n;
+    }
+    const size_t frame_len =
+        read_be<4>(frame_.data() + 4) + COLA_B_FRAME_OVERHEAD;
+    const size_t n = std::min(len, frame_len - frame_.size());
+    frame_.insert(frame_.end(), data, data + n);
+    if (frame_.size() == frame_len) {
+      dispatch();
+      state_ = State::Idle;
+    }
+    return n;
+  }
+
+  const size_t method_end = 1 + METHOD_LEN;
+  const char *etx = static_cast<const char *>(std::memchr(data, ETX, len));
+  size_t n = etx == nullptr ? len : etx - data + 1;
+  if (frame_.size() < method_end) {
+    n = std::min(n, method_end - frame_.size());
+  }
+  frame_.insert(frame_.end(), data, data + n);
+  if (frame_.back() == ETX) {
+    dispatch();
+    state_ = State::Idle;
+  } else if ((frame_.size() == method_end && is_event(frame_.data() + 1)) ||
+             frame_.size() > COLA_B_MAX_PAYLOAD) {
+    state_ = State::Skip;
+  }
+  return n;
+}
+
+void CommandChannel::resync() {
+  const std::vector<char> rest(frame_.begin() + 1, frame_.end());
+  state_ = State::Idle;
+  frame_.clear();
+  add_data(rest.data(), rest.size());
+}
+
+void CommandChannel::dispatch() {
+  size_t payload_len;
+  const char *payload =
+      telegram_payload(frame_.data(), frame_.size(), payload_len);
+  if (payload_len < METHOD_LEN) {
+    return;
+  }
+  const ReplyStatus reply =
+      binary_ ? classify_reply_binary(frame_.data(), frame_.size())
+              : classify_reply_ascii(frame_.data(), frame_.size());
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto request = requests_.begin();
+  if (std::memcmp(payload, "sFA", METHOD_LEN) != 0) {
+    // compare in place, replies to frequent polls must not allocate
+    const size_t name_len = telegram_name_len(payload, payload_len);
+    request = std::find_if(requests_.begin(), requests_.end(),
+                           [payload, name_len](const Request &pending) {
+                             return pending.reply.size() == name_len &&
+                                    std::memcmp(pending.reply.data(), payload,
+                                                name_len) == 0;
+                           });
+  }
+  if (request == requests_.end()) {
+    // e.g. sMA, which only acknowledges a method that takes long
+    return;
+  }
+  request->promise.set_value(reply.status);
+  requests_.erase(request);
+  n_pending_.store(requests_.size());
+}
+
+void CommandChannel::fail(SickErr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Request &request : requests_) {
+    request.promise.set_value(error);
+  }
+  requests_.clear();
+  n_pending_.store(0);
+}
+
+void CommandChannel::cancel(uint64_t id, SickErr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto request =
+      std::find_if(requests_.begin(), requests_.end(),
+                   [id](const Request &pending) { return pending.id == id; });
+  if (request == requests_.end()) {
+    return;
+  }
+  request->promise.set_value(error);
+  requests_.erase(request);
+  n_pending_.store(requests_.size());
+}
+
+void CommandChannel::reset() {
+  state_ = State::Idle;
+  frame_.clear();
+  skip_ = 0;
+}
+
+} // namespace sick
@@ -0,0 +1,230 @@
+#include <limits>
+#include <sick-lms5xx/compact.hpp>
+#include <stdexcept>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace sick {
+
+void update_scan_geometry(CompactScan &scan, unsigned int n_values,
+                          deg start_angle, deg ang_incr,
+                          unsigned int n_echoes) {
+  update_scan_angles(scan, n_values, start_angle, ang_incr, n_echoes);
+  scan.ranges.resize(n_echoes, n_values);
+  scan.intensities.resize(n_echoes, n_values);
+}
+
+void decode_u16_scalar(const uint16_t *raw, size_t n, ChannelScaling scaling,
+                       float *out) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = scaling(raw[i]);
+  }
+}
+
+void decode_u8_scalar(const uint8_t *raw, size_t n, ChannelScaling scaling,
+                      float *out) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = scaling(raw[i]);
+  }
+}
+
+#if defined(__AVX__)
+/**
+ * @brief   Scale 8 raw values widened to 32 bit, given as two halves
+ */
+static __m256 scale_epi32(__m128i lo, __m128i hi, __m256 scale,
+                          __m256 offset) {
+  const __m256i value =
+      _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+  return _mm256_add_ps(offset, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(value)));
+}
+#elif defined(__SSE2__)
+/**
+ * @brief   Scale 4 raw values widened to 32 bit
+ */
+static __m128 scale_epi32(__m128i value, __m128 scale, __m128 offset) {
+  return _mm_add_ps(offset, _mm_mul_ps(scale, _mm_cvtepi32_ps(value)));
+}
+#elif defined(__ARM_NEON)
+/**
+ * @brief   Scale 4 raw values widened to 32 bit
+ */
+static float32x4_t scale_u32(uint32x4_t value, float32x4_t scale,
+                             float32x4_t offset) {
+  return vmlaq_f32(offset, scale, vcvtq_f32_u32(value));
+}
+#endif
+
+void decode_u16(const uint16_t *raw, size_t n, ChannelScaling scaling,
+                float *out) {
+  size_t i = 0;
+#if defined(__AVX__)
+  const __m256 scale = _mm256_set1_ps(scaling.scale);
+  const __m256 offset = _mm256_set1_ps(scaling.offset);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + i));
+    _mm256_storeu_ps(out + i, scale_epi32(_mm_unpacklo_epi16(v, zero),
+                                          _mm_unpackhi_epi16(v, zero), scale,
+                                          offset));
+  }
+#elif defined(__SSE2__)
+  const __m128 scale = _mm_set1_ps(scaling.scale);
+  const __m128 offset = _mm_set1_ps(scaling.offset);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + i));
+    _mm_storeu_ps(out + i,
+                  scale_epi32(_mm_unpacklo_epi16(v, zero), scale, offset));
+    _mm_storeu_ps(out + i + 4,
+                  scale_epi32(_mm_unpackhi_epi16(v, zero), scale, offset));
+  }
+#elif defined(__ARM_NEON)
+  const float32x4_t scale = vdupq_n_f32(scaling.scale);
+  const float32x4_t offset = vdupq_n_f32(scaling.offset);
+  for (; i + 8 <= n; i += 8) {
+    const uint16x8_t v = vld1q_u16(raw + i);
+    vst1q_f32(out + i, scale_u32(vmovl_u16(vget_low_u16(v)), scale, offset));
+    vst1q_f32(out + i + 4,
+              scale_u32(vmovl_u16(vget_high_u16(v)), scale, offset));
+  }
+#endif
+  decode_u16_scalar(raw + i, n - i, scaling, out + i);
+}
+
+void decode_u8(const uint8_t *raw, size_t n, ChannelScaling scaling,
+               float *out) {
+  size_t i = 0;
+#if defined(__AVX__)
+  const __m256 scale = _mm256_set1_ps(scaling.scale);
+  const __m256 offset = _mm256_set1_ps(scaling.offset);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + i));
+    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm256_storeu_ps(out + i, scale_epi32(_mm_unpacklo_epi16(lo, zero),
+                                          _mm_unpackhi_epi16(lo, zero), scale,
+                                          offset));
+    _mm256_storeu_ps(out + i + 8, scale_epi32(_mm_unpacklo_epi16(hi, zero),
+                                              _mm_unpackhi_epi16(hi, zero),
+                                              scale, offset));
+  }
+#elif defined(__SSE2__)
+  const __m128 scale = _mm_set1_ps(scaling.scale);
+  const __m128 offset = _mm_set1_ps(scaling.offset);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + i));
+    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_ps(out + i,
+                  scale_epi32(_mm_unpacklo_epi16(lo, zero), scale, offset));
+    _mm_storeu_ps(out + i + 4,
+                  scale_epi32(_mm_unpackhi_epi16(lo, zero), scale, offset));
+    _mm_storeu_ps(out + i + 8,
+                  scale_epi32(_mm_unpacklo_epi16(hi, zero), scale, offset));
+    _mm_storeu_ps(out + i + 12,
+                  scale_epi32(_mm_unpackhi_epi16(hi, zero), scale, offset));
+  }
+#elif defined(__ARM_NEON)
+  const float32x4_t scale = vdupq_n_f32(scaling.scale);
+  const float32x4_t offset = vdupq_n_f32(scaling.offset);
+  for (; i + 8 <= n; i += 8) {
+    const uint16x8_t v = vmovl_u8(vld1_u8(raw + i));
+    vst1q_f32(out + i, scale_u32(vmovl_u16(vget_low_u16(v)), scale, offset));
+    vst1q_f32(out + i + 4,
+              scale_u32(vmovl_u16(vget_high_u16(v)), scale, offset));
+  }
+#endif
+  decode_u8_scalar(raw + i, n - i, scaling, out + i);
+}
+
+/**
+ * @brief   Throw unless rays `[begin, begin + n)` of \p echo exist in \p scan
+ */
+static void check_rays(const CompactScan &scan, unsigned int echo,
+                       size_t begin, size_t n) {
+  if (echo >= scan.ranges.rows() ||
+      begin + n > static_cast<size_t>(scan.ranges.cols()) ||
+      begin + n > static_cast<size_t>(scan.intensities.cols())) {
+    throw std::out_of_range("Decoded rays exceed the scan.");
+  }
+}
+
+void decode_ranges(const CompactScan &scan, unsigned int echo, size_t begin,
+                   size_t n, float *out) {
+  check_rays(scan, echo, begin, n);
+  decode_u16(scan.ranges.row(echo).data() + begin, n,
+             scan.range_scaling[echo], out);
+}
+
+void decode_intensities(const CompactScan &scan, unsigned int echo,
+                        size_t begin, size_t n, float *out) {
+  check_rays(scan, echo, begin, n);
+  decode_u8(scan.intensities.row(echo).data() + begin, n,
+            scan.intensity_scaling[echo], out);
+}
+
+/**
+ * @brief   Convert \p n values back to raw values with \p scaling, clamped to
+ * the range of \p Raw
+ *
+ * @return  Number of clamped values
+ */
+template <typename Raw>
+static size_t quantize(const float *values, size_t n, ChannelScaling scaling,
+                       Raw *out) {
+  static constexpr float MAX_RAW = std::numeric_limits<Raw>::max();
+  const auto raw =
+      ((Eigen::Map<const Eigen::ArrayXf>(values, n) - scaling.offset) /
+       scaling.scale)
+          .round();
+  const size_t n_clamped = (raw < 0.0f || raw > MAX_RAW).count();
+  Eigen::Map<Eigen::Array<Raw, Eigen::Dynamic, 1>>(out, n) =
+      raw.max(0.0f).min(MAX_RAW).template cast<Raw>();
+  return n_clamped;
+}
+
+size_t compact_scan(const Scan &scan, CompactScan &compact) {
+  static_cast<ScanInfo &>(compact) = scan;
+  compact.ranges.resize(scan.ranges.rows(), scan.ranges.cols());
+  compact.intensities.resize(scan.intensities.rows(),
+                             scan.intensities.cols());
+  size_t n_clamped = 0;
+  for (unsigned int echo = 0; echo < scan.ranges.rows(); ++echo) {
+    n_clamped += quantize(scan.ranges.row(echo).data(), scan.ranges.cols(),
+                          scan.range_scaling[echo],
+                          compact.ranges.row(echo).data());
+  }
+  for (unsigned int echo = 0; echo < scan.intensities.rows(); ++echo) {
+    n_clamped += quantize(
+        scan.intensities.row(echo).data(), scan.intensities.cols(),
+        scan.intensity_scaling[echo], compact.intensities.row(echo).data());
+  }
+  return n_clamped;
+}
+
+void expand_scan(const CompactScan &compact, Scan &scan) {
+  static_cast<ScanInfo &>(scan) = compact;
+  scan.ranges.resize(compact.ranges.rows(), compact.ranges.cols());
+  scan.intensities.resize(compact.intensities.rows(),
+                          compact.intensities.cols());
+  for (unsigned int echo = 0; echo < compact.ranges.rows(); ++echo) {
+    decode_u16(compact.ranges.row(echo).data(), compact.ranges.cols(),
+               compact.range_scaling[echo], scan.ranges.row(echo).data());
+    decode_u8(compact.intensities.row(echo).data(),
+              compact.intensities.cols(), compact.intensity_scaling[echo],
+              scan.intensities.row(echo).data());
+  }
+}
+
+} // namespace sick
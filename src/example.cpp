@@ -42,9 +42,13 @@ static void cbk(const Scan &scan) {
 }
 #endif
 
-int main() {
+int main(int argc, char **argv) {
   n_scans = 0;
-  SOPASProtocolASCII proto("192.168.95.47", 2111, cbk);
+  // scanner address and port can be given on the command line, e.g. to run
+  // against the simulator on 127.0.0.1
+  const string ip = argc > 1 ? argv[1] : "192.168.95.47";
+  const uint32_t port = argc > 2 ? atoi(argv[2]) : 2111;
+  SOPASProtocolASCII proto(ip, port, cbk);
 
   // log into the scanner as authorized client.
   /* SickErr status = proto.set_access_mode(); */
@@ -89,6 +93,7 @@ int main() {
 
   // start socket poller for receive. wait for a few seconds to warm up and then
   // start counting scans. Print resulting hz.
+  proto.enable_stats();
   proto.start_scan();
   std::cout << "Wait a bit for scanner..." << std::endl;
   std::this_thread::sleep_for(std::chrono::seconds(2));
@@ -100,5 +105,12 @@ int main() {
       chrono::duration_cast<chrono::milliseconds>(toc - tic).count() / 1000.0;
   std::cout << "got " << n_scans << " in " << s_elapsed << "s ("
             << n_scans.load() / s_elapsed << "hz)" << std::endl;
+  const ScanStats stats = proto.stats();
+  std::cout << stats.telegrams << " telegrams, " << stats.parse_failures
+            << " parse failures, " << stats.framing_errors
+            << " framing errors. recv to callback end: p50 "
+            << stats.total.percentile_ns(50) / 1000.0 << "us, p99 "
+            << stats.total.percentile_ns(99) / 1000.0 << "us, max "
+            << stats.total.max_ns() / 1000.0 << "us" << std::endl;
   proto.stop();
 }
@@ -0,0 +1,180 @@
+#include <cstdint>
+#include <cstring>
+#include <sick-lms5xx/framing.hpp>
+#include <sick-lms5xx/types.hpp>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace sick {
+
+#if defined(__AVX2__)
+static constexpr size_t BLOCK_SIZE = 32;    ///< bytes compared at once
+static constexpr unsigned int MASK_BITS = 1; ///< mask bits per byte
+
+/**
+ * @brief   Masks of the STX and ETX bytes of a block, one bit per byte
+ */
+static void block_masks(const char *block, uint64_t &stx, uint64_t &etx) {
+  const __m256i bytes =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+  stx = static_cast<uint32_t>(_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(STX))));
+  etx = static_cast<uint32_t>(_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(ETX))));
+}
+#elif defined(__SSE2__)
+static constexpr size_t BLOCK_SIZE = 16;
+static constexpr unsigned int MASK_BITS = 1;
+
+static void block_masks(const char *block, uint64_t &stx, uint64_t &etx) {
+  const __m128i bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+  stx = static_cast<uint16_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(STX))));
+  etx = static_cast<uint16_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ETX))));
+}
+#elif defined(__ARM_NEON)
+static constexpr size_t BLOCK_SIZE = 16;
+static constexpr unsigned int MASK_BITS = 4;
+
+/**
+ * @brief   Narrow a byte compare result to 4 mask bits per byte, NEON has no
+ * movemask
+ */
+static uint64_t narrow_mask(uint8x16_t eq) {
+  return vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+static void block_masks(const char *block, uint64_t &stx, uint64_t &etx) {
+  const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(block));
+  stx = narrow_mask(vceqq_u8(bytes, vdupq_n_u8(STX)));
+  etx = narrow_mask(vceqq_u8(bytes, vdupq_n_u8(ETX)));
+}
+#endif
+
+/**
+ * @brief   Call \p visit with the offset and value of every STX and ETX byte
+ * of \p data, in order
+ */
+template <typename Visitor>
+static void for_each_delimiter(const char *data, size_t len,
+                               Visitor &&visit) {
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+  static constexpr uint64_t BYTE_MASK = (uint64_t(1) << MASK_BITS) - 1;
+  size_t pos = 0;
+  for (; pos + BLOCK_SIZE <= len; pos += BLOCK_SIZE) {
+    uint64_t stx, etx;
+    block_masks(data + pos, stx, etx);
+    uint64_t any = stx | etx;
+    while (any != 0) {
+      const unsigned int bit = __builtin_ctzll(any);
+      visit(pos + bit / MASK_BITS, (stx >> bit) & 1 ? STX : ETX);
+      any &= ~(BYTE_MASK << bit);
+    }
+  }
+  for (; pos < len; ++pos) {
+    if (data[pos] == STX || data[pos] == ETX) {
+      visit(pos, data[pos]);
+    }
+  }
+#else
+  // merge the results of two searches, memchr() is vectorized by the libc
+  const char *end = data + len;
+  const char *stx = static_cast<const char *>(std::memchr(data, STX, len));
+  const char *etx = static_cast<const char *>(std::memchr(data, ETX, len));
+  while (stx != nullptr || etx != nullptr) {
+    if (etx == nullptr || (stx != nullptr && stx < etx)) {
+      visit(static_cast<size_t>(stx - data), STX);
+      stx = static_cast<const char *>(std::memchr(stx + 1, STX, end - stx - 1));
+    } else {
+      visit(static_cast<size_t>(etx - data), ETX);
+      etx = static_cast<const char *>(std::memchr(etx + 1, ETX, end - etx - 1));
+    }
+  }
+#endif
+}
+
+/**
+ * @brief   Collects the \ref FrameSpan of a chunk from its delimiters
+ */
+class FrameCollector {
+  std::vector<FrameSpan> &frames_; ///< output
+  FrameSpan span_;                 ///< span being collected
+  size_t len_;                     ///< length of the chunk
+
+public:
+  FrameCollector(std::vector<FrameSpan> &frames, size_t len)
+      : frames_(frames), span_{0, NO_STX, len, false}, len_(len) {
+    frames_.clear();
+  }
+
+  void operator()(size_t pos, char byte) {
+    if (byte == STX) {
+      if (span_.stx == NO_STX) {
+        span_.stx = pos;
+      }
+      return;
+    }
+    span_.end = pos + 1;
+    span_.terminated = true;
+    frames_.push_back(span_);
+    span_ = FrameSpan{pos + 1, NO_STX, len_, false};
+  }
+
+  /**
+   * @brief Add the span after the last ETX, if any
+   */
+  void finish() {
+    if (span_.begin < len_) {
+      frames_.push_back(span_);
+    }
+  }
+};
+
+void find_frames(const char *data, size_t len,
+                 std::vector<FrameSpan> &frames) {
+  FrameCollector collector(frames, len);
+  for_each_delimiter(data, len, collector);
+  collector.finish();
+}
+
+void count_delimiters(const char *data, size_t len, size_t &n_stx,
+                      size_t &n_etx) {
+  n_stx = 0;
+  n_etx = 0;
+  for_each_delimiter(data, len, [&n_stx, &n_etx](size_t, char byte) {
+    ++(byte == STX ? n_stx : n_etx);
+  });
+}
+
+void find_frames_scalar(const char *data, size_t len,
+                        std::vector<FrameSpan> &frames) {
+  FrameCollector collector(frames, len);
+  for (size_t pos = 0; pos < len; ++pos) {
+    if (data[pos] == STX || data[pos] == ETX) {
+      collector(pos, data[pos]);
+    }
+  }
+  collector.finish();
+}
+
+void count_delimiters_scalar(const char *data, size_t len, size_t &n_stx,
+                             size_t &n_etx) {
+  n_stx = 0;
+  n_etx = 0;
+  for (size_t pos = 0; pos < len; ++pos) {
+    if (data[pos] == STX) {
+      ++n_stx;
+    } else if (data[pos] == ETX) {
+      ++n_etx;
+    }
+  }
+}
+
+} // namespace sick
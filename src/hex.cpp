@@ -0,0 +1,198 @@
+#include <cstring>
+#include <sick-lms5xx/hex.hpp>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// the digits of a value are combined in a little endian 64 bit word
+#if (defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)) &&       \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SICK_HEX_SIMD 1
+#endif
+
+namespace sick {
+
+/// Most digits of a value decoded in bulk, which fit 32 bit
+static constexpr size_t MAX_DIGITS = 8;
+
+size_t decode_hex_values_scalar(const char *data, size_t len, uint32_t *out,
+                                size_t n, size_t &consumed) {
+  size_t n_decoded = 0;
+  size_t pos = 0;
+  while (n_decoded < n) {
+    uint32_t value = 0;
+    size_t n_digits = 0;
+    int digit;
+    while (pos + n_digits < len && n_digits <= MAX_DIGITS &&
+           (digit = hex_digit(data[pos + n_digits])) >= 0) {
+      value = (value << 4) | digit;
+      ++n_digits;
+    }
+    if (n_digits == 0 || n_digits > MAX_DIGITS || pos + n_digits >= len ||
+        data[pos + n_digits] != ' ') {
+      break;
+    }
+    out[n_decoded++] = value;
+    pos += n_digits + 1;
+  }
+  consumed = pos;
+  return n_decoded;
+}
+
+#ifdef SICK_HEX_SIMD
+/// Bytes classified at once, one bit per byte in 64 bit masks
+static constexpr size_t CHUNK_SIZE = 64;
+
+#if defined(__AVX2__)
+/**
+ * @brief   Masks of the spaces and of the characters which are neither hex
+ * digits nor spaces, of 32 bytes
+ */
+static void block_masks(const char *block, uint32_t &space, uint32_t &other) {
+  const __m256i c =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+  // bytes above 0x7F are negative and fail both ranges
+  const __m256i digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+  const __m256i lc = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+  const __m256i letter =
+      _mm256_and_si256(_mm256_cmpgt_epi8(lc, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lc));
+  const __m256i blank = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+  space = _mm256_movemask_epi8(blank);
+  other = ~_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_or_si256(digit, letter), blank));
+}
+
+static constexpr size_t BLOCK_SIZE = 32; ///< bytes per \ref block_masks()
+#elif defined(__SSE2__)
+/**
+ * @brief   Masks of the spaces and of the characters which are neither hex
+ * digits nor spaces, of 16 bytes
+ */
+static void block_masks(const char *block, uint32_t &space, uint32_t &other) {
+  const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+  // bytes above 0x7F are negative and fail both ranges
+  const __m128i digit =
+      _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+  const __m128i lc = _mm_or_si128(c, _mm_set1_epi8(0x20));
+  const __m128i letter =
+      _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(lc, _mm_set1_epi8('f' + 1)));
+  const __m128i blank = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+  space = _mm_movemask_epi8(blank);
+  other = ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, letter), blank));
+  other &= 0xFFFF;
+}
+
+static constexpr size_t BLOCK_SIZE = 16;
+#elif defined(__ARM_NEON)
+/**
+ * @brief   One bit per byte of a compare result, NEON has no movemask
+ */
+static uint32_t movemask(uint8x16_t eq) {
+  static const uint8_t BITS[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                   1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t bits = vandq_u8(eq, vld1q_u8(BITS));
+  // sum the bits of each half
+  uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+  sum = vpadd_u8(sum, sum);
+  sum = vpadd_u8(sum, sum);
+  return vget_lane_u16(vreinterpret_u16_u8(sum), 0);
+}
+
+static void block_masks(const char *block, uint32_t &space, uint32_t &other) {
+  const uint8x16_t c = vld1q_u8(reinterpret_cast<const uint8_t *>(block));
+  const uint8x16_t digit =
+      vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+  const uint8x16_t lc = vorrq_u8(c, vdupq_n_u8(0x20));
+  const uint8x16_t letter =
+      vandq_u8(vcgeq_u8(lc, vdupq_n_u8('a')), vcleq_u8(lc, vdupq_n_u8('f')));
+  const uint8x16_t blank = vceqq_u8(c, vdupq_n_u8(' '));
+  space = movemask(blank);
+  other = movemask(vmvnq_u8(vorrq_u8(vorrq_u8(digit, letter), blank)));
+}
+
+static constexpr size_t BLOCK_SIZE = 16;
+#endif
+
+/**
+ * @brief   Masks of the spaces and of the other characters of a chunk
+ */
+static void chunk_masks(const char *chunk, uint64_t &space, uint64_t &other) {
+  space = 0;
+  other = 0;
+  for (size_t block = 0; block < CHUNK_SIZE; block += BLOCK_SIZE) {
+    uint32_t block_space, block_other;
+    block_masks(chunk + block, block_space, block_other);
+    space |= static_cast<uint64_t>(block_space) << block;
+    other |= static_cast<uint64_t>(block_other) << block;
+  }
+}
+
+/**
+ * @brief   Value of \p n_digits hex digits, 1 to 8. Reads 8 bytes from
+ * \p digits, the bytes after the digits are ignored.
+ */
+static uint32_t combine_digits(const char *digits, unsigned int n_digits) {
+  uint64_t word;
+  std::memcpy(&word, digits, sizeof(word));
+  // value of each digit in its byte, letters have bit 6 set
+  word = (word & 0x0F0F0F0F0F0F0F0Full) +
+         9 * ((word >> 6) & 0x0101010101010101ull);
+  // drop the bytes after the digits, the last digit ends up in the top byte
+  word <<= 8 * (MAX_DIGITS - n_digits);
+  // merge neighbouring bytes, then 16 and 32 bit halves, with one multiply
+  // each. The first digit is in the lowest byte, so that it ends up highest.
+  word = ((word * (1 + (16ull << 8))) >> 8) & 0x00FF00FF00FF00FFull;
+  word = ((word * (1 + (256ull << 16))) >> 16) & 0x0000FFFF0000FFFFull;
+  return static_cast<uint32_t>((word * (1 + (65536ull << 32))) >> 32);
+}
+#endif
+
+size_t decode_hex_values(const char *data, size_t len, uint32_t *out, size_t n,
+                         size_t &consumed) {
+  size_t n_decoded = 0;
+  size_t pos = 0;
+#ifdef SICK_HEX_SIMD
+  // values end at the spaces of each chunk, so that only the loop over them
+  // depends on their lengths. combine_digits() reads 8 bytes from the start
+  // of a value.
+  size_t begin = 0; // start of the next value
+  bool plain = true;
+  for (size_t chunk = 0;
+       plain && n_decoded < n && chunk + CHUNK_SIZE + MAX_DIGITS <= len;
+       chunk += CHUNK_SIZE) {
+    uint64_t space, other;
+    chunk_masks(data + chunk, space, other);
+    const size_t first_other =
+        other == 0 ? CHUNK_SIZE : __builtin_ctzll(other);
+    for (; space != 0 && n_decoded < n; space &= space - 1) {
+      const size_t end = __builtin_ctzll(space);
+      const size_t n_digits = chunk + end - begin;
+      if (end > first_other || n_digits - 1 >= MAX_DIGITS) {
+        // left to the scalar path, which stops at the same value
+        plain = false;
+        break;
+      }
+      out[n_decoded++] = combine_digits(data + begin, n_digits);
+      begin = chunk + end + 1;
+    }
+    // other characters after the last space belong to the next value
+    plain = plain && other == 0;
+  }
+  pos = begin;
+#endif
+  size_t tail;
+  n_decoded += decode_hex_values_scalar(data + pos, len - pos, out + n_decoded,
+                                        n - n_decoded, tail);
+  consumed = pos + tail;
+  return n_decoded;
+}
+
+} // namespace sick
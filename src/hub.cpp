@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <errno.h>
+#include <sick-lms5xx/hub.hpp>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace sick {
+
+static constexpr int MAX_EVENTS = 16; ///< events fetched per epoll_wait()
+
+ScannerHub::ScannerHub(const HubScanCallback &fn, size_t n_threads)
+    : n_threads_(n_threads), callback_(fn), running_(false), stopping_(false) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    throw std::runtime_error(std::string("Unable to create epoll instance: ") +
+                             strerror(errno));
+  }
+  wakeup_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wakeup_fd_ < 0) {
+    close(epoll_fd_);
+    throw std::runtime_error(std::string("Unable to create eventfd: ") +
+                             strerror(errno));
+  }
+}
+
+size_t ScannerHub::add(const SOPASProtocol::SOPASProtocolPtr &scanner) {
+  if (running_.load()) {
+    throw std::runtime_error("Cannot add scanners to a running ScannerHub.");
+  }
+  if (!scanner) {
+    throw std::runtime_error("Cannot add null scanner to ScannerHub.");
+  }
+  std::unique_ptr<Entry> entry(new Entry());
+  entry->id = entries_.size();
+  entry->scanner = scanner;
+  entry->active = true;
+  if (callback_) {
+    const size_t id = entry->id;
+    entry->sink = [this, id](Scan &scan) { callback_(id, scan); };
+  } else {
+    SOPASProtocol *protocol = scanner.get();
+    entry->sink = [protocol](Scan &scan) { protocol->deliver(scan); };
+  }
+  entries_.push_back(std::move(entry));
+  return entries_.back()->id;
+}
+
+SickErr ScannerHub::start() {
+  if (running_.load()) {
+    return sick_err_t::Ok;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) < 0) {
+    return SickErr(errno);
+  }
+  for (const auto &entry : entries_) {
+    entry->active = true;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = entry.get();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, entry->scanner->sock_fd_,
+                  &event) < 0) {
+      const SickErr err(errno);
+      for (const auto &added : entries_) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, added->scanner->sock_fd_, nullptr);
+      }
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, wakeup_fd_, nullptr);
+      return err;
+    }
+  }
+
+  size_t n_threads = n_threads_;
+  if (n_threads == 0) {
+    n_threads = std::max<size_t>(
+        1, std::min<size_t>(std::thread::hardware_concurrency(),
+                            entries_.size()));
+  }
+  for (const auto &entry : entries_) {
+    // the workers read command replies from now on
+    entry->scanner->start_receiving();
+  }
+  running_.store(true);
+  for (size_t i = 0; i < n_threads; ++i) {
+    workers_.emplace_back([this] { work(); });
+  }
+  return sick_err_t::Ok;
+}
+
+void ScannerHub::work() {
+  std::vector<char> buffer(2 * 4096);
+  std::array<struct epoll_event, MAX_EVENTS> events;
+  while (true) {
+    const int n_events = epoll_wait(epoll_fd_, events.data(), MAX_EVENTS, -1);
+    if (n_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    for (int i = 0; i < n_events; ++i) {
+      Entry *entry = static_cast<Entry *>(events[i].data.ptr);
+      if (entry == nullptr) {
+        // the eventfd is never reset, so it wakes up every worker
+        return;
+      }
+      receive(*entry, buffer);
+    }
+  }
+}
+
+void ScannerHub::receive(Entry &entry, std::vector<char> &buffer) {
+  // the socket is armed one-shot, so the lock is never contended. it only
+  // makes the batcher state visible to the next worker serving this scanner.
+  std::lock_guard<std::mutex> lock(entry.mutex);
+  const int sock_fd = entry.scanner->sock_fd_;
+  ssize_t read_bytes;
+  std::chrono::system_clock::time_point received;
+  while ((read_bytes = recv_timestamped(sock_fd, buffer.data(), buffer.size(),
+                                        MSG_DONTWAIT, received)) == -1 &&
+         errno == EINTR) {
+    continue;
+  }
+  if (read_bytes > 0) {
+    entry.scanner->receive_scan_data(buffer.data(), read_bytes, received,
+                                     entry.sink);
+  } else if (read_bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    // connection closed or broken, stop watching it until reconnected
+    const SickErr error =
+        read_bytes == 0 ? SickErr(sick_err_t::CustomErrorConnectionClosed)
+                        : SickErr(errno);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, sock_fd, nullptr);
+    entry.active = false;
+    entry.scanner->commands_.fail(error);
+    if (entry.recovery.joinable()) {
+      // finished, it armed the socket which was just lost
+      entry.recovery.join();
+    }
+    Entry *lost = &entry;
+    entry.recovery =
+        std::thread([this, lost, error] { recover(*lost, error); });
+    return;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = &entry;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, sock_fd, &event);
+}
+
+void ScannerHub::recover(Entry &entry, SickErr error) {
+  if (!entry.scanner->recover(error, &stopping_)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(entry.mutex);
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = &entry;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, entry.scanner->sock_fd_, &event) <
+      0) {
+    entry.scanner->notify(ConnectionEvent{ConnectionState::Failed, 0,
+                                          SickErr(errno),
+                                          std::chrono::milliseconds(0)});
+    return;
+  }
+  entry.active = true;
+}
+
+void ScannerHub::stop() {
+  if (!running_.load()) {
+    return;
+  }
+  const uint64_t one = 1;
+  if (write(wakeup_fd_, &one, sizeof(one)) < 0) {
+    throw std::runtime_error(std::string("Unable to wake up hub workers: ") +
+                             strerror(errno));
+  }
+  stopping_.store(true);
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  for (const auto &entry : entries_) {
+    if (entry->recovery.joinable()) {
+      entry->recovery.join();
+    }
+  }
+  stopping_.store(false);
+
+  uint64_t count;
+  while (read(wakeup_fd_, &count, sizeof(count)) > 0) {
+    continue;
+  }
+  for (const auto &entry : entries_) {
+    if (entry->active) {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, entry->scanner->sock_fd_, nullptr);
+    }
+    entry->scanner->receiving_.store(false);
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, wakeup_fd_, nullptr);
+  running_.store(false);
+}
+
+ScannerHub::~ScannerHub() {
+  stop();
+  close(wakeup_fd_);
+  close(epoll_fd_);
+}
+
+} // namespace sick
@@ -1,9 +1,14 @@
 #include <arpa/inet.h>
+#include <cstring>
 #include <errno.h>
 #include <fcntl.h>
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#endif
 #include <poll.h>
 #include <sick-lms5xx/network.hpp>
 #include <stdexcept>
+#include <time.h>
 
 namespace sick {
 
@@ -114,4 +119,57 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr,
   // Success
   return rc;
 }
+
+int enable_receive_timestamps(int sockfd, bool hardware) {
+#ifdef SO_TIMESTAMPING
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (hardware) {
+    flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+  }
+  return setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                    sizeof(flags));
+#else
+  (void)sockfd;
+  (void)hardware;
+  errno = ENOPROTOOPT;
+  return -1;
+#endif
+}
+
+ssize_t recv_timestamped(int sockfd, void *buf, size_t len, int flags,
+                         std::chrono::system_clock::time_point &received) {
+  struct iovec iov = {buf, len};
+  // software, deprecated and hardware time stamp
+  alignas(struct cmsghdr) char control[CMSG_SPACE(3 * sizeof(timespec))];
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  const ssize_t n = recvmsg(sockfd, &msg, flags);
+  received = std::chrono::system_clock::now();
+  if (n <= 0) {
+    return n;
+  }
+#ifdef SO_TIMESTAMPING
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SO_TIMESTAMPING) {
+      continue;
+    }
+    timespec ts[3];
+    std::memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+    const timespec &stamp =
+        ts[2].tv_sec != 0 || ts[2].tv_nsec != 0 ? ts[2] : ts[0];
+    if (stamp.tv_sec != 0 || stamp.tv_nsec != 0) {
+      received = std::chrono::system_clock::time_point(
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              std::chrono::seconds(stamp.tv_sec) +
+              std::chrono::nanoseconds(stamp.tv_nsec)));
+    }
+  }
+#endif
+  return n;
+}
 } // namespace sick
@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <sick-lms5xx/command_table.hpp>
+#include <sick-lms5xx/framing.hpp>
 #include <sick-lms5xx/parsing.hpp>
 
 using namespace std;
@@ -23,6 +28,77 @@ TokenBuffer::TokenBuffer(const char *tokens, size_t len, char delim) {
   iter_ = tokens_copy_.begin();
 }
 
+bool TokenView::contains(const char *needle) const {
+  const size_t needle_len = strlen(needle);
+  if (needle_len > size) {
+    return false;
+  }
+  for (size_t i = 0; i + needle_len <= size; ++i) {
+    if (std::memcmp(data + i, needle, needle_len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TokenView::operator==(const char *str) const {
+  return strlen(str) == size && std::memcmp(data, str, size) == 0;
+}
+
+long parse_hex(const char *data, size_t len) {
+  size_t idx = 0;
+  bool negative = false;
+  if (idx < len && (data[idx] == '-' || data[idx] == '+')) {
+    negative = data[idx] == '-';
+    ++idx;
+  }
+  unsigned long value = 0;
+  for (; idx < len; ++idx) {
+    const int digit = hex_digit(data[idx]);
+    if (digit < 0) {
+      break;
+    }
+    value = (value << 4) | digit;
+  }
+  return negative ? -static_cast<long>(value) : static_cast<long>(value);
+}
+
+TokenCursor::TokenCursor(const char *tokens, size_t len, char delim)
+    : pos_(tokens), end_(tokens + len), delim_(delim), exhausted_(false) {}
+
+TokenView TokenCursor::next() {
+  if (!has_next()) {
+    exhausted_ = true;
+    return TokenView{end_, 0};
+  }
+  const char *begin = pos_;
+  const char *tok_end = static_cast<const char *>(
+      std::memchr(begin, delim_, end_ - begin));
+  if (tok_end == nullptr) {
+    pos_ = end_;
+    return TokenView{begin, static_cast<size_t>(end_ - begin)};
+  }
+  pos_ = tok_end + 1;
+  return TokenView{begin, static_cast<size_t>(tok_end - begin)};
+}
+
+size_t TokenCursor::next_hex_values(uint32_t *out, size_t n) {
+  if (delim_ != ' ') {
+    return 0;
+  }
+  size_t consumed;
+  const size_t n_values =
+      decode_hex_values(pos_, end_ - pos_, out, n, consumed);
+  pos_ += consumed;
+  return n_values;
+}
+
+void TokenCursor::skip(size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    next();
+  }
+}
+
 bool TokenBuffer::has_next() const { return iter_ != tokens_copy_.end(); }
 
 const char *TokenBuffer::next() {
@@ -44,68 +120,92 @@ Channel::Channel(const std::string &description, size_t n_values,
 
 bool Channel::valid() const { return angles.size() == values.size(); }
 
-ScanBatcher::ScanBatcher() { num_bytes_buffered = 0; }
+ScanBatcher::ScanBatcher()
+    : num_bytes_buffered(0), pipeline_stats(nullptr) {}
 
 simple_optional<Scan> ScanBatcher::add_data(const char *data_new,
                                             size_t length) {
-  if (length < 1) {
-    return simple_optional<Scan>();
+  simple_optional<Scan> result;
+  add_data(data_new, length,
+           [&result](Scan &scan) { result = simple_optional<Scan>(scan); });
+  return result;
+}
+
+void ScanBatcher::append(const char *data, size_t length) {
+  const size_t needed = num_bytes_buffered + length;
+  if (buffer.size() < needed) {
+    // grow geometrically, so that appends are amortized O(1) and the buffer
+    // stops growing once it holds the largest telegram
+    buffer.resize(std::max(needed, 2 * buffer.size()));
   }
+  std::memcpy(buffer.data() + num_bytes_buffered, data, length);
+  num_bytes_buffered = needed;
+}
 
-  // check if etx found
-  int etx_idx = -1;
-  for (size_t i = 0; i < length; ++i) {
-    if (data_new[i] == ETX) {
-      etx_idx = i;
-      break;
+bool ScanBatcher::handle_telegram(const char *telegram, size_t len,
+                                  const ScanSink &sink) {
+  if (pipeline_stats) {
+    pipeline_stats->telegram_framed();
+  }
+  if (telegram[0] != STX || telegram[len - 1] != ETX) {
+    if (pipeline_stats) {
+      pipeline_stats->framing_error();
     }
+    return false;
   }
+  if (pipeline_stats) {
+    pipeline_stats->parse_started();
+  }
+  const bool ok = parse_scan_telegram(telegram, len, s);
+  if (pipeline_stats) {
+    pipeline_stats->parse_finished(ok);
+  }
+  if (!ok) {
+    return false;
+  }
+  if (pipeline_stats) {
+    pipeline_stats->callback_started();
+  }
+  sink(s);
+  if (pipeline_stats) {
+    pipeline_stats->callback_finished();
+  }
+  return true;
+}
 
-  bool got_scan = false;
-
-  // 1. if etx found -> append data up until etx to current buffer, parse
-  // scan, then replace by everything after etx
-  // 2. no etx found -> append all data
-  if (etx_idx < 0) {
-    buffer.reserve(num_bytes_buffered + length + 1);
-    std::memcpy(buffer.data() + num_bytes_buffered, data_new, length);
-    num_bytes_buffered += length;
-  } else {
-    // etx found
-    buffer.reserve(num_bytes_buffered + etx_idx + 1);
-    std::memcpy(buffer.data() + num_bytes_buffered, data_new, etx_idx + 1);
-    num_bytes_buffered += etx_idx + 1;
-    if (buffer[0] == STX && buffer[num_bytes_buffered - 1] == ETX) {
-      // try to parse scan telegram
-      if (parse_scan_telegram(buffer, num_bytes_buffered - 1, s)) {
-        // return the scan
-        got_scan = true;
-      } else {
-        /* std::cout << "Error: scan did not parse" << std::endl; */
-      }
-    } else {
-      /* std::cout << "Error: invalid data." << std::endl; */
-    }
-    num_bytes_buffered = 0;
-
-    if (length > etx_idx + 1) {
-      // trailing data must be kept
-      // You'd think to check that the start token of the trailing data is
-      // STX, but the partial datagrams don't seem to have it
-      const size_t new_data_length = length - (etx_idx + 1);
-      buffer.reserve(new_data_length);
-      if (new_data_length > 0) {
-        std::memcpy(buffer.data(), data_new + etx_idx + 1, new_data_length);
+size_t ScanBatcher::add_data(const char *data_new, size_t length,
+                             const ScanSink &sink) {
+  size_t n_scans = 0;
+  find_frames(data_new, length, frames);
+  for (const FrameSpan &span : frames) {
+    const char *segment = data_new + span.begin;
+    size_t telegram_len = span.end - span.begin;
+    if (num_bytes_buffered == 0) {
+      // a new telegram starts here. skip separators before its STX
+      if (span.stx != NO_STX) {
+        segment = data_new + span.stx;
+        telegram_len = span.end - span.stx;
+      } else if (!span.terminated) {
+        // only separators
+        break;
       }
-      num_bytes_buffered = new_data_length;
     }
-  }
 
-  if (got_scan) {
-    return simple_optional<Scan>(s);
-  } else {
-    return simple_optional<Scan>();
+    if (!span.terminated) {
+      // incomplete telegram, keep it for the next call
+      append(segment, telegram_len);
+      break;
+    }
+    if (num_bytes_buffered == 0) {
+      // the telegram is complete in data_new, parse it in place
+      n_scans += handle_telegram(segment, telegram_len, sink);
+    } else {
+      append(segment, telegram_len);
+      n_scans += handle_telegram(buffer.data(), num_bytes_buffered, sink);
+      num_bytes_buffered = 0;
+    }
   }
+  return n_scans;
 }
 
 Channel ScanBatcher::parse_channel(TokenBuffer &buf) {
@@ -126,7 +226,7 @@ Channel ScanBatcher::parse_channel(TokenBuffer &buf) {
 
   const long n_values = strtol(buf.next(), &p, 16);
 
-  Channel cn(content, ang_incr, n_values);
+  Channel cn(content, n_values, ang_incr);
   for (int i = 0; i < n_values; ++i) {
     const long value = strtol(buf.next(), &p, 16);
     cn.values.emplace_back(offset + scale_factor * value);
@@ -138,146 +238,268 @@ Channel ScanBatcher::parse_channel(TokenBuffer &buf) {
   return cn;
 }
 
+std::shared_ptr<const AngleTable> AngleTable::get(unsigned int n_values,
+                                                  deg start, deg incr) {
+  static std::mutex mutex;
+  // tables are owned by the scans using them, so that the cache does not grow
+  // with every geometry ever seen
+  static std::vector<std::weak_ptr<const AngleTable>> cache;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &entry : cache) {
+    auto table = entry.lock();
+    if (table && table->matches(n_values, start, incr)) {
+      return table;
+    }
+  }
+  // prune tables of geometries no scan uses anymore
+  cache.erase(std::remove_if(cache.begin(), cache.end(),
+                             [](const std::weak_ptr<const AngleTable> &entry) {
+                               return entry.expired();
+                             }),
+              cache.end());
+  auto table = std::make_shared<AngleTable>();
+  table->size = n_values;
+  table->start_angle = start;
+  table->ang_increment = incr;
+  Eigen::VectorXf angles(n_values, 1);
+  for (unsigned int i = 0; i < n_values; ++i) {
+    angles(i) = angle_from_lms(start + i * incr);
+  }
+  table->cos_map = Eigen::cos(angles.array());
+  table->sin_map = Eigen::sin(angles.array());
+  cache.push_back(table);
+  return table;
+}
+
+void update_scan_angles(ScanInfo &info, unsigned int n_values,
+                        deg start_angle, deg ang_incr, unsigned int n_echoes) {
+  if (info.angles && info.angles->matches(n_values, start_angle, ang_incr) &&
+      info.n_echoes == n_echoes) {
+    return;
+  }
+  info.size = n_values;
+  info.n_echoes = n_echoes;
+  info.ang_increment = ang_incr;
+  // round trip through float like the angle table does
+  info.start_angle =
+      angle_to_lms(static_cast<float>(angle_from_lms(start_angle)));
+  info.end_angle = angle_to_lms(static_cast<float>(
+      angle_from_lms(start_angle + (n_values - 1) * ang_incr)));
+  info.angles = AngleTable::get(n_values, start_angle, ang_incr);
+}
+
+void update_scan_geometry(Scan &scan, unsigned int n_values, deg start_angle,
+                          deg ang_incr, unsigned int n_echoes) {
+  update_scan_angles(scan, n_values, start_angle, ang_incr, n_echoes);
+  // no-ops unless the size changed or a sink took the buffers
+  scan.ranges.resize(n_echoes, n_values);
+  scan.intensities.resize(n_echoes, n_values);
+}
+
+void update_scan_timing(ScanInfo &scan, hz scan_frequency,
+                        hz measurement_frequency) {
+  scan.scan_frequency = scan_frequency;
+  scan.measurement_frequency = measurement_frequency;
+  if (measurement_frequency > 0) {
+    scan.time_increment = static_cast<float>(1 / measurement_frequency);
+  } else if (scan_frequency > 0 && scan.angles) {
+    // the mirror turns by 360 degrees per scan
+    scan.time_increment = static_cast<float>(
+        scan.angles->ang_increment / 360 / scan_frequency);
+  } else {
+    scan.time_increment = 0;
+  }
+}
+
+std::chrono::system_clock::time_point scan_time(long year, long month,
+                                                long day, long hour,
+                                                long minute, long second,
+                                                long microsecond) {
+  // mktime() is slow and takes the time zone lock, but scans only cross an
+  // hour boundary every few thousand scans. DST changes happen on the hour.
+  struct HourCache {
+    long year, month, day, hour;
+    std::time_t start;
+  };
+  thread_local HourCache cache{-1, -1, -1, -1, 0};
+  if (year != cache.year || month != cache.month || day != cache.day ||
+      hour != cache.hour) {
+    std::tm tm;
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    cache = HourCache{year, month, day, hour, std::mktime(&tm)};
+  }
+  return std::chrono::system_clock::from_time_t(cache.start) +
+         std::chrono::seconds(minute * 60 + second) +
+         std::chrono::microseconds(microsecond);
+}
+
+bool ScanBatcher::parse_channel_header(TokenCursor &cur,
+                                       ChannelHeader &header) {
+  header.description = cur.next();
+  header.scale_factor = cur.next() == "3F800000" ? 1 : 2;
+  header.offset = cur.next_hex();
+  // start angle is a signed 32 bit value
+  const uint32_t start_angle_u = static_cast<uint32_t>(cur.next_hex());
+  header.start_angle = static_cast<int32_t>(start_angle_u) / 10000.0;
+  header.ang_incr = cur.next_hex() / 10000.0;
+  header.n_values = cur.next_hex();
+  return cur.ok();
+}
+
+/**
+ * @brief   Decode the values of a channel as `offset + scale_factor * value`
+ *
+ * @param cur   Cursor at the first value
+ * @param header    Header of the channel
+ * @param out   Receives \ref ChannelHeader::n_values values
+ */
+static void decode_channel(TokenCursor &cur, const ChannelHeader &header,
+                           float *out) {
+  // raw values are decoded in bulk, in chunks that fit on the stack
+  static constexpr size_t CHUNK_SIZE = 128;
+  uint32_t raw[CHUNK_SIZE];
+  const size_t n_values = header.n_values;
+  size_t i = 0;
+  while (i < n_values) {
+    const size_t n_chunk = std::min(CHUNK_SIZE, n_values - i);
+    const size_t n_raw = cur.next_hex_values(raw, n_chunk);
+    for (size_t k = 0; k < n_raw; ++k) {
+      out[i + k] =
+          header.offset + header.scale_factor * static_cast<long>(raw[k]);
+    }
+    i += n_raw;
+    if (n_raw < n_chunk) {
+      // e.g. a sign, or the end of the telegram
+      out[i++] = header.offset + header.scale_factor * cur.next_hex();
+    }
+  }
+}
+
 bool ScanBatcher::parse_scan_telegram(const std::vector<char> &buffer,
                                       size_t last_valid_idx, Scan &scan) {
-  using std::string;
-  // remove STX and ETX bytes
-  TokenBuffer buf(&buffer[1], last_valid_idx);
+  return parse_scan_telegram(buffer.data(), last_valid_idx + 1, scan);
+}
 
-  string method(buf.next());
-  string command(buf.next());
-  string proto_version(buf.next());
-  string device_num(buf.next());
-  char *p;
-  const int serial_num = strtol(buf.next(), &p, 16);
-  string device_status1(buf.next());
-  string device_status2(buf.next());
-  string num_telegrams(buf.next());
-  string num_scans(buf.next());
-  const long time_since_boot_us = strtol(buf.next(), &p, 16);
-  const long time_of_transmission_us = strtol(buf.next(), &p, 16);
-  string status_digital_input_pins1(buf.next());
-  string status_digital_input_pins2(buf.next());
-  string status_digital_output_pins1(buf.next());
-  string status_digital_output_pins2(buf.next());
-  string layer_angle(buf.next());
+bool ScanBatcher::parse_scan_telegram(const char *telegram, size_t len,
+                                      Scan &scan) {
+  if (len < 2) {
+    return false;
+  }
+  // remove STX and ETX bytes
+  TokenCursor cur(telegram + 1, len - 2);
+
+  // method, command, version, device number
+  cur.skip(4);
+  const long serial_num = cur.next_hex();
+  // device status, telegram counter, scan counter
+  cur.skip(4);
+  const long time_since_boot_us = cur.next_hex();
+  const long time_of_transmission_us = cur.next_hex();
+  // digital input and output pins, layer angle
+  cur.skip(5);
   // if layer_angle != 0: error
-  const double scan_freq = strtol(buf.next(), &p, 16) / 100.0;
-  const long measurement_freq = strtol(buf.next(), &p, 16);
-  const long encoder = strtol(buf.next(), &p, 16);
+  const double scan_freq = cur.next_hex() / 100.0;
+  const long measurement_freq = cur.next_hex();
+  const long encoder = cur.next_hex();
   if (encoder != 0) {
-    // pos
-    buf.next();
-    // speed
-    buf.next();
+    // pos, speed
+    cur.skip(2);
   }
-  const long num_16bit_channels = strtol(buf.next(), &p, 16);
-  if (num_16bit_channels != 1) {
+  // one distance channel per echo
+  const long num_16bit_channels = cur.next_hex();
+  if (num_16bit_channels < 1 || num_16bit_channels > MAX_ECHOES) {
     return false;
-    /* throw std::runtime_error(__fun__+ ": num_16bit_channels != 1"); */
   }
-
-  std::vector<Channel> channels_16bit(num_16bit_channels);
-  for (int i = 0; i < num_16bit_channels; ++i) {
-    channels_16bit[i] = parse_channel(buf);
+  const unsigned int n_echoes = num_16bit_channels;
+
+  unsigned int n_values = 0;
+  for (unsigned int echo = 0; echo < n_echoes; ++echo) {
+    ChannelHeader range_header;
+    if (!parse_channel_header(cur, range_header) ||
+        !range_header.description.contains("DIST") ||
+        range_header.n_values < 1 ||
+        range_header.n_values > MAX_CHANNEL_VALUES ||
+        // each value takes at least a digit and a space
+        static_cast<size_t>(range_header.n_values) > cur.remaining() / 2) {
+      return false;
+    }
+    if (echo == 0) {
+      n_values = range_header.n_values;
+      update_scan_geometry(scan, n_values, range_header.start_angle,
+                           range_header.ang_incr, n_echoes);
+    } else if (range_header.n_values != n_values) {
+      return false;
+    }
+    decode_channel(cur, range_header, scan.ranges.row(echo).data());
+    // distances are sent in mm
+    scan.range_scaling[echo] =
+        ChannelScaling{range_header.scale_factor / 1000.0f,
+                       range_header.offset / 1000.0f};
   }
 
-  const long num_8bit_channels = strtol(buf.next(), &p, 16);
-  if (num_8bit_channels != 1) {
+  // one remission channel per echo
+  const long num_8bit_channels = cur.next_hex();
+  if (num_8bit_channels != num_16bit_channels) {
     return false;
-    /* throw std::runtime_error(__func__ + ": num_8bit_channels = " + */
-    /*                          std::to_string(num_8bit_channels)); */
   }
 
-  std::vector<Channel> channels_8bit(num_8bit_channels);
-  for (int i = 0; i < num_8bit_channels; ++i) {
-    channels_8bit[i] = parse_channel(buf);
+  for (unsigned int echo = 0; echo < n_echoes; ++echo) {
+    ChannelHeader intensity_header;
+    if (!parse_channel_header(cur, intensity_header) ||
+        !intensity_header.description.contains("RSSI") ||
+        intensity_header.n_values != n_values) {
+      return false;
+    }
+    decode_channel(cur, intensity_header,
+                   scan.intensities.row(echo).data());
+    scan.intensity_scaling[echo] =
+        ChannelScaling{static_cast<float>(intensity_header.scale_factor),
+                       static_cast<float>(intensity_header.offset)};
   }
 
-  const long position = strtol(buf.next(), &p, 16);
-  const long name_exists = strtol(buf.next(), &p, 16);
+  const long position = cur.next_hex();
+  const long name_exists = cur.next_hex();
   if (name_exists == 1) {
-    buf.next();
-    buf.next();
+    cur.skip(2);
   }
   // always 0
-  const long comment_exists = strtol(buf.next(), &p, 16);
+  const long comment_exists = cur.next_hex();
 
-  const long time_exists = strtol(buf.next(), &p, 16);
+  const long time_exists = cur.next_hex();
+  long time[7];
   if (time_exists == 1) {
-    const long y = strtol(buf.next(), &p, 16);
-    const long mo = strtol(buf.next(), &p, 16);
-    const long d = strtol(buf.next(), &p, 16);
-    const long h = strtol(buf.next(), &p, 16);
-    const long mi = strtol(buf.next(), &p, 16);
-    const long s = strtol(buf.next(), &p, 16);
-    const long us = strtol(buf.next(), &p, 16);
-    std::tm tm;
-    tm.tm_year = y - 1900;
-    tm.tm_mon = mo - 1;
-    tm.tm_mday = d;
-    tm.tm_hour = h;
-    tm.tm_min = mi;
-    tm.tm_sec = s;
-    tm.tm_isdst = -1;
-    std::time_t tmt = std::mktime(&tm);
-    std::chrono::system_clock::time_point stamp =
-        std::chrono::system_clock::from_time_t(tmt) +
-        std::chrono::microseconds(us);
-
-    if (channels_16bit.size() < 1) {
-      return false;
-      /* throw std::runtime_error(__func__ + */
-      /*                          ": parse_scan_telegram() got no 16bit channels"); */
-    } else {
-      const Channel &range_cn = channels_16bit.front();
-      if (range_cn.description.find("DIST") == std::string::npos) {
-        return false;
-        /* throw std::runtime_error( */
-        /*     __func__ + ": First 16bit channel was not range but " + */
-        /*     range_cn.description); */
-      } else {
-        const Channel &intensity_cn = channels_8bit.front();
-        if (intensity_cn.description.find("RSSI") == std::string::npos) {
-          return false;
-          /* throw std::runtime_error( */
-          /*     __func__ + ": First 8bit channel was not intensity but " + */
-          /*     range_cn.description); */
-        } else {
-          if (range_cn.values.size() != intensity_cn.values.size()) {
-            throw std::runtime_error(
-                "Ranges and intensities not matched in size.");
-          } else {
-            if (scan.ranges.size() == 0) {
-              // first time -> fill nonchanging fields
-              scan.size = range_cn.values.size();
-              scan.ranges = Eigen::VectorXf::Zero(scan.size, 1);
-              scan.intensities = Eigen::VectorXf::Zero(scan.size, 1);
-              scan.ang_increment = range_cn.ang_incr;
-              scan.start_angle = angle_to_lms(range_cn.angles.front());
-              scan.end_angle = angle_to_lms(range_cn.angles.back());
-              Eigen::VectorXf angles(scan.size, 1);
-              std::memcpy(angles.data(), &range_cn.angles[0],
-                          scan.size * sizeof(float));
-              scan.cos_map = Eigen::cos(angles.array());
-              scan.sin_map = Eigen::sin(angles.array());
-            }
-
-            std::memcpy(scan.ranges.data(), &range_cn.values[0],
-                        scan.size * sizeof(float));
-            scan.ranges /= 1000;
-            std::memcpy(scan.intensities.data(), &intensity_cn.values[0],
-                        scan.size * sizeof(float));
-            scan.time = stamp;
-            return true;
-          }
-        }
-      }
+    // year, month, day, hour, minute, second, microsecond
+    for (long &field : time) {
+      field = cur.next_hex();
     }
+  }
+  if (!cur.ok()) {
+    return false;
+  }
+
+  scan.ranges /= 1000;
+  // measurement frequency is sent in units of 100 Hz
+  update_scan_timing(scan, scan_freq, measurement_freq * 100.0);
+  scan.time_since_boot_us = static_cast<uint32_t>(time_since_boot_us);
+  scan.time_of_transmission_us =
+      static_cast<uint32_t>(time_of_transmission_us);
+  if (time_exists == 1) {
+    scan.time = scan_time(time[0], time[1], time[2], time[3], time[4],
+                          time[5], time[6]);
+    scan.time_source = ScanTimeSource::Device;
   } else {
-    // no time stamp, use system time?
+    // no NTP configured, the receiver may stamp the scan
+    scan.time = std::chrono::system_clock::time_point();
+    scan.time_source = ScanTimeSource::None;
   }
-  return false;
+  return true;
 }
 
 std::string method(const char *sopas_reply, size_t len) {
@@ -287,24 +509,38 @@ std::string method(const char *sopas_reply, size_t len) {
     return std::string(sopas_reply + 1, 3);
 }
 
-bool status_ok(const std::string &cmd_name, int status_code) {
-  if (cmd_name == "mLMPsetscancfg") {
-    return status_code == 0;
-  }
-  if (cmd_name == "mEEwriteall") {
-    return status_code == 1;
-  }
-  if (cmd_name == "Run") {
-    return status_code == 1;
-  }
-  if (cmd_name == "LMCstopmeas" || cmd_name == "LMCstartmeas") {
-    return status_code == 0;
+/// Reply status of each command, indexed by \ref SOPASCommand
+static constexpr std::array<CommandStatus, N_SOPAS_COMMANDS> command_statuses =
+    command_status_table(std::make_index_sequence<N_SOPAS_COMMANDS>());
+
+/// Commands by the method and name of their replies
+static constexpr ReplyIndex replies = reply_index(command_statuses);
+
+SOPASCommand reply_command(const char *reply, size_t len) {
+  const uint32_t hash = fnv1a(reply, len);
+  for (size_t slot = hash % REPLY_INDEX_SIZE; replies.slots[slot] != -1;
+       slot = (slot + 1) % REPLY_INDEX_SIZE) {
+    const CommandStatus &status = command_statuses[replies.slots[slot]];
+    if (status.hash != hash || status.len != len) {
+      continue;
+    }
+    bool match = true;
+    for (size_t i = 0; i < len && match; ++i) {
+      match = reply[i] == reply_char(status.request, i);
+    }
+    if (match) {
+      return static_cast<SOPASCommand>(replies.slots[slot]);
+    }
   }
-  if (cmd_name == "LMDscandata") {
-    // 0 means stop, 1 means start, there is no error
-    return true;
+  return UNKNOWN_COMMAND;
+}
+
+bool status_ok(SOPASCommand command, int status_code) {
+  if (command == UNKNOWN_COMMAND) {
+    return status_code == STATUS_SUCCESS;
   }
-  return status_code == 1;
+  const int success = command_statuses[command].success;
+  return success == STATUS_ANY || status_code == success;
 }
 
 bool validate_response(const char *data, size_t len) {
@@ -315,45 +551,75 @@ bool validate_response(const char *data, size_t len) {
   // somehow read multiple messages, which can happen in some cases if you
   // time out your recv, but the data then comes with your next call (should
   // you try one)
-  size_t n_stx = 0, n_etx = 0;
-  for (int i = 0; i < len; ++i) {
-    if (data[i] == STX) {
-      ++n_stx;
-    }
-    if (data[i] == ETX) {
-      ++n_etx;
-    }
-  }
+  size_t n_stx, n_etx;
+  count_delimiters(data, len, n_stx, n_etx);
   return n_stx == 1 && n_etx == 1;
 }
 
 SickErr status_from_bytes_ascii(const char *data, size_t len) {
+  return classify_reply_ascii(data, len).status;
+}
+
+/**
+ * @return  Decimal value at the start of \p tok, like atoi()
+ */
+static int parse_status(const TokenView &tok) {
+  size_t idx = 0;
+  bool negative = false;
+  if (idx < tok.size && (tok.data[idx] == '-' || tok.data[idx] == '+')) {
+    negative = tok.data[idx] == '-';
+    ++idx;
+  }
+  int value = 0;
+  for (; idx < tok.size && tok.data[idx] >= '0' && tok.data[idx] <= '9';
+       ++idx) {
+    value = value * 10 + (tok.data[idx] - '0');
+  }
+  return negative ? -value : value;
+}
+
+ReplyStatus classify_reply_ascii(const char *data, size_t len) {
   if (!validate_response(data, len)) {
-    return sick_err_t::CustomErrorInvalidDatagram;
-  }
-  const std::string answer_method = method(data, len);
-  if (answer_method == "sFA") {
-    // generic errors
-    static const char pattern[]{"\x02sFA %2X\x03"};
-    unsigned int status = 0;
-    int scanf_result = sscanf(data, pattern, &status);
-    if (scanf_result != 1) {
-      return sick_err_t::CustomError;
+    return {UNKNOWN_COMMAND, sick_err_t::CustomErrorInvalidDatagram};
+  }
+  // there is exactly one of each, ETX may be followed by garbage
+  const char *stx = static_cast<const char *>(std::memchr(data, STX, len));
+  const char *etx = static_cast<const char *>(
+      std::memchr(stx, ETX, data + len - stx));
+  if (etx == nullptr) {
+    return {UNKNOWN_COMMAND, sick_err_t::CustomErrorInvalidDatagram};
+  }
+  const char *payload = stx + 1;
+  const size_t payload_len = etx - payload;
+  if (payload_len >= 3 && std::memcmp(payload, "sFA", 3) == 0) {
+    // generic errors, optionally separated by a space from the hex code
+    size_t idx = 3;
+    if (idx < payload_len && payload[idx] == ' ') {
+      ++idx;
+    }
+    const size_t n_digits = payload_len - idx;
+    if (n_digits == 0 || n_digits > 2 || hex_digit(payload[idx]) < 0 ||
+        hex_digit(payload[payload_len - 1]) < 0) {
+      return {UNKNOWN_COMMAND, sick_err_t::CustomError};
     }
-    return static_cast<sick_err_t>(status);
+    const unsigned int status = parse_hex(payload + idx, n_digits);
+    if (status >= static_cast<unsigned int>(sick_err_t::_LAST)) {
+      return {UNKNOWN_COMMAND, sick_err_t::CustomError};
+    }
+    return {UNKNOWN_COMMAND, static_cast<sick_err_t>(status)};
+  }
+  TokenCursor tokens(payload, payload_len);
+  tokens.skip(); // method
+  const TokenView cmd_name = tokens.next();
+  const SOPASCommand command =
+      reply_command(payload, cmd_name.data + cmd_name.size - payload);
+  if (!tokens.has_next()) {
+    return {command, sick_err_t::Ok};
+  }
+  if (status_ok(command, parse_status(tokens.next()))) {
+    return {command, sick_err_t::Ok};
   } else {
-    TokenBuffer buf(data, len);
-    std::string method(buf.next());
-    std::string cmd_name(buf.next());
-    if (buf.has_next()) {
-      int status_code = atoi(buf.next());
-      if (status_ok(cmd_name, status_code)) {
-        return sick_err_t::Ok;
-      } else {
-        return sick_err_t::CustomErrorCommandFailure;
-      }
-    } else
-      return sick_err_t::Ok;
+    return {command, sick_err_t::CustomErrorCommandFailure};
   }
 }
 
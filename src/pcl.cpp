@@ -1,34 +1,51 @@
+#include <algorithm>
 #include <sick-lms5xx/parsing.hpp>
 #include <sick-lms5xx/pcl.hpp>
+#include <sick-lms5xx/projection.hpp>
 
 namespace sick {
 namespace pcl {
 
+static constexpr size_t PROJECTION_CHUNK =
+    256; ///< rays projected at once into stack buffers
+
+/**
+ * @brief   Fill a resized cloud with the points of \p scan. Coordinates are
+ * projected chunk-wise into small stack buffers, so no temporaries are
+ * allocated.
+ */
+static void fill_cloud(const sick::Scan &scan,
+                       ::pcl::PointCloud<::pcl::PointXYZI> &cloud) {
+  float x[PROJECTION_CHUNK];
+  float y[PROJECTION_CHUNK];
+  const size_t n_points = cloud.size();
+  for (size_t begin = 0; begin < n_points; begin += PROJECTION_CHUNK) {
+    const size_t n = std::min(PROJECTION_CHUNK, n_points - begin);
+    project_scan(scan, begin, n, x, y);
+    for (size_t i = 0; i < n; ++i) {
+      ::pcl::PointXYZI &point = cloud.points[begin + i];
+      point.x = x[i];
+      point.y = y[i];
+      point.z = 0;
+      // first echo
+      point.intensity = scan.intensities(0, begin + i);
+    }
+  }
+}
+
 ::pcl::PointCloud<::pcl::PointXYZI>::Ptr
 cloud_ptr_from_scan(const sick::Scan &scan) {
   ::pcl::PointCloud<::pcl::PointXYZI>::Ptr cloud_out =
       ::pcl::make_shared<::pcl::PointCloud<::pcl::PointXYZI>>();
-  cloud_out->resize(scan.ranges.size());
-  for (int i = 0; i < scan.ranges.size(); ++i) {
-    cloud_out->points[i].x = scan.ranges(i) * scan.cos_map(i);
-    cloud_out->points[i].y = scan.ranges(i) * scan.sin_map(i);
-    cloud_out->points[i].z = 0;
-    cloud_out->points[i].intensity = scan.intensities[i];
-  }
+  cloud_out->resize(scan.size);
+  fill_cloud(scan, *cloud_out);
   return cloud_out;
 }
 
 ::pcl::PointCloud<::pcl::PointXYZI> cloud_from_scan(const sick::Scan &scan) {
   ::pcl::PointCloud<::pcl::PointXYZI> cloud_out;
-  cloud_out.resize(scan.ranges.size());
-  const Eigen::VectorXf x = scan.ranges.array() * scan.cos_map.array();
-  const Eigen::VectorXf y = scan.ranges.array() * scan.sin_map.array();
-  for (int i = 0; i < x.size(); ++i) {
-    cloud_out.points[i].x = x(i);
-    cloud_out.points[i].y = y(i);
-    cloud_out.points[i].z = 0;
-    cloud_out.points[i].intensity = scan.intensities[i];
-  }
+  cloud_out.resize(scan.size);
+  fill_cloud(scan, cloud_out);
   return cloud_out;
 }
 } // namespace pcl
@@ -0,0 +1,95 @@
+#include <sick-lms5xx/pool.hpp>
+#include <stdexcept>
+
+namespace sick {
+
+constexpr size_t ScanPool::MAX_SIZE;
+
+ScanPtr::ScanPtr(const ScanPtr &other)
+    : pool_(other.pool_), slot_(other.slot_) {
+  if (pool_) {
+    pool_->retain(slot_);
+  }
+}
+
+ScanPtr::ScanPtr(ScanPtr &&other) noexcept
+    : pool_(other.pool_), slot_(other.slot_) {
+  other.pool_ = nullptr;
+}
+
+ScanPtr &ScanPtr::operator=(const ScanPtr &other) {
+  if (this != &other) {
+    if (other.pool_) {
+      other.pool_->retain(other.slot_);
+    }
+    reset();
+    pool_ = other.pool_;
+    slot_ = other.slot_;
+  }
+  return *this;
+}
+
+ScanPtr &ScanPtr::operator=(ScanPtr &&other) noexcept {
+  if (this != &other) {
+    reset();
+    pool_ = other.pool_;
+    slot_ = other.slot_;
+    other.pool_ = nullptr;
+  }
+  return *this;
+}
+
+void ScanPtr::reset() {
+  if (pool_) {
+    pool_->release(slot_);
+    pool_ = nullptr;
+  }
+}
+
+const Scan *ScanPtr::get() const {
+  return pool_ ? &pool_->slots_[slot_] : nullptr;
+}
+
+ScanPool::ScanPool(size_t size)
+    : slots_(size), refcounts_(new std::atomic<uint32_t>[size]), free_(0),
+      exhausted_(0) {
+  if (size < 1 || size > MAX_SIZE) {
+    throw std::invalid_argument("ScanPool size must be in [1, 64].");
+  }
+  for (size_t i = 0; i < size; ++i) {
+    refcounts_[i].store(0);
+  }
+  free_.store(size == MAX_SIZE ? ~uint64_t(0) : (uint64_t(1) << size) - 1);
+}
+
+void ScanPool::retain(uint32_t slot) {
+  refcounts_[slot].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ScanPool::release(uint32_t slot) {
+  if (refcounts_[slot].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    free_.fetch_or(uint64_t(1) << slot, std::memory_order_release);
+  }
+}
+
+ScanPtr ScanPool::publish(Scan &scan) {
+  uint64_t free = free_.load(std::memory_order_acquire);
+  uint32_t slot;
+  do {
+    if (free == 0) {
+      exhausted_.fetch_add(1, std::memory_order_relaxed);
+      return ScanPtr();
+    }
+    slot = __builtin_ctzll(free);
+  } while (!free_.compare_exchange_weak(free, free & ~(uint64_t(1) << slot),
+                                        std::memory_order_acquire));
+  refcounts_[slot].store(1, std::memory_order_relaxed);
+  std::swap(slots_[slot], scan);
+  return ScanPtr(this, slot);
+}
+
+size_t ScanPool::available() const {
+  return __builtin_popcountll(free_.load(std::memory_order_relaxed));
+}
+
+} // namespace sick
@@ -0,0 +1,249 @@
+#include <cmath>
+#include <cstring>
+#include <sick-lms5xx/projection.hpp>
+#include <stdexcept>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace sick {
+
+void project_polar_scalar(const float *ranges, const float *cos_map,
+                          const float *sin_map, size_t n, float *x, float *y) {
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = ranges[i] * cos_map[i];
+    y[i] = ranges[i] * sin_map[i];
+  }
+}
+
+void project_polar(const float *ranges, const float *cos_map,
+                   const float *sin_map, size_t n, float *x, float *y) {
+  size_t i = 0;
+#if defined(__AVX__)
+  for (; i + 8 <= n; i += 8) {
+    const __m256 r = _mm256_loadu_ps(ranges + i);
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(r, _mm256_loadu_ps(cos_map + i)));
+    _mm256_storeu_ps(y + i, _mm256_mul_ps(r, _mm256_loadu_ps(sin_map + i)));
+  }
+#elif defined(__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    const __m128 r = _mm_loadu_ps(ranges + i);
+    _mm_storeu_ps(x + i, _mm_mul_ps(r, _mm_loadu_ps(cos_map + i)));
+    _mm_storeu_ps(y + i, _mm_mul_ps(r, _mm_loadu_ps(sin_map + i)));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t r = vld1q_f32(ranges + i);
+    vst1q_f32(x + i, vmulq_f32(r, vld1q_f32(cos_map + i)));
+    vst1q_f32(y + i, vmulq_f32(r, vld1q_f32(sin_map + i)));
+  }
+#endif
+  project_polar_scalar(ranges + i, cos_map + i, sin_map + i, n - i, x + i,
+                       y + i);
+}
+
+const char *projection_kernel() {
+#if defined(__AVX__)
+  return "avx";
+#elif defined(__SSE2__)
+  return "sse2";
+#elif defined(__ARM_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+/**
+ * @brief   Throw unless rays `[begin, begin + n)` of \p echo exist in \p scan
+ */
+static void check_rays(const Scan &scan, size_t begin, size_t n,
+                       unsigned int echo) {
+  if (!scan.angles || begin + n > scan.angles->size ||
+      begin + n > static_cast<size_t>(scan.ranges.cols()) ||
+      echo >= scan.ranges.rows()) {
+    throw std::out_of_range("Projected rays exceed the scan.");
+  }
+}
+
+void project_scan(const Scan &scan, size_t begin, size_t n, float *x,
+                  float *y, float *intensity, unsigned int echo) {
+  if (n == 0) {
+    return;
+  }
+  check_rays(scan, begin, n, echo);
+  project_polar(scan.ranges.row(echo).data() + begin,
+                scan.angles->cos_map.data() + begin,
+                scan.angles->sin_map.data() + begin, n, x, y);
+  if (intensity != nullptr) {
+    std::memcpy(intensity, scan.intensities.row(echo).data() + begin,
+                n * sizeof(float));
+  }
+}
+
+void project_scan(const Scan &scan, float *x, float *y, float *intensity,
+                  unsigned int echo) {
+  project_scan(scan, 0, scan.size, x, y, intensity, echo);
+}
+
+static double seconds(std::chrono::system_clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+PoseInterpolator::PoseInterpolator(
+    const Eigen::Isometry3f &begin,
+    std::chrono::system_clock::time_point begin_time,
+    const Eigen::Isometry3f &end,
+    std::chrono::system_clock::time_point end_time)
+    : begin_(begin), begin_time_(begin_time),
+      duration_s_(seconds(end_time - begin_time)) {
+  const Eigen::Isometry3f delta = begin.inverse() * end;
+  const Eigen::AngleAxisf rotation(delta.linear());
+  axis_ = rotation.axis();
+  angle_ = rotation.angle();
+  translation_ = delta.translation();
+}
+
+PoseInterpolator::PoseInterpolator(const Scan &scan,
+                                   const Eigen::Isometry3f &begin,
+                                   const Eigen::Isometry3f &end)
+    : PoseInterpolator(
+          begin, scan.time, end,
+          scan.time +
+              std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                  std::chrono::duration<float>(
+                      scan.time_offset(scan.size > 0 ? scan.size - 1 : 0)))) {
+}
+
+double PoseInterpolator::fraction(
+    std::chrono::system_clock::time_point time) const {
+  return seconds(time - begin_time_) * rate();
+}
+
+Eigen::Isometry3f
+PoseInterpolator::at(std::chrono::system_clock::time_point time) const {
+  const float u = static_cast<float>(fraction(time));
+  Eigen::Isometry3f delta = Eigen::Isometry3f::Identity();
+  delta.linear() = Eigen::AngleAxisf(u * angle_, axis_).toRotationMatrix();
+  delta.translation() = u * translation_;
+  return begin_ * delta;
+}
+
+/// Rays transformed at once by \ref deskew_scan()
+static constexpr int DESKEW_BLOCK = 8;
+using BlockF = Eigen::Array<float, DESKEW_BLOCK, 1>;
+using BlockD = Eigen::Array<double, DESKEW_BLOCK, 1>;
+
+/**
+ * @brief   Per-scan constants of \ref deskew_scan(). With the scanner
+ * rotating by angle `phi` about axis `a`, a point `v` in the scan plane maps
+ * to `Rb (cos(phi) (v - a a'v) + sin(phi) a x v + a a'v + u t) + tb`, linear
+ * in `v` for each of the three terms.
+ */
+struct DeskewTerms {
+  Eigen::Matrix<float, 3, 2> fixed;  ///< `Rb a a'`, part along the axis
+  Eigen::Matrix<float, 3, 2> cosine; ///< `Rb (I - a a')`, scaled by cos(phi)
+  Eigen::Matrix<float, 3, 2> sine;   ///< `Rb [a]x`, scaled by sin(phi)
+  Eigen::Vector3f translation;       ///< `Rb t`, scaled by u
+  Eigen::Vector3f origin;            ///< `tb`
+};
+
+/**
+ * @brief   Transform one block of rays
+ *
+ * @param terms Per-scan constants
+ * @param vx    x in the scan plane
+ * @param vy    y in the scan plane
+ * @param c Cosine of each ray's rotation angle
+ * @param s Sine of each ray's rotation angle
+ * @param u Fraction of the motion at each ray
+ * @param out   Output x, y and z
+ */
+static void deskew_block(const DeskewTerms &terms, const BlockF &vx,
+                         const BlockF &vy, const BlockF &c, const BlockF &s,
+                         const BlockF &u, float *const out[3]) {
+  for (int row = 0; row < 3; ++row) {
+    Eigen::Map<BlockF> coordinate(out[row]);
+    coordinate =
+        terms.fixed(row, 0) * vx + terms.fixed(row, 1) * vy +
+        c * (terms.cosine(row, 0) * vx + terms.cosine(row, 1) * vy) +
+        s * (terms.sine(row, 0) * vx + terms.sine(row, 1) * vy) +
+        u * terms.translation(row) + terms.origin(row);
+  }
+}
+
+void deskew_scan(const Scan &scan, const PoseInterpolator &motion, float *x,
+                 float *y, float *z, float *intensity, unsigned int echo) {
+  const size_t n = scan.size;
+  if (n == 0) {
+    return;
+  }
+  check_rays(scan, 0, n, echo);
+
+  const Eigen::Matrix3f rb = motion.begin().linear();
+  const Eigen::Vector3f &a = motion.axis();
+  const Eigen::Matrix3f along = a * a.transpose();
+  Eigen::Matrix3f cross;
+  cross << 0, -a.z(), a.y(), a.z(), 0, -a.x(), -a.y(), a.x(), 0;
+  DeskewTerms terms;
+  terms.fixed = (rb * along).leftCols<2>();
+  terms.cosine = (rb * (Eigen::Matrix3f::Identity() - along)).leftCols<2>();
+  terms.sine = (rb * cross).leftCols<2>();
+  terms.translation = rb * motion.translation();
+  terms.origin = motion.begin().translation();
+
+  // fraction of the motion at the first ray and per ray
+  const double u0 = motion.fraction(scan.time);
+  const double du = scan.time_increment * motion.rate();
+  const double angle = motion.angle();
+  const BlockD lanes = BlockD::LinSpaced(0, DESKEW_BLOCK - 1);
+  // fraction of the motion of each lane, advanced like the angle
+  BlockF u = (u0 + lanes * du).cast<float>();
+  const float step_u = static_cast<float>(DESKEW_BLOCK * du);
+  // rotation angle of each lane, advanced by a whole block per iteration
+  BlockD c = ((u0 + lanes * du) * angle).cos();
+  BlockD s = ((u0 + lanes * du) * angle).sin();
+  const double step_cos = std::cos(DESKEW_BLOCK * du * angle);
+  const double step_sin = std::sin(DESKEW_BLOCK * du * angle);
+
+  const float *ranges = scan.ranges.row(echo).data();
+  const float *cos_map = scan.angles->cos_map.data();
+  const float *sin_map = scan.angles->sin_map.data();
+  size_t i = 0;
+  for (; i + DESKEW_BLOCK <= n; i += DESKEW_BLOCK) {
+    const BlockF r = Eigen::Map<const BlockF>(ranges + i);
+    float *const out[3] = {x + i, y + i, z + i};
+    deskew_block(terms, r * Eigen::Map<const BlockF>(cos_map + i),
+                 r * Eigen::Map<const BlockF>(sin_map + i), c.cast<float>(),
+                 s.cast<float>(), u, out);
+    const BlockD next_c = c * step_cos - s * step_sin;
+    s = s * step_cos + c * step_sin;
+    c = next_c;
+    u += step_u;
+  }
+  if (i < n) {
+    // pad the remainder to a whole block
+    const size_t rest = n - i;
+    BlockF vx = BlockF::Zero();
+    BlockF vy = BlockF::Zero();
+    for (size_t k = 0; k < rest; ++k) {
+      vx(k) = ranges[i + k] * cos_map[i + k];
+      vy(k) = ranges[i + k] * sin_map[i + k];
+    }
+    BlockF px, py, pz;
+    float *const out[3] = {px.data(), py.data(), pz.data()};
+    deskew_block(terms, vx, vy, c.cast<float>(), s.cast<float>(), u, out);
+    std::memcpy(x + i, px.data(), rest * sizeof(float));
+    std::memcpy(y + i, py.data(), rest * sizeof(float));
+    std::memcpy(z + i, pz.data(), rest * sizeof(float));
+  }
+  if (intensity != nullptr) {
+    std::memcpy(intensity, scan.intensities.row(echo).data(),
+                n * sizeof(float));
+  }
+}
+
+} // namespace sick
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sick-lms5xx/recorder.hpp>
+#include <sick-lms5xx/types.hpp>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace sick {
+
+static constexpr char RECORDING_MAGIC[] = {'S', 'I', 'C', 'K',
+                                           'R', 'E', 'C', '1'};
+static constexpr char RECORDING_INDEX_MAGIC[] = {'S', 'I', 'C', 'K',
+                                                 'I', 'D', 'X', '1'};
+static constexpr uint32_t RECORDING_VERSION = 1;
+static constexpr auto WRITER_PERIOD =
+    std::chrono::milliseconds(10); ///< how often the writer drains the ring
+
+template <size_t N> static void write_le(char *data, uint64_t value) {
+  for (size_t i = 0; i < N; ++i) {
+    data[i] = static_cast<char>(value >> (8 * i));
+  }
+}
+
+template <size_t N>
+static void append_le(std::vector<char> &buffer, uint64_t value) {
+  const size_t size = buffer.size();
+  buffer.resize(size + N);
+  write_le<N>(buffer.data() + size, value);
+}
+
+/**
+ * @brief   Add an index entry for a record if the index interval has passed
+ * and the record contains the start of a telegram
+ */
+static void index_record(std::vector<RecordingIndexEntry> &index,
+                         uint64_t index_interval_ns, uint64_t timestamp_ns,
+                         uint64_t record_offset, const char *data,
+                         size_t len) {
+  if (!index.empty() &&
+      timestamp_ns < index.back().timestamp_ns + index_interval_ns) {
+    return;
+  }
+  const char *telegram =
+      static_cast<const char *>(std::memchr(data, STX, len));
+  if (telegram == nullptr) {
+    return;
+  }
+  index.push_back(RecordingIndexEntry{
+      timestamp_ns, record_offset,
+      record_offset + RECORD_HEADER_SIZE + (telegram - data)});
+}
+
+bool is_recording(const char *data, size_t len) {
+  return len >= RECORDING_HEADER_SIZE &&
+         std::memcmp(data, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) == 0 &&
+         read_le<4>(data + 8) == RECORDING_VERSION;
+}
+
+TelegramRecorder::TelegramRecorder(const std::string &path,
+                                   size_t buffer_size,
+                                   std::chrono::milliseconds index_interval)
+    : ring_capacity_([buffer_size] {
+        size_t capacity = 4096;
+        while (capacity < buffer_size) {
+          capacity *= 2;
+        }
+        return capacity;
+      }()),
+      ring_head_(0), ring_tail_(0),
+      index_interval_ns_(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(index_interval)
+              .count()),
+      file_offset_(0), stop_(false), failed_(false), recorded_(0),
+      dropped_(0) {
+  ring_.reset(new char[ring_capacity_]);
+  write_buffer_.reserve(ring_capacity_);
+
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error(std::string("Unable to open recording: ") +
+                             strerror(errno));
+  }
+  char header[RECORDING_HEADER_SIZE];
+  std::memcpy(header, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+  write_le<4>(header + 8, RECORDING_VERSION);
+  write_le<4>(header + 12, index_interval.count());
+  if (!write_fully(header, sizeof(header))) {
+    const int err = errno;
+    ::close(fd_);
+    throw std::runtime_error(std::string("Unable to write recording: ") +
+                             strerror(err));
+  }
+  file_offset_ = sizeof(header);
+
+  writer_ = std::thread([this] { write_loop(); });
+}
+
+bool TelegramRecorder::record(const char *data, size_t len) {
+  const uint64_t timestamp_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+  const uint64_t needed = RECORD_HEADER_SIZE + len;
+  const uint64_t head = ring_head_.load(std::memory_order_relaxed);
+  const uint64_t tail = ring_tail_.load(std::memory_order_acquire);
+  if (stop_.load(std::memory_order_relaxed) ||
+      failed_.load(std::memory_order_relaxed) || len > UINT32_MAX ||
+      needed > ring_capacity_ - (head - tail)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  char header[RECORD_HEADER_SIZE];
+  write_le<8>(header, timestamp_ns);
+  write_le<4>(header + 8, len);
+  const char *parts[] = {header, data};
+  const size_t part_sizes[] = {sizeof(header), len};
+  uint64_t pos = head;
+  for (size_t p = 0; p < 2; ++p) {
+    // copy in up to two pieces, around the end of the ring
+    const size_t begin = pos & (ring_capacity_ - 1);
+    const size_t first = std::min(part_sizes[p], ring_capacity_ - begin);
+    std::memcpy(ring_.get() + begin, parts[p], first);
+    std::memcpy(ring_.get(), parts[p] + first, part_sizes[p] - first);
+    pos += part_sizes[p];
+  }
+  ring_head_.store(pos, std::memory_order_release);
+  recorded_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool TelegramRecorder::drain() {
+  const uint64_t head = ring_head_.load(std::memory_order_acquire);
+  uint64_t tail = ring_tail_.load(std::memory_order_relaxed);
+  if (head == tail) {
+    return false;
+  }
+  // records are appended to the write buffer in one go, so afterwards each
+  // record is contiguous and can be searched for a telegram start
+  const size_t n_bytes = head - tail;
+  const size_t old_size = write_buffer_.size();
+  write_buffer_.resize(old_size + n_bytes);
+  const size_t begin = tail & (ring_capacity_ - 1);
+  const size_t first = std::min(n_bytes, ring_capacity_ - begin);
+  std::memcpy(write_buffer_.data() + old_size, ring_.get() + begin, first);
+  std::memcpy(write_buffer_.data() + old_size + first, ring_.get(),
+              n_bytes - first);
+  ring_tail_.store(head, std::memory_order_release);
+
+  size_t pos = old_size;
+  while (pos < write_buffer_.size()) {
+    const char *record = write_buffer_.data() + pos;
+    const uint64_t timestamp_ns = read_le<8>(record);
+    const size_t len = read_le<4>(record + 8);
+    index_record(index_, index_interval_ns_, timestamp_ns, file_offset_ + pos,
+                 record + RECORD_HEADER_SIZE, len);
+    pos += RECORD_HEADER_SIZE + len;
+  }
+  return true;
+}
+
+bool TelegramRecorder::write_fully(const char *data, size_t len) {
+  while (len > 0) {
+    const ssize_t written = write(fd_, data, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+void TelegramRecorder::write_loop() {
+  while (true) {
+    const bool stopping = stop_.load();
+    drain();
+    if (!write_buffer_.empty()) {
+      if (!failed_.load() &&
+          !write_fully(write_buffer_.data(), write_buffer_.size())) {
+        failed_.store(true);
+      }
+      file_offset_ += write_buffer_.size();
+      write_buffer_.clear();
+    }
+    if (stopping) {
+      return;
+    }
+    std::this_thread::sleep_for(WRITER_PERIOD);
+  }
+}
+
+bool TelegramRecorder::close() {
+  if (fd_ < 0) {
+    return !failed_.load();
+  }
+  stop_.store(true);
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+
+  std::vector<char> trailer;
+  trailer.reserve(index_.size() * RECORDING_INDEX_ENTRY_SIZE +
+                  RECORDING_FOOTER_SIZE);
+  for (const RecordingIndexEntry &entry : index_) {
+    append_le<8>(trailer, entry.timestamp_ns);
+    append_le<8>(trailer, entry.record_offset);
+    append_le<8>(trailer, entry.telegram_offset);
+  }
+  append_le<8>(trailer, file_offset_);
+  append_le<8>(trailer, index_.size());
+  trailer.insert(trailer.end(), RECORDING_INDEX_MAGIC,
+                 RECORDING_INDEX_MAGIC + sizeof(RECORDING_INDEX_MAGIC));
+  if (!failed_.load() && !write_fully(trailer.data(), trailer.size())) {
+    failed_.store(true);
+  }
+  if (::close(fd_) < 0) {
+    failed_.store(true);
+  }
+  fd_ = -1;
+  return !failed_.load();
+}
+
+TelegramRecorder::~TelegramRecorder() { close(); }
+
+RecordingReader::RecordingReader(const std::string &path)
+    : file_(std::fopen(path.c_str(), "rb")), index_rebuilt_(false),
+      data_end_(RECORDING_HEADER_SIZE), pos_(RECORDING_HEADER_SIZE),
+      skip_to_(0) {
+  if (file_ == nullptr) {
+    throw std::runtime_error(std::string("Unable to open recording: ") +
+                             strerror(errno));
+  }
+  char header[RECORDING_HEADER_SIZE];
+  if (!read_at(0, header, sizeof(header)) ||
+      !is_recording(header, sizeof(header))) {
+    std::fclose(file_);
+    throw std::runtime_error("Not a recording: " + path);
+  }
+  load_index(read_le<4>(header + 12) * 1000000);
+}
+
+bool RecordingReader::read_at(uint64_t offset, char *data, size_t len) {
+  return fseeko(file_, offset, SEEK_SET) == 0 &&
+         std::fread(data, 1, len, file_) == len;
+}
+
+void RecordingReader::load_index(uint64_t index_interval_ns) {
+  fseeko(file_, 0, SEEK_END);
+  const uint64_t file_size = ftello(file_);
+
+  char footer[RECORDING_FOOTER_SIZE];
+  if (file_size >= RECORDING_HEADER_SIZE + RECORDING_FOOTER_SIZE &&
+      read_at(file_size - RECORDING_FOOTER_SIZE, footer, sizeof(footer)) &&
+      std::memcmp(footer + 16, RECORDING_INDEX_MAGIC,
+                  sizeof(RECORDING_INDEX_MAGIC)) == 0) {
+    const uint64_t index_offset = read_le<8>(footer);
+    const uint64_t n_entries = read_le<8>(footer + 8);
+    std::vector<char> entries(n_entries * RECORDING_INDEX_ENTRY_SIZE);
+    if (index_offset >= RECORDING_HEADER_SIZE &&
+        index_offset + entries.size() + RECORDING_FOOTER_SIZE == file_size &&
+        read_at(index_offset, entries.data(), entries.size())) {
+      index_.resize(n_entries);
+      for (size_t i = 0; i < n_entries; ++i) {
+        const char *entry = entries.data() + i * RECORDING_INDEX_ENTRY_SIZE;
+        index_[i] = RecordingIndexEntry{read_le<8>(entry),
+                                        read_le<8>(entry + 8),
+                                        read_le<8>(entry + 16)};
+      }
+      data_end_ = index_offset;
+      return;
+    }
+  }
+
+  // not closed properly, walk the records and stop at a truncated one
+  index_rebuilt_ = true;
+  uint64_t offset = RECORDING_HEADER_SIZE;
+  char record_header[RECORD_HEADER_SIZE];
+  std::vector<char> data;
+  while (read_at(offset, record_header, sizeof(record_header))) {
+    const uint64_t timestamp_ns = read_le<8>(record_header);
+    const size_t len = read_le<4>(record_header + 8);
+    if (offset + RECORD_HEADER_SIZE + len > file_size) {
+      break;
+    }
+    // only read the data if it may be indexed
+    if (index_.empty() ||
+        timestamp_ns >= index_.back().timestamp_ns + index_interval_ns) {
+      data.resize(len);
+      if (!read_at(offset + RECORD_HEADER_SIZE, data.data(), len)) {
+        break;
+      }
+      index_record(index_, index_interval_ns, timestamp_ns, offset,
+                   data.data(), len);
+    }
+    offset += RECORD_HEADER_SIZE + len;
+  }
+  data_end_ = offset;
+}
+
+void RecordingReader::seek(uint64_t timestamp_ns) {
+  const auto it = std::upper_bound(
+      index_.begin(), index_.end(), timestamp_ns,
+      [](uint64_t t, const RecordingIndexEntry &entry) {
+        return t < entry.timestamp_ns;
+      });
+  if (it == index_.begin()) {
+    rewind();
+    return;
+  }
+  pos_ = std::prev(it)->record_offset;
+  skip_to_ = std::prev(it)->telegram_offset;
+}
+
+void RecordingReader::rewind() {
+  pos_ = RECORDING_HEADER_SIZE;
+  skip_to_ = 0;
+}
+
+bool RecordingReader::next(RecordedChunk &chunk) {
+  char record_header[RECORD_HEADER_SIZE];
+  if (pos_ + RECORD_HEADER_SIZE > data_end_ ||
+      !read_at(pos_, record_header, sizeof(record_header))) {
+    return false;
+  }
+  const uint64_t data_begin =
+      std::max<uint64_t>(pos_ + RECORD_HEADER_SIZE, skip_to_);
+  const uint64_t data_end =
+      pos_ + RECORD_HEADER_SIZE + read_le<4>(record_header + 8);
+  if (data_end > data_end_) {
+    return false;
+  }
+  chunk.timestamp_ns = read_le<8>(record_header);
+  chunk.data.resize(data_end - data_begin);
+  if (!read_at(data_begin, chunk.data.data(), chunk.data.size())) {
+    return false;
+  }
+  pos_ = data_end;
+  return true;
+}
+
+RecordingReader::~RecordingReader() { std::fclose(file_); }
+
+} // namespace sick
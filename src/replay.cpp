@@ -0,0 +1,147 @@
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sick-lms5xx/recorder.hpp>
+#include <sick-lms5xx/replay.hpp>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace sick {
+
+static constexpr size_t RAW_CHUNK_SIZE =
+    64 * 1024; ///< bytes of a raw capture passed to the batcher at once
+
+/**
+ * @brief   Check whether data begins with the CoLa-B magic bytes
+ */
+static bool starts_binary(const char *data, size_t len) {
+  return len >= 4 && data[0] == STX && data[1] == STX && data[2] == STX &&
+         data[3] == STX;
+}
+
+ReplaySource::ReplaySource(const std::string &path, const ScanCallback &fn)
+    : data_(nullptr), size_(0), recording_(false), binary_(false),
+      data_begin_(0), data_end_(0), callback_(fn), speed_(1.0),
+      start_data_ns_(0), started_(false) {
+  stop_.store(false);
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Unable to open replay file: ") +
+                             strerror(errno));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0) {
+    const int err = errno;
+    close(fd);
+    throw std::runtime_error(std::string("Unable to stat replay file: ") +
+                             strerror(err));
+  }
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    void *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      const int err = errno;
+      close(fd);
+      throw std::runtime_error(std::string("Unable to map replay file: ") +
+                               strerror(err));
+    }
+    data_ = static_cast<const char *>(mapped);
+    madvise(mapped, size_, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  recording_ = sick::is_recording(data_, size_);
+  if (recording_) {
+    // the reader takes care of the index and of truncated recordings
+    RecordingReader reader(path);
+    data_begin_ = reader.data_begin();
+    data_end_ = reader.data_end();
+    binary_ =
+        data_end_ >= data_begin_ + RECORD_HEADER_SIZE &&
+        starts_binary(data_ + data_begin_ + RECORD_HEADER_SIZE,
+                      data_end_ - data_begin_ - RECORD_HEADER_SIZE);
+  } else {
+    data_end_ = size_;
+    binary_ = starts_binary(data_, size_);
+  }
+}
+
+void ReplaySource::set_speed(double speed) { speed_ = speed; }
+
+void ReplaySource::pace(uint64_t data_ns) {
+  if (speed_ <= 0) {
+    return;
+  }
+  if (!started_) {
+    started_ = true;
+    start_wall_ = std::chrono::steady_clock::now();
+    start_data_ns_ = data_ns;
+    return;
+  }
+  if (data_ns <= start_data_ns_) {
+    return;
+  }
+  const auto offset = std::chrono::nanoseconds(
+      static_cast<int64_t>((data_ns - start_data_ns_) / speed_));
+  std::this_thread::sleep_until(start_wall_ + offset);
+}
+
+size_t ReplaySource::feed(const char *data, size_t len, const ScanSink &sink) {
+  if (binary_) {
+    return binary_batcher_.add_data(data, len, sink);
+  }
+  return batcher_.add_data(data, len, sink);
+}
+
+size_t ReplaySource::run() {
+  stop_.store(false);
+  started_ = false;
+  batcher_ = ScanBatcher();
+  binary_batcher_ = BinaryScanBatcher();
+
+  size_t n_scans = 0;
+  if (recording_) {
+    const ScanSink sink = [this](Scan &scan) { callback_(scan); };
+    uint64_t pos = data_begin_;
+    while (pos + RECORD_HEADER_SIZE <= data_end_ && !stop_.load()) {
+      const char *record = data_ + pos;
+      const size_t len = read_le<4>(record + 8);
+      pace(read_le<8>(record));
+      n_scans += feed(record + RECORD_HEADER_SIZE, len, sink);
+      pos += RECORD_HEADER_SIZE + len;
+    }
+  } else {
+    // raw captures have no receive times, so pace by the scan time stamps,
+    // or by the scanner clock if the telegrams have none
+    const ScanSink sink = [this](Scan &scan) {
+      if (scan.time_source == ScanTimeSource::None) {
+        pace(uint64_t{scan.time_since_boot_us} * 1000);
+      } else {
+        pace(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 scan.time.time_since_epoch())
+                 .count());
+      }
+      callback_(scan);
+    };
+    uint64_t pos = data_begin_;
+    while (pos < data_end_ && !stop_.load()) {
+      const size_t len = std::min<uint64_t>(RAW_CHUNK_SIZE, data_end_ - pos);
+      n_scans += feed(data_ + pos, len, sink);
+      pos += len;
+    }
+  }
+  return n_scans;
+}
+
+void ReplaySource::stop() { stop_.store(true); }
+
+ReplaySource::~ReplaySource() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+} // namespace sick
@@ -0,0 +1,163 @@
+#include <sick-lms5xx/ring.hpp>
+#include <stdexcept>
+#include <thread>
+
+namespace sick {
+
+// One slot is lent to the producer, one to the consumer, and one more covers
+// the moment in which the consumer has claimed a new slot but not yet returned
+// its previous one. With these, the free list is never empty when the
+// producer needs a slot.
+static constexpr size_t EXTRA_SLOTS = 3;
+
+/**
+ * @brief   Back off while waiting for the other side of the ring
+ */
+static void backoff(unsigned int &n_waits) {
+  if (n_waits < 64) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  ++n_waits;
+}
+
+ScanRing::ScanRing(size_t capacity, OverrunPolicy policy)
+    : capacity_(capacity), policy_(policy), slots_(capacity + EXTRA_SLOTS),
+      queue_(new std::atomic<uint32_t>[capacity]),
+      free_(new std::atomic<uint32_t>[capacity + EXTRA_SLOTS]), head_(0),
+      tail_(0), free_head_(0), free_tail_(0), producer_slot_(0),
+      consumer_slot_(0), consumer_has_slot_(false), closed_(false), pushed_(0),
+      popped_(0), overruns_(0), blocked_(0) {
+  if (capacity < 1) {
+    throw std::invalid_argument("ScanRing capacity must be at least 1.");
+  }
+  // slot 0 goes to the producer, all others are free
+  for (uint32_t i = 1; i < slots_.size(); ++i) {
+    free_[free_head_.load() % slots_.size()].store(i);
+    free_head_.store(free_head_.load() + 1);
+  }
+}
+
+uint32_t ScanRing::take_free_slot() {
+  unsigned int n_waits = 0;
+  while (free_tail_ == free_head_.load(std::memory_order_acquire)) {
+    // cannot happen with EXTRA_SLOTS, but better wait than corrupt the ring
+    backoff(n_waits);
+  }
+  const uint32_t slot =
+      free_[free_tail_ % slots_.size()].load(std::memory_order_relaxed);
+  ++free_tail_;
+  return slot;
+}
+
+bool ScanRing::push(Scan &scan) {
+  if (closed_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  std::swap(slots_[producer_slot_], scan);
+
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  bool waited = false;
+  unsigned int n_waits = 0;
+  while (true) {
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail < capacity_) {
+      break;
+    }
+    if (policy_ == OverrunPolicy::DropOldest) {
+      // reclaim the oldest slot unless the consumer takes it first
+      const uint32_t oldest =
+          queue_[tail % capacity_].load(std::memory_order_relaxed);
+      if (tail_.compare_exchange_strong(tail, tail + 1,
+                                        std::memory_order_acq_rel)) {
+        queue_[head % capacity_].store(producer_slot_,
+                                       std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+        producer_slot_ = oldest;
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    } else {
+      if (!waited) {
+        blocked_.fetch_add(1, std::memory_order_relaxed);
+        waited = true;
+      }
+      if (closed_.load(std::memory_order_relaxed)) {
+        // give the scan back so the caller's buffers stay intact
+        std::swap(slots_[producer_slot_], scan);
+        return false;
+      }
+      backoff(n_waits);
+    }
+  }
+
+  queue_[head % capacity_].store(producer_slot_, std::memory_order_relaxed);
+  head_.store(head + 1, std::memory_order_release);
+  producer_slot_ = take_free_slot();
+  pushed_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+const Scan *ScanRing::try_pop() {
+  uint64_t tail = tail_.load(std::memory_order_acquire);
+  uint32_t slot;
+  while (true) {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    if (tail == head) {
+      return nullptr;
+    }
+    slot = queue_[tail % capacity_].load(std::memory_order_relaxed);
+    // fails if the producer dropped this scan in the meantime, in which case
+    // tail is reloaded and we retry with the next one
+    if (tail_.compare_exchange_weak(tail, tail + 1,
+                                    std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+
+  if (consumer_has_slot_) {
+    const uint64_t free_head = free_head_.load(std::memory_order_relaxed);
+    free_[free_head % slots_.size()].store(consumer_slot_,
+                                           std::memory_order_relaxed);
+    free_head_.store(free_head + 1, std::memory_order_release);
+  }
+  consumer_slot_ = slot;
+  consumer_has_slot_ = true;
+  popped_.fetch_add(1, std::memory_order_relaxed);
+  return &slots_[slot];
+}
+
+const Scan *ScanRing::pop(std::chrono::microseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  unsigned int n_waits = 0;
+  while (true) {
+    const Scan *scan = try_pop();
+    if (scan != nullptr) {
+      return scan;
+    }
+    if (closed_.load(std::memory_order_relaxed) ||
+        std::chrono::steady_clock::now() >= deadline) {
+      return nullptr;
+    }
+    backoff(n_waits);
+  }
+}
+
+void ScanRing::close() { closed_.store(true); }
+
+size_t ScanRing::size() const {
+  const uint64_t tail = tail_.load(std::memory_order_acquire);
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  return head - tail;
+}
+
+ScanRingStats ScanRing::stats() const {
+  return ScanRingStats{pushed_.load(std::memory_order_relaxed),
+                       popped_.load(std::memory_order_relaxed),
+                       overruns_.load(std::memory_order_relaxed),
+                       blocked_.load(std::memory_order_relaxed)};
+}
+
+} // namespace sick
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sick-lms5xx/shm.hpp>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace sick {
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared memory sequence locks need lock-free 64 bit atomics");
+
+static constexpr uint32_t SHM_MAGIC = 0x534C4D53; ///< "SLMS"
+static constexpr uint32_t SHM_VERSION = 1;
+static constexpr size_t CACHE_LINE = 64;
+
+/**
+ * @brief   Start of the segment, followed by the slots
+ */
+struct ShmSegmentHeader {
+  uint32_t magic;        ///< \ref SHM_MAGIC once the segment is initialized
+  uint32_t version;      ///< layout version, \ref SHM_VERSION
+  uint32_t n_slots;      ///< number of slots in the ring
+  uint32_t max_rays;     ///< rays per echo a slot holds
+  uint64_t slot_size;    ///< bytes per slot, including the values
+  int32_t publisher_pid; ///< process of the publisher, to detect a crash
+  alignas(CACHE_LINE) std::atomic<uint64_t> published; ///< scans published
+  std::atomic<uint32_t> closed; ///< set when the publisher shuts down
+};
+
+/**
+ * @brief   Start of a slot, followed by the raw distances and remissions of
+ * MAX_ECHOES rows of \ref ShmSegmentHeader::max_rays values each
+ */
+struct ShmSlot {
+  std::atomic<uint64_t> sequence; ///< odd while the slot is written
+  uint64_t index;                 ///< publication number of the scan
+  uint32_t size;
+  uint32_t n_echoes;
+  double start_angle;   ///< of the angle table, LMS degrees
+  double ang_increment; ///< of the angle table, degrees
+  int64_t time_ns;
+  int64_t receive_time_ns;
+  uint32_t time_since_boot_us;
+  uint32_t time_of_transmission_us;
+  double scan_frequency;
+  double measurement_frequency;
+  float time_increment;
+  uint8_t time_source;
+  ChannelScaling range_scaling[MAX_ECHOES];
+  ChannelScaling intensity_scaling[MAX_ECHOES];
+};
+
+static size_t align_up(size_t n) {
+  return (n + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+static size_t header_size() { return align_up(sizeof(ShmSegmentHeader)); }
+
+static size_t slot_values_offset() { return align_up(sizeof(ShmSlot)); }
+
+static size_t slot_size(unsigned int max_rays) {
+  return align_up(slot_values_offset() +
+                  MAX_ECHOES * max_rays * (sizeof(uint16_t) + 1));
+}
+
+static int64_t to_ns(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+static std::chrono::system_clock::time_point from_ns(int64_t ns) {
+  return std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(ns)));
+}
+
+static uint16_t *slot_ranges(ShmSlot *slot) {
+  return reinterpret_cast<uint16_t *>(reinterpret_cast<char *>(slot) +
+                                      slot_values_offset());
+}
+
+static const uint16_t *slot_ranges(const ShmSlot *slot) {
+  return reinterpret_cast<const uint16_t *>(
+      reinterpret_cast<const char *>(slot) + slot_values_offset());
+}
+
+static uint8_t *slot_intensities(ShmSlot *slot, unsigned int max_rays) {
+  return reinterpret_cast<uint8_t *>(slot_ranges(slot) +
+                                     MAX_ECHOES * max_rays);
+}
+
+static const uint8_t *slot_intensities(const ShmSlot *slot,
+                                       unsigned int max_rays) {
+  return reinterpret_cast<const uint8_t *>(slot_ranges(slot) +
+                                           MAX_ECHOES * max_rays);
+}
+
+ShmScanView::ShmScanView()
+    : slot_(nullptr), ranges_(nullptr), intensities_(nullptr), max_rays_(0),
+      sequence_(0), index_(0) {}
+
+unsigned int ShmScanView::size() const {
+  return std::min<unsigned int>(slot_->size, max_rays_);
+}
+
+unsigned int ShmScanView::n_echoes() const {
+  return std::min<unsigned int>(slot_->n_echoes, MAX_ECHOES);
+}
+
+ChannelScaling ShmScanView::range_scaling(unsigned int echo) const {
+  return slot_->range_scaling[echo];
+}
+
+ChannelScaling ShmScanView::intensity_scaling(unsigned int echo) const {
+  return slot_->intensity_scaling[echo];
+}
+
+bool ShmScanView::valid() const {
+  // order the reads of the slot before the check
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot_ != nullptr &&
+         slot_->sequence.load(std::memory_order_relaxed) == sequence_;
+}
+
+bool ShmScanView::info(ScanInfo &info) const {
+  ShmSlot copy;
+  std::memcpy(static_cast<void *>(&copy), slot_, sizeof(copy));
+  if (!valid()) {
+    return false;
+  }
+  update_scan_angles(info, copy.size, copy.start_angle, copy.ang_increment,
+                     copy.n_echoes);
+  info.time = from_ns(copy.time_ns);
+  info.receive_time = from_ns(copy.receive_time_ns);
+  info.time_source = static_cast<ScanTimeSource>(copy.time_source);
+  info.time_since_boot_us = copy.time_since_boot_us;
+  info.time_of_transmission_us = copy.time_of_transmission_us;
+  info.scan_frequency = copy.scan_frequency;
+  info.measurement_frequency = copy.measurement_frequency;
+  info.time_increment = copy.time_increment;
+  for (unsigned int echo = 0;
+       echo < std::min<unsigned int>(copy.n_echoes, MAX_ECHOES); ++echo) {
+    info.range_scaling[echo] = copy.range_scaling[echo];
+    info.intensity_scaling[echo] = copy.intensity_scaling[echo];
+  }
+  return true;
+}
+
+/**
+ * @brief   Remove the segment \p name if it was left behind by a publisher
+ * which shut down or crashed. Segments of live publishers, and those which are
+ * not scan segments of this version, are kept.
+ */
+static void remove_stale_segment(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return;
+  }
+  bool stale = false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(ShmSegmentHeader)) {
+    void *base =
+        mmap(nullptr, sizeof(ShmSegmentHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED) {
+      const ShmSegmentHeader *header =
+          static_cast<const ShmSegmentHeader *>(base);
+      // EPERM means the process exists, but belongs to another user
+      stale = header->magic == SHM_MAGIC && header->version == SHM_VERSION &&
+              (header->closed.load(std::memory_order_acquire) != 0 ||
+               (kill(header->publisher_pid, 0) != 0 && errno == ESRCH));
+      munmap(base, sizeof(ShmSegmentHeader));
+    }
+  }
+  close(fd);
+  if (stale) {
+    shm_unlink(name.c_str());
+  }
+}
+
+ScanPublisher::ScanPublisher(const std::string &name, size_t n_slots,
+                             unsigned int max_rays)
+    : name_(name), base_(nullptr), size_(0), header_(nullptr),
+      published_(0) {
+  if (n_slots < 1 || max_rays < 1) {
+    throw std::invalid_argument(
+        "ScanPublisher needs at least one slot of one ray.");
+  }
+  // a live publisher's segment makes O_EXCL fail with EEXIST
+  remove_stale_segment(name);
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to create shared memory segment " +
+                             name + ": " + strerror(errno));
+  }
+  size_ = header_size() + n_slots * slot_size(max_rays);
+  if (ftruncate(fd, size_) != 0) {
+    const int err = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("Unable to size shared memory segment " + name +
+                             ": " + strerror(err));
+  }
+  base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int err = errno;
+  // the mapping keeps the segment alive
+  close(fd);
+  if (base_ == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::runtime_error("Unable to map shared memory segment " + name +
+                             ": " + strerror(err));
+  }
+  // the segment starts zeroed, so all slots are empty with sequence 0
+  header_ = new (base_) ShmSegmentHeader();
+  header_->version = SHM_VERSION;
+  header_->n_slots = static_cast<uint32_t>(n_slots);
+  header_->max_rays = max_rays;
+  header_->slot_size = slot_size(max_rays);
+  header_->publisher_pid = static_cast<int32_t>(getpid());
+  header_->published.store(0);
+  header_->closed.store(0);
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = SHM_MAGIC;
+}
+
+ScanPublisher::~ScanPublisher() {
+  header_->closed.store(1, std::memory_order_release);
+  munmap(base_, size_);
+  shm_unlink(name_.c_str());
+}
+
+ShmSlot *ScanPublisher::begin_write(const ScanInfo &info) {
+  if (info.size > header_->max_rays || info.n_echoes > MAX_ECHOES) {
+    return nullptr;
+  }
+  ShmSlot *slot = reinterpret_cast<ShmSlot *>(
+      static_cast<char *>(base_) + header_size() +
+      (published_ % header_->n_slots) * header_->slot_size);
+  const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  // readers which see the new data also see the odd sequence
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->index = published_;
+  slot->size = info.size;
+  slot->n_echoes = info.n_echoes;
+  slot->start_angle = info.angles ? info.angles->start_angle : 0;
+  slot->ang_increment = info.angles ? info.angles->ang_increment : 0;
+  slot->time_ns = to_ns(info.time);
+  slot->receive_time_ns = to_ns(info.receive_time);
+  slot->time_since_boot_us = info.time_since_boot_us;
+  slot->time_of_transmission_us = info.time_of_transmission_us;
+  slot->scan_frequency = info.scan_frequency;
+  slot->measurement_frequency = info.measurement_frequency;
+  slot->time_increment = info.time_increment;
+  slot->time_source = static_cast<uint8_t>(info.time_source);
+  return slot;
+}
+
+void ScanPublisher::end_write(ShmSlot *slot) {
+  slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+  ++published_;
+  header_->published.store(published_, std::memory_order_release);
+}
+
+bool ScanPublisher::publish(const Scan &scan) {
+  compact_scan(scan, compact_);
+  return publish(compact_);
+}
+
+bool ScanPublisher::publish(const CompactScan &scan) {
+  ShmSlot *slot = begin_write(scan);
+  if (slot == nullptr) {
+    return false;
+  }
+  const unsigned int max_rays = header_->max_rays;
+  uint16_t *ranges = slot_ranges(slot);
+  uint8_t *intensities = slot_intensities(slot, max_rays);
+  for (unsigned int echo = 0; echo < scan.n_echoes; ++echo) {
+    slot->range_scaling[echo] = scan.range_scaling[echo];
+    slot->intensity_scaling[echo] = scan.intensity_scaling[echo];
+    std::memcpy(ranges + echo * max_rays, scan.ranges.row(echo).data(),
+                scan.size * sizeof(uint16_t));
+    std::memcpy(intensities + echo * max_rays,
+                scan.intensities.row(echo).data(), scan.size);
+  }
+  end_write(slot);
+  return true;
+}
+
+ScanSubscriber::ScanSubscriber(const std::string &name)
+    : base_(nullptr), size_(0), header_(nullptr), next_(0), dropped_(0) {
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open shared memory segment " + name +
+                             ": " + strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    const int err = errno;
+    close(fd);
+    throw std::runtime_error("Unable to stat shared memory segment " + name +
+                             ": " + strerror(err));
+  }
+  size_ = st.st_size;
+  if (size_ < header_size()) {
+    close(fd);
+    throw std::runtime_error("Shared memory segment " + name +
+                             " is not a scan segment.");
+  }
+  void *base = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  const int err = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("Unable to map shared memory segment " + name +
+                             ": " + strerror(err));
+  }
+  base_ = base;
+  header_ = static_cast<const ShmSegmentHeader *>(base_);
+  const bool initialized = header_->magic == SHM_MAGIC;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!initialized || header_->version != SHM_VERSION ||
+      header_->n_slots < 1 ||
+      header_->slot_size != slot_size(header_->max_rays) ||
+      size_ < header_size() + header_->n_slots * header_->slot_size) {
+    munmap(base, size_);
+    throw std::runtime_error("Shared memory segment " + name +
+                             " is not a scan segment of this version.");
+  }
+  next_ = header_->published.load(std::memory_order_acquire);
+}
+
+ScanSubscriber::~ScanSubscriber() {
+  munmap(const_cast<void *>(base_), size_);
+}
+
+const ShmSlot *ScanSubscriber::slot(uint64_t index) const {
+  return reinterpret_cast<const ShmSlot *>(
+      static_cast<const char *>(base_) + header_size() +
+      (index % header_->n_slots) * header_->slot_size);
+}
+
+bool ScanSubscriber::next(ShmScanView &view) {
+  const uint64_t published =
+      header_->published.load(std::memory_order_acquire);
+  const uint64_t n_slots = header_->n_slots;
+  if (published - next_ > n_slots) {
+    // the publisher lapped this subscriber
+    dropped_ += published - n_slots - next_;
+    next_ = published - n_slots;
+  }
+  for (; next_ < published; ++next_) {
+    const ShmSlot *s = slot(next_);
+    const uint64_t sequence = s->sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0 || s->index != next_) {
+      // overwritten since published was read
+      ++dropped_;
+      continue;
+    }
+    view.slot_ = s;
+    view.ranges_ = slot_ranges(s);
+    view.max_rays_ = header_->max_rays;
+    view.intensities_ = slot_intensities(s, view.max_rays_);
+    view.sequence_ = sequence;
+    view.index_ = next_;
+    ++next_;
+    return true;
+  }
+  return false;
+}
+
+bool ScanSubscriber::read(CompactScan &scan) {
+  ShmScanView view;
+  while (next(view)) {
+    if (!view.info(scan)) {
+      ++dropped_;
+      continue;
+    }
+    scan.ranges.resize(scan.n_echoes, scan.size);
+    scan.intensities.resize(scan.n_echoes, scan.size);
+    for (unsigned int echo = 0; echo < scan.n_echoes; ++echo) {
+      std::memcpy(scan.ranges.row(echo).data(), view.ranges(echo),
+                  scan.size * sizeof(uint16_t));
+      std::memcpy(scan.intensities.row(echo).data(), view.intensities(echo),
+                  scan.size);
+    }
+    if (view.valid()) {
+      return true;
+    }
+    ++dropped_;
+  }
+  return false;
+}
+
+bool ScanSubscriber::available() const {
+  return header_->published.load(std::memory_order_acquire) != next_;
+}
+
+bool ScanSubscriber::closed() const {
+  return header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool ScanSubscriber::wait(std::chrono::microseconds timeout) const {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (unsigned int n_waits = 0; !available(); ++n_waits) {
+    if (closed() || std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    if (n_waits < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+  return true;
+}
+
+} // namespace sick
@@ -0,0 +1,297 @@
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <sick-lms5xx/binary.hpp>
+#include <sick-lms5xx/simulation.hpp>
+#include <sick-lms5xx/types.hpp>
+
+namespace sick {
+
+static constexpr uint32_t SIMULATED_SERIAL = 0x89A27F;
+
+SimulationConfig::SimulationConfig() : SimulationConfig(25, 0.1667) {}
+
+SimulationConfig::SimulationConfig(hz frequency, deg resolution,
+                                   deg start_angle, deg end_angle)
+    : frequency(frequency), resolution(resolution), start_angle(start_angle),
+      n_points(static_cast<unsigned int>(
+                   std::round((end_angle - start_angle) / resolution)) +
+               1),
+      time_block(true), n_echoes(1) {}
+
+deg SimulationConfig::end_angle() const {
+  return start_angle + (n_points - 1) * resolution;
+}
+
+/**
+ * @brief   Range in mm of ray \p i: a room outline which slowly rotates with
+ * the scan counter
+ */
+static uint16_t synthetic_range(const SimulationConfig &config, unsigned int i,
+                                uint16_t counter) {
+  const double angle = (config.start_angle + i * config.resolution) * DEG2RAD;
+  return static_cast<uint16_t>(4000 + 1500 * std::sin(3 * angle) +
+                               500 * std::sin(angle + counter * 0.01));
+}
+
+/**
+ * @brief   Range in mm of echo \p echo of ray \p i: later echoes come from
+ * behind the outline, as if it were a fence or foliage
+ */
+static uint16_t synthetic_range(const SimulationConfig &config, unsigned int i,
+                                uint16_t counter, unsigned int echo) {
+  return static_cast<uint16_t>(synthetic_range(config, i, counter) +
+                               echo * (250 + i % 200));
+}
+
+/**
+ * @brief   Measurement frequency field in units of 100 Hz: shots per second
+ * over the whole mirror revolution, not only the reported field of view
+ */
+static uint32_t measurement_frequency(const SimulationConfig &config) {
+  return static_cast<uint32_t>(
+      std::round(config.frequency * 360 / config.resolution / 100));
+}
+
+static uint8_t synthetic_intensity(unsigned int i, uint16_t counter,
+                                   unsigned int echo) {
+  return static_cast<uint8_t>((60 + (i * 7 + counter) % 150) >> echo);
+}
+
+/**
+ * @brief   Channel name of echo \p echo, e.g. `DIST2`
+ */
+static std::string channel_name(const char *content, unsigned int echo) {
+  return content + std::to_string(echo + 1);
+}
+
+/**
+ * @brief   Calendar fields of the time block
+ */
+struct TimeFields {
+  unsigned int year, month, day, hour, minute, second;
+  uint32_t us;
+};
+
+static TimeFields time_fields(std::chrono::system_clock::time_point time) {
+  const std::time_t t = std::chrono::system_clock::to_time_t(time);
+  struct tm tm;
+  localtime_r(&t, &tm);
+  const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      time.time_since_epoch())
+                      .count() %
+                  1000000;
+  return TimeFields{static_cast<unsigned int>(tm.tm_year + 1900),
+                    static_cast<unsigned int>(tm.tm_mon + 1),
+                    static_cast<unsigned int>(tm.tm_mday),
+                    static_cast<unsigned int>(tm.tm_hour),
+                    static_cast<unsigned int>(tm.tm_min),
+                    static_cast<unsigned int>(tm.tm_sec),
+                    static_cast<uint32_t>(us < 0 ? us + 1000000 : us)};
+}
+
+/**
+ * @brief   Append a space and \p value as upper case hex without leading zeros
+ */
+static void append_hex(std::vector<char> &out, uint32_t value) {
+  static constexpr char digits[] = "0123456789ABCDEF";
+  char tmp[8];
+  size_t n = 0;
+  do {
+    tmp[n++] = digits[value & 0xF];
+    value >>= 4;
+  } while (value != 0);
+  out.push_back(' ');
+  while (n > 0) {
+    out.push_back(tmp[--n]);
+  }
+}
+
+static void append_token(std::vector<char> &out, const char *token) {
+  out.push_back(' ');
+  while (*token != '\0') {
+    out.push_back(*token++);
+  }
+}
+
+void synthesize_scan_ascii(const SimulationConfig &config, uint16_t counter,
+                           std::chrono::system_clock::time_point time,
+                           std::vector<char> &telegram) {
+  const uint32_t start = static_cast<int32_t>(std::round(
+      config.start_angle * 10000)); // two's complement for negative angles
+  const uint32_t increment =
+      static_cast<uint32_t>(std::round(config.resolution * 10000));
+  const uint32_t time_us = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          time.time_since_epoch())
+          .count());
+
+  telegram.clear();
+  telegram.push_back(STX);
+  static constexpr char prefix[] = "sSN LMDscandata 1 1";
+  telegram.insert(telegram.end(), prefix, prefix + sizeof(prefix) - 1);
+  append_hex(telegram, SIMULATED_SERIAL);
+  // device status
+  append_hex(telegram, 0);
+  append_hex(telegram, 0);
+  // telegram and scan counter, time since boot and of transmission
+  append_hex(telegram, counter);
+  append_hex(telegram, counter);
+  append_hex(telegram, time_us);
+  append_hex(telegram, time_us);
+  // inputs, outputs, layer angle
+  for (int i = 0; i < 5; ++i) {
+    append_hex(telegram, 0);
+  }
+  append_hex(telegram, static_cast<uint32_t>(config.frequency * 100));
+  append_hex(telegram, measurement_frequency(config));
+  // no encoders, one 16 bit channel per echo
+  append_hex(telegram, 0);
+  append_hex(telegram, config.n_echoes);
+  for (unsigned int echo = 0; echo < config.n_echoes; ++echo) {
+    append_token(telegram, channel_name("DIST", echo).c_str());
+    append_token(telegram, "3F800000 00000000");
+    append_hex(telegram, start);
+    append_hex(telegram, increment);
+    append_hex(telegram, config.n_points);
+    for (unsigned int i = 0; i < config.n_points; ++i) {
+      append_hex(telegram, synthetic_range(config, i, counter, echo));
+    }
+  }
+  // one 8 bit channel per echo
+  append_hex(telegram, config.n_echoes);
+  for (unsigned int echo = 0; echo < config.n_echoes; ++echo) {
+    append_token(telegram, channel_name("RSSI", echo).c_str());
+    append_token(telegram, "3F800000 00000000");
+    append_hex(telegram, start);
+    append_hex(telegram, increment);
+    append_hex(telegram, config.n_points);
+    for (unsigned int i = 0; i < config.n_points; ++i) {
+      append_hex(telegram, synthetic_intensity(i, counter, echo));
+    }
+  }
+  // no position, name, comment
+  append_hex(telegram, 0);
+  append_hex(telegram, 0);
+  append_hex(telegram, 0);
+  if (config.time_block) {
+    const TimeFields t = time_fields(time);
+    append_hex(telegram, 1);
+    append_hex(telegram, t.year);
+    append_hex(telegram, t.month);
+    append_hex(telegram, t.day);
+    append_hex(telegram, t.hour);
+    append_hex(telegram, t.minute);
+    append_hex(telegram, t.second);
+    append_hex(telegram, t.us);
+  } else {
+    append_hex(telegram, 0);
+  }
+  // no events
+  append_hex(telegram, 0);
+  telegram.push_back(ETX);
+}
+
+template <size_t N>
+static void append_be(std::vector<char> &out, uint32_t value) {
+  for (size_t i = 0; i < N; ++i) {
+    out.push_back(static_cast<char>(value >> (8 * (N - 1 - i))));
+  }
+}
+
+static void append_bytes(std::vector<char> &out, const char *data,
+                         size_t len) {
+  out.insert(out.end(), data, data + len);
+}
+
+void synthesize_scan_binary(const SimulationConfig &config, uint16_t counter,
+                            std::chrono::system_clock::time_point time,
+                            std::vector<char> &telegram) {
+  const uint32_t start =
+      static_cast<int32_t>(std::round(config.start_angle * 10000));
+  const uint32_t increment =
+      static_cast<uint32_t>(std::round(config.resolution * 10000));
+  const uint32_t time_us = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          time.time_since_epoch())
+          .count());
+  static constexpr char one_float[] = {'\x3F', '\x80', '\x00', '\x00'};
+  static constexpr char zero_float[] = {0, 0, 0, 0};
+
+  telegram.clear();
+  // magic and length, filled in below
+  telegram.resize(COLA_B_HEADER_SIZE, STX);
+  static constexpr char prefix[] = "sSN LMDscandata ";
+  append_bytes(telegram, prefix, sizeof(prefix) - 1);
+  // version, device number, serial, device status
+  append_be<2>(telegram, 1);
+  append_be<2>(telegram, 1);
+  append_be<4>(telegram, SIMULATED_SERIAL);
+  append_be<2>(telegram, 0);
+  // telegram and scan counter, time since boot and of transmission
+  append_be<2>(telegram, counter);
+  append_be<2>(telegram, counter);
+  append_be<4>(telegram, time_us);
+  append_be<4>(telegram, time_us);
+  // inputs, outputs, layer angle
+  append_be<2>(telegram, 0);
+  append_be<2>(telegram, 0);
+  append_be<2>(telegram, 0);
+  append_be<4>(telegram, static_cast<uint32_t>(config.frequency * 100));
+  append_be<4>(telegram, measurement_frequency(config));
+  // no encoders, one 16 bit channel per echo
+  append_be<2>(telegram, 0);
+  append_be<2>(telegram, config.n_echoes);
+  for (unsigned int echo = 0; echo < config.n_echoes; ++echo) {
+    append_bytes(telegram, channel_name("DIST", echo).c_str(), 5);
+    append_bytes(telegram, one_float, 4);
+    append_bytes(telegram, zero_float, 4);
+    append_be<4>(telegram, start);
+    append_be<2>(telegram, increment);
+    append_be<2>(telegram, config.n_points);
+    for (unsigned int i = 0; i < config.n_points; ++i) {
+      append_be<2>(telegram, synthetic_range(config, i, counter, echo));
+    }
+  }
+  // one 8 bit channel per echo
+  append_be<2>(telegram, config.n_echoes);
+  for (unsigned int echo = 0; echo < config.n_echoes; ++echo) {
+    append_bytes(telegram, channel_name("RSSI", echo).c_str(), 5);
+    append_bytes(telegram, one_float, 4);
+    append_bytes(telegram, zero_float, 4);
+    append_be<4>(telegram, start);
+    append_be<2>(telegram, increment);
+    append_be<2>(telegram, config.n_points);
+    for (unsigned int i = 0; i < config.n_points; ++i) {
+      append_be<1>(telegram, synthetic_intensity(i, counter, echo));
+    }
+  }
+  // no position, name, comment
+  append_be<2>(telegram, 0);
+  append_be<2>(telegram, 0);
+  append_be<2>(telegram, 0);
+  if (config.time_block) {
+    const TimeFields t = time_fields(time);
+    append_be<2>(telegram, 1);
+    append_be<2>(telegram, t.year);
+    append_be<1>(telegram, t.month);
+    append_be<1>(telegram, t.day);
+    append_be<1>(telegram, t.hour);
+    append_be<1>(telegram, t.minute);
+    append_be<1>(telegram, t.second);
+    append_be<4>(telegram, t.us);
+  } else {
+    append_be<2>(telegram, 0);
+  }
+  // no events
+  append_be<2>(telegram, 0);
+
+  const size_t payload_len = telegram.size() - COLA_B_HEADER_SIZE;
+  for (size_t i = 0; i < 4; ++i) {
+    telegram[4 + i] = static_cast<char>(payload_len >> (8 * (3 - i)));
+  }
+  telegram.push_back(static_cast<char>(
+      cola_b_checksum(telegram.data() + COLA_B_HEADER_SIZE, payload_len)));
+}
+
+} // namespace sick
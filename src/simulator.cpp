@@ -0,0 +1,467 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <random>
+#include <signal.h>
+#include <string>
+#include <sys/select.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <sick-lms5xx/binary.hpp>
+#include <sick-lms5xx/network.hpp>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/simulation.hpp>
+#include <sick-lms5xx/types.hpp>
+
+// Simulates LMS5xx scanners on localhost. Each scanner answers the SOPAS
+// commands used by this library on an ASCII and a binary port and streams
+// synthetic scan telegrams once LMDscandata is enabled. Scanner i listens on
+// the i-th address after --ip, since all of 127.0.0.0/8 is local.
+
+using namespace std;
+using namespace sick;
+
+static atomic<bool> running;
+
+/**
+ * @brief   Command line options
+ */
+struct Options {
+  string ip = "127.0.0.1";   ///< address of the first scanner
+  unsigned int n_scanners = 1; ///< number of scanners
+  uint16_t port = 2111;      ///< ASCII port, binary is on the next port
+  SimulationConfig scan;     ///< scan geometry and rate
+  unsigned int jitter_us = 0; ///< maximum deviation of the send time
+  size_t fragment = 0;        ///< maximum bytes per send(), 0 for no limit
+};
+
+/**
+ * @brief   One client connection to a simulated scanner
+ */
+class Session {
+  const int fd_;
+  const bool binary_;
+  const Options &options_;
+  SimulationConfig scan_; ///< current scan config, changed by commands
+  bool streaming_;        ///< whether LMDscandata is enabled
+  uint16_t counter_;      ///< scan counter
+  vector<char> input_;    ///< received bytes not yet processed
+  vector<char> telegram_; ///< scratch buffer for outgoing telegrams
+  mt19937 rng_;
+
+  bool send_all(const char *data, size_t len) {
+    while (len > 0) {
+      const ssize_t sent = send(fd_, data, len, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += sent;
+      len -= sent;
+    }
+    return true;
+  }
+
+  bool send_fragmented(const char *data, size_t len) {
+    const size_t fragment = options_.fragment > 0 ? options_.fragment : len;
+    for (size_t begin = 0; begin < len; begin += fragment) {
+      if (!send_all(data + begin, min(fragment, len - begin))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Send a reply. \p status < 0 omits the status value.
+   */
+  bool reply(const string &method, const string &name, int status,
+             const string &ascii_args = "") {
+    if (binary_) {
+      BinaryCommand answer((method + " " + name).c_str());
+      if (status >= 0) {
+        answer.u8(status);
+      }
+      const char *data = answer.data();
+      return send_all(data, answer.size());
+    }
+    string answer = STX + method + " " + name;
+    if (status >= 0) {
+      answer += " " + to_string(status);
+    }
+    answer += ascii_args + ETX;
+    return send_all(answer.data(), answer.size());
+  }
+
+  void set_scan_config(hz frequency, unsigned int resolution, int start,
+                       int end) {
+    if (resolution > 0 && end > start) {
+      SimulationConfig scan(frequency > 0 ? frequency : scan_.frequency,
+                            resolution / 10000.0, start / 10000.0,
+                            end / 10000.0);
+      scan.time_block = scan_.time_block;
+      scan.n_echoes = scan_.n_echoes;
+      scan_ = scan;
+    }
+  }
+
+  /**
+   * @brief Apply an echo filter: all echoes are sent in as many channels as
+   * configured on the command line, first or last echo in one channel
+   */
+  void set_echo_filter(int filter) {
+    scan_.n_echoes = filter == 1 ? options_.scan.n_echoes : 1;
+  }
+
+  /**
+   * @brief Handle a command telegram, STX to ETX or a CoLa-B frame
+   */
+  bool handle(const char *telegram, size_t len) {
+    // method and name are text in both flavours, arguments are not
+    const char *payload = telegram + (binary_ ? COLA_B_HEADER_SIZE : 1);
+    const char *end = telegram + len - 1;
+    const char *name = static_cast<const char *>(
+        memchr(payload, ' ', end - payload));
+    if (name == nullptr) {
+      return reply("sFA", "", -1);
+    }
+    ++name;
+    const char *name_end =
+        static_cast<const char *>(memchr(name, ' ', end - name));
+    if (name_end == nullptr) {
+      name_end = end;
+    }
+    const string method(payload, name - 1);
+    const string cmd(name, name_end);
+    const char *args = name_end < end ? name_end + 1 : end;
+
+    if (method == "sMN" && cmd == "mLMPsetscancfg") {
+      if (binary_ && end - args >= 18) {
+        set_scan_config(read_be<4>(args) / 100.0, read_be<4>(args + 6),
+                        static_cast<int32_t>(read_be<4>(args + 10)),
+                        static_cast<int32_t>(read_be<4>(args + 14)));
+      } else if (!binary_) {
+        unsigned int frequency = 0, resolution = 0;
+        int sectors = 0, start = 0, stop = 0;
+        if (sscanf(args, "%u %d %u %d %d", &frequency, &sectors, &resolution,
+                   &start, &stop) == 5) {
+          set_scan_config(frequency / 100.0, resolution, start, stop);
+        }
+      }
+      return reply("sAN", cmd, 0);
+    }
+    if (method == "sMN" && (cmd == "LMCstartmeas" || cmd == "LMCstopmeas")) {
+      return reply("sAN", cmd, 0);
+    }
+    if (method == "sMN" && cmd == "mSCreboot") {
+      streaming_ = false;
+      return reply("sAN", cmd, -1);
+    }
+    if (method == "sMN") {
+      // SetAccessMode, Run, mEEwriteall
+      return reply("sAN", cmd, 1);
+    }
+    if (method == "sWN" && cmd == "FREchoFilter" && args < end) {
+      set_echo_filter(binary_ ? *args : *args - '0');
+      return reply("sWA", cmd, -1);
+    }
+    if (method == "sWN") {
+      return reply("sWA", cmd, -1);
+    }
+    if (method == "sRN" && cmd == "LMPoutputRange") {
+      char args_out[64];
+      snprintf(args_out, sizeof(args_out), " %X %X %X",
+               static_cast<unsigned int>(std::round(scan_.resolution * 10000)),
+               static_cast<unsigned int>(
+                   static_cast<int>(std::round(scan_.start_angle * 10000))),
+               static_cast<unsigned int>(
+                   static_cast<int>(std::round(scan_.end_angle() * 10000))));
+      return reply("sRA", cmd, 1, args_out);
+    }
+    if (method == "sEN" && cmd == "LMDscandata") {
+      streaming_ = binary_ ? (args < end && *args == 1)
+                           : (args < end && *args == '1');
+      return reply("sEA", cmd, streaming_ ? 1 : 0);
+    }
+    // unknown command
+    const uint8_t error =
+        static_cast<uint8_t>(sick_err_t::Sopas_Error_UNKNOWN_COLA_COMMAND);
+    if (binary_) {
+      BinaryCommand answer("sFA");
+      answer.u8(error);
+      const char *data = answer.data();
+      return send_all(data, answer.size());
+    }
+    char answer[16];
+    const int answer_len =
+        snprintf(answer, sizeof(answer), "%csFA %X%c", STX, error, ETX);
+    return send_all(answer, answer_len);
+  }
+
+  /**
+   * @brief Handle all complete commands in \ref input_
+   */
+  bool handle_input() {
+    size_t begin = 0;
+    while (begin < input_.size()) {
+      size_t telegram_len;
+      if (binary_) {
+        if (!next_cola_b_frame(input_.data(), input_.size(), begin,
+                               telegram_len)) {
+          break;
+        }
+      } else {
+        const char *stx = static_cast<const char *>(
+            memchr(input_.data() + begin, STX, input_.size() - begin));
+        if (stx == nullptr) {
+          begin = input_.size();
+          break;
+        }
+        begin = stx - input_.data();
+        const char *etx = static_cast<const char *>(
+            memchr(stx, ETX, input_.size() - begin));
+        if (etx == nullptr) {
+          break;
+        }
+        telegram_len = etx - stx + 1;
+      }
+      if (!handle(input_.data() + begin, telegram_len)) {
+        return false;
+      }
+      begin += telegram_len;
+    }
+    input_.erase(input_.begin(), input_.begin() + begin);
+    return true;
+  }
+
+  bool send_scan() {
+    const auto now = chrono::system_clock::now();
+    if (binary_) {
+      synthesize_scan_binary(scan_, counter_, now, telegram_);
+    } else {
+      synthesize_scan_ascii(scan_, counter_, now, telegram_);
+    }
+    ++counter_;
+    return send_fragmented(telegram_.data(), telegram_.size());
+  }
+
+public:
+  Session(int fd, bool binary, const Options &options, unsigned int seed)
+      : fd_(fd), binary_(binary), options_(options), scan_(options.scan),
+        streaming_(false), counter_(0), rng_(seed) {}
+
+  void run() {
+    // fragments should arrive as separate segments
+    const int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    uniform_int_distribution<int> jitter(-static_cast<int>(options_.jitter_us),
+                                         options_.jitter_us);
+    auto schedule = chrono::steady_clock::now();
+    auto due = schedule;
+    vector<char> buffer(4096);
+    while (running.load()) {
+      const auto now = chrono::steady_clock::now();
+      if (streaming_ && now >= due) {
+        if (!send_scan()) {
+          return;
+        }
+        // jitter does not accumulate, the schedule stays periodic
+        schedule += chrono::microseconds(
+            static_cast<int64_t>(1e6 / scan_.frequency));
+        if (schedule < now) {
+          schedule = now;
+        }
+        due = schedule + chrono::microseconds(jitter(rng_));
+        continue;
+      }
+      auto wait = chrono::microseconds(100000);
+      if (streaming_) {
+        wait =
+            min(wait, chrono::duration_cast<chrono::microseconds>(due - now));
+      }
+      fd_set fds;
+      FD_ZERO(&fds);
+      FD_SET(fd_, &fds);
+      struct timeval timeout {
+        .tv_sec = 0, .tv_usec = static_cast<suseconds_t>(wait.count())
+      };
+      const int ready = select(fd_ + 1, &fds, nullptr, nullptr, &timeout);
+      if (ready < 0 && errno != EINTR) {
+        return;
+      }
+      if (ready > 0) {
+        const ssize_t n = recv(fd_, buffer.data(), buffer.size(), 0);
+        if (n <= 0) {
+          return;
+        }
+        const bool was_streaming = streaming_;
+        input_.insert(input_.end(), buffer.data(), buffer.data() + n);
+        if (!handle_input()) {
+          return;
+        }
+        if (streaming_ && !was_streaming) {
+          // like the scanner, reply first and send the first scan later
+          schedule = chrono::steady_clock::now() +
+                     chrono::microseconds(
+                         static_cast<int64_t>(1e6 / scan_.frequency));
+          due = schedule;
+        }
+      }
+    }
+  }
+};
+
+/**
+ * @brief   Accept connections on one port of one simulated scanner
+ */
+static void serve(uint32_t ip, uint16_t port, bool binary,
+                  const Options &options) {
+  const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  const int one = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = ip;
+  if (bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) < 0 ||
+      listen(listen_fd, 4) < 0) {
+    char ip_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip_str, sizeof(ip_str));
+    cerr << "Unable to listen on " << ip_str << ":" << port << ": "
+         << strerror(errno) << endl;
+    close(listen_fd);
+    running.store(false);
+    return;
+  }
+  vector<thread> sessions;
+  unsigned int n_sessions = 0;
+  while (running.load()) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(listen_fd, &fds);
+    struct timeval timeout {
+      .tv_sec = 0, .tv_usec = 100000
+    };
+    if (select(listen_fd + 1, &fds, nullptr, nullptr, &timeout) <= 0) {
+      continue;
+    }
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    const unsigned int seed = ntohl(ip) ^ (port << 16) ^ n_sessions++;
+    sessions.emplace_back([fd, binary, &options, seed] {
+      Session session(fd, binary, options, seed);
+      session.run();
+      close(fd);
+    });
+  }
+  for (auto &session : sessions) {
+    session.join();
+  }
+  close(listen_fd);
+}
+
+static void usage(const char *name) {
+  cerr << "Usage: " << name << " [options]\n"
+       << "  --ip IP           address of the first scanner (127.0.0.1)\n"
+       << "  --scanners N      number of scanners on consecutive addresses "
+          "(1)\n"
+       << "  --port PORT       ASCII port, binary is on PORT+1 (2111)\n"
+       << "  --frequency HZ    scan frequency (25)\n"
+       << "  --resolution DEG  angular resolution (0.1667)\n"
+       << "  --points N        number of rays (whole 190 degree field of "
+          "view)\n"
+       << "  --jitter US       maximum random deviation of send times (0)\n"
+       << "  --fragment BYTES  maximum bytes per send (0, unlimited)\n"
+       << "  --time-block 0|1  send the date/time block, as with NTP (1)\n"
+       << "  --echoes N        echoes per ray, 1 to 5, until an echo filter "
+          "is set (1)\n";
+}
+
+static void on_signal(int) { running.store(false); }
+
+int main(int argc, char **argv) {
+  Options options;
+  hz frequency = 25;
+  deg resolution = 0.1667;
+  unsigned int n_points = 0;
+  bool time_block = true;
+  unsigned int n_echoes = 1;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+    const char *value = argv[++i];
+    if (arg == "--ip") {
+      options.ip = value;
+    } else if (arg == "--scanners") {
+      options.n_scanners = atoi(value);
+    } else if (arg == "--port") {
+      options.port = atoi(value);
+    } else if (arg == "--frequency") {
+      frequency = atof(value);
+    } else if (arg == "--resolution") {
+      resolution = atof(value);
+    } else if (arg == "--points") {
+      n_points = atoi(value);
+    } else if (arg == "--jitter") {
+      options.jitter_us = atoi(value);
+    } else if (arg == "--fragment") {
+      options.fragment = atoi(value);
+    } else if (arg == "--time-block") {
+      time_block = atoi(value) != 0;
+    } else if (arg == "--echoes") {
+      n_echoes = atoi(value);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frequency <= 0 || resolution <= 0 || options.n_scanners < 1 ||
+      n_echoes < 1 || n_echoes > MAX_ECHOES) {
+    usage(argv[0]);
+    return 1;
+  }
+  options.scan = SimulationConfig(frequency, resolution);
+  if (n_points > 0) {
+    options.scan.n_points = n_points;
+  }
+  options.scan.time_block = time_block;
+  options.scan.n_echoes = n_echoes;
+
+  running.store(true);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  vector<thread> servers;
+  const uint32_t first_ip = ntohl(ip_addr_to_int(options.ip));
+  for (unsigned int i = 0; i < options.n_scanners; ++i) {
+    const uint32_t ip = htonl(first_ip + i);
+    servers.emplace_back(serve, ip, options.port, false, std::cref(options));
+    servers.emplace_back(serve, ip, options.port + 1, true,
+                         std::cref(options));
+  }
+  cout << "Simulating " << options.n_scanners << " scanner(s) from "
+       << options.ip << " on ports " << options.port << " (ASCII) and "
+       << options.port + 1 << " (binary), " << options.scan.n_points
+       << " points at " << options.scan.frequency << " Hz" << endl;
+  for (auto &server : servers) {
+    server.join();
+  }
+}
@@ -1,4 +1,6 @@
+#include <cstring>
 #include <errno.h>
+#include <netinet/tcp.h>
 
 #include <sick-lms5xx/sopas.hpp>
 
@@ -22,68 +24,345 @@ static int uninterrupted_send(int fd, const char *data, int len) {
 
 SOPASProtocol::SOPASProtocol(const std::string &sensor_ip, const uint32_t port,
                              const ScanCallback &fn, unsigned int timeout_s)
-    : sensor_ip_(sensor_ip), port_(port), callback_(fn) {
+    : sensor_ip_(sensor_ip), port_(port), callback_(fn), timeout_s_(timeout_s),
+      clock_skew_ppm_(0), outer_sink_(nullptr) {
   stop_.store(false);
+  receiving_.store(false);
+  data_requested_.store(false);
+  connection_state_.store(ConnectionState::Connected);
+  // built once, so that wrapping the sink does not allocate per chunk
+  stamping_sink_ = [this](Scan &scan) {
+    stamp(scan);
+    (*outer_sink_)(scan);
+  };
 
-  sock_fd_ = socket(PF_INET, SOCK_STREAM, 0);
+  sock_fd_ = connect_socket();
   if (sock_fd_ < 0) {
-    throw std::runtime_error(std::string("Unable to create socket: ") +
+    throw std::runtime_error(std::string("Unable to connect to scanner: ") +
                              strerror(errno));
   }
+}
+
+int SOPASProtocol::connect_socket() const {
+  const int fd = socket(PF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
   struct sockaddr_in addr;
   addr.sin_family = AF_INET;
-  addr.sin_port = htons(port);
-  addr.sin_addr.s_addr = ip_addr_to_int(sensor_ip);
+  addr.sin_port = htons(port_);
+  addr.sin_addr.s_addr = ip_addr_to_int(sensor_ip_);
 
   // TODO: some commands might cause the scanner to take a while to respond
   // (when config changes or something). so there might not be a universal
   // timeout, but we should set a long one to not deadlock during config, and
   // a shorter one during scan parsing to know that we have lost connection.
   struct timeval timeout {
-    .tv_sec = timeout_s, .tv_usec = 0
+    .tv_sec = timeout_s_, .tv_usec = 0
   };
 
-  setsockopt(sock_fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-  setsockopt(sock_fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  // pipelined commands must not wait for the acknowledgement of the previous
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
-  const auto connect_timeout = std::chrono::seconds(timeout_s);
+  const auto connect_timeout = std::chrono::seconds(timeout_s_);
   int connect_result =
-      connect_with_timeout(sock_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+      connect_with_timeout(fd, reinterpret_cast<struct sockaddr *>(&addr),
                            sizeof(addr), connect_timeout);
   if (connect_result < 0) {
-    throw std::runtime_error(std::string("Unable to connect to scanner: ") +
-                             strerror(errno));
+    const int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
   }
+  return fd;
 }
 
 SickErr SOPASProtocol::start_scan() {
+  start_receiving();
   poller_ = std::thread([&] {
     std::vector<char> buffer(2 * 4096);
+    const ScanSink sink = [this](Scan &scan) { deliver(scan); };
+    std::chrono::system_clock::time_point received;
+    auto last_data = std::chrono::steady_clock::now();
     while (!stop_.load()) {
-      int read_bytes =
-          uninterrupted_recv(sock_fd_, buffer.data(), buffer.size());
-      if (read_bytes < 0) {
-        // do nothing for now. TODO: is this an error?
-      } else {
-        simple_optional<Scan> maybe_s =
-            batcher_.add_data(buffer.data(), read_bytes);
-        if (maybe_s.has_value()) {
-          callback_(maybe_s);
+      ssize_t read_bytes;
+      while ((read_bytes = recv_timestamped(sock_fd_, buffer.data(),
+                                            buffer.size(), 0, received)) ==
+                 -1 &&
+             errno == EINTR) {
+        continue;
+      }
+      const int recv_errno = errno;
+      const auto now = std::chrono::steady_clock::now();
+      if (read_bytes > 0) {
+        last_data = now;
+        receive_scan_data(buffer.data(), read_bytes, received, sink);
+        continue;
+      }
+      if (stop_.load()) {
+        break;
+      }
+      SickErr error(recv_errno);
+      if (read_bytes == 0) {
+        error = sick_err_t::CustomErrorConnectionClosed;
+      } else if (recv_errno == EAGAIN || recv_errno == EWOULDBLOCK) {
+        // the socket timeout expired. the scanner is quiet unless scan data
+        // was requested, so only then no data means e.g. a pulled cable.
+        const auto liveness_timeout = reconnect_policy_.liveness_timeout;
+        if (!data_requested_.load() || liveness_timeout.count() == 0 ||
+            now - last_data < liveness_timeout) {
+          continue;
         }
+        error = SickErr(ETIMEDOUT);
       }
+      if (!recover(error)) {
+        break;
+      }
+      last_data = std::chrono::steady_clock::now();
     }
   });
 
   return sick_err_t::Ok;
 }
 
+void SOPASProtocol::set_reconnect_policy(const ReconnectPolicy &policy) {
+  reconnect_policy_ = policy;
+}
+
+void SOPASProtocol::set_connection_callback(const ConnectionCallback &fn) {
+  connection_callback_ = fn;
+}
+
+void SOPASProtocol::notify(const ConnectionEvent &event) {
+  connection_state_.store(event.state);
+  if (connection_callback_) {
+    connection_callback_(event);
+  }
+}
+
+bool SOPASProtocol::wait_for_stop(std::chrono::milliseconds delay,
+                                  const std::atomic<bool> *cancel) const {
+  static constexpr std::chrono::milliseconds step(10);
+  const auto deadline = std::chrono::steady_clock::now() + delay;
+  while (!stopping(cancel)) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+        step, deadline - now));
+  }
+  return true;
+}
+
+void SOPASProtocol::reset_batcher() {
+  batcher_ = StreamingScanBatcher();
+  batcher_.set_stats(stats_.get());
+}
+
+SickErr SOPASProtocol::restore_session() {
+  // copy, since the setters record the session again
+  const Session session = session_;
+  if (session.has_access_mode) {
+    const SickErr status =
+        set_access_mode(session.access_mode, session.pw_hash);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  if (!session.ntp_server.empty()) {
+    const SickErr status = configure_ntp_client(session.ntp_server);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  if (session.has_scan_config) {
+    const SickErr status = set_scan_config(session.scan_config);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  if (session.running) {
+    return run();
+  }
+  return sick_err_t::Ok;
+}
+
+SickErr SOPASProtocol::reconnect() {
+  {
+    std::lock_guard<std::mutex> send_lock(send_mutex_);
+    std::lock_guard<std::mutex> receive_lock(receive_mutex_);
+    // replies to commands sent on the old socket never arrive
+    commands_.fail(sick_err_t::CustomErrorConnectionClosed);
+    commands_.reset();
+    close(sock_fd_);
+    sock_fd_ = connect_socket();
+    if (sock_fd_ < 0) {
+      return SickErr(errno);
+    }
+  }
+  reset_batcher();
+  if (session_.receive_timestamps) {
+    const SickErr status =
+        enable_receive_timestamps(session_.hardware_timestamps);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return restore_session();
+}
+
+bool SOPASProtocol::recover(SickErr error, const std::atomic<bool> *cancel) {
+  // commands sent meanwhile, and those restoring the session, read their
+  // replies themselves
+  receiving_.store(false);
+  if (!reconnect_policy_.enabled) {
+    notify(ConnectionEvent{ConnectionState::Failed, 0, error,
+                           std::chrono::milliseconds(0)});
+    return false;
+  }
+  for (unsigned int attempt = 1; reconnect_policy_.max_attempts == 0 ||
+                                 attempt <= reconnect_policy_.max_attempts;
+       ++attempt) {
+    const std::chrono::milliseconds delay =
+        reconnect_delay(reconnect_policy_, attempt);
+    notify(ConnectionEvent{ConnectionState::Disconnected, attempt - 1, error,
+                           delay});
+    if (wait_for_stop(delay, cancel)) {
+      return false;
+    }
+    notify(ConnectionEvent{ConnectionState::Reconnecting, attempt, error,
+                           std::chrono::milliseconds(0)});
+    error = reconnect();
+    if (error.ok()) {
+      start_receiving();
+      notify(ConnectionEvent{ConnectionState::Connected, attempt, error,
+                             std::chrono::milliseconds(0)});
+      return true;
+    }
+    if (stopping(cancel)) {
+      return false;
+    }
+  }
+  notify(ConnectionEvent{ConnectionState::Failed,
+                         reconnect_policy_.max_attempts, error,
+                         std::chrono::milliseconds(0)});
+  return false;
+}
+
+void SOPASProtocol::set_scan_ring(const std::shared_ptr<ScanRing> &ring) {
+  ring_ = ring;
+}
+
+size_t SOPASProtocol::add_scan_data(const char *data, size_t len,
+                                    const ScanSink &sink) {
+  return batcher_.add_data(data, len, sink);
+}
+
+size_t SOPASProtocol::receive_scan_data(
+    const char *data, size_t len,
+    std::chrono::system_clock::time_point received, const ScanSink &sink) {
+  if (recorder_) {
+    recorder_->record(data, len);
+  }
+  if (stats_) {
+    stats_->chunk_received(len);
+  }
+  commands_.add_data(data, len);
+  received_ = received;
+  outer_sink_ = &sink;
+  return add_scan_data(data, len, stamping_sink_);
+}
+
+void SOPASProtocol::stamp(Scan &scan) {
+  scan.receive_time = received_;
+  clock_.update(scan.time_of_transmission_us, received_);
+  clock_skew_ppm_.store(clock_.skew_ppm(), std::memory_order_relaxed);
+  if (scan.time_source == ScanTimeSource::Device) {
+    return;
+  }
+  if (clock_.ready()) {
+    scan.time = clock_.to_host(scan.time_since_boot_us);
+    scan.time_source = ScanTimeSource::Estimated;
+  } else {
+    // the scanner clock tells how long ago the scan started
+    const uint32_t age_us =
+        scan.time_of_transmission_us - scan.time_since_boot_us;
+    scan.time = received_ - std::chrono::microseconds(age_us);
+    scan.time_source = ScanTimeSource::Receive;
+  }
+}
+
+SickErr SOPASProtocol::enable_receive_timestamps(bool hardware) {
+  if (sick::enable_receive_timestamps(sock_fd_, hardware) < 0) {
+    return sick_err_t::CustomError;
+  }
+  session_.receive_timestamps = true;
+  session_.hardware_timestamps = hardware;
+  return sick_err_t::Ok;
+}
+
+void SOPASProtocol::set_batcher_stats(PipelineStats *stats) {
+  batcher_.set_stats(stats);
+}
+
+void SOPASProtocol::enable_stats(bool enable) {
+  if (enable && !stats_) {
+    stats_ = std::make_shared<PipelineStats>();
+  } else if (!enable) {
+    stats_.reset();
+  }
+  set_batcher_stats(stats_.get());
+}
+
+ScanStats SOPASProtocol::stats() const {
+  if (stats_) {
+    return stats_->snapshot();
+  }
+  return ScanStats();
+}
+
+void SOPASProtocol::record_to(
+    const std::shared_ptr<TelegramRecorder> &recorder) {
+  recorder_ = recorder;
+}
+
+void SOPASProtocol::set_scan_pool(const std::shared_ptr<ScanPool> &pool,
+                                  const PooledScanCallback &fn) {
+  pool_ = pool;
+  pool_callback_ = fn;
+}
+
+void SOPASProtocol::deliver(Scan &scan) {
+  if (ring_) {
+    ring_->push(scan);
+  } else if (pool_) {
+    ScanPtr pooled = pool_->publish(scan);
+    if (pooled) {
+      pool_callback_(std::move(pooled));
+    }
+  } else {
+    callback_(scan);
+  }
+}
+
 void SOPASProtocol::stop(bool stop_laser) {
   stop_.store(true);
+  if (ring_) {
+    // wake up the poller if it is blocked on a full ring
+    ring_->close();
+  }
   // for mysterious reasons, sometimes the poller is not joinable even though
   // it is not join()ed anywhere else
   if (poller_.joinable()) {
     poller_.join();
   }
+  receiving_.store(false);
+  session_.running = false;
+  data_requested_.store(false);
 }
 
 SOPASProtocol::~SOPASProtocol() {
@@ -91,6 +370,75 @@ SOPASProtocol::~SOPASProtocol() {
   close(sock_fd_);
 }
 
+std::future<SickErr> SOPASProtocol::send_telegram_async(const char *telegram,
+                                                        size_t len) {
+  std::lock_guard<std::mutex> lock(send_mutex_);
+  uint64_t id;
+  std::future<SickErr> reply = commands_.expect(telegram, len, id);
+  const int send_result = send_sopas_command(sock_fd_, telegram, len);
+  // commands on other threads are failed by whoever reads the socket
+  if (send_result < 0) {
+    commands_.cancel(id, SickErr(errno));
+  } else if (send_result == 0) {
+    commands_.cancel(id, sick_err_t::CustomErrorConnectionClosed);
+  }
+  return std::async(std::launch::deferred, &SOPASProtocol::await_reply, this,
+                    std::move(reply), id);
+}
+
+SickErr SOPASProtocol::await_reply(std::future<SickErr> reply, uint64_t id) {
+  static constexpr std::chrono::milliseconds poll_interval(10);
+  // without a socket timeout, wait as long as a blocking recv would
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s_);
+  std::array<char, 4096> buffer;
+  while (true) {
+    const auto now = std::chrono::steady_clock::now();
+    if (timeout_s_ > 0 && now >= deadline) {
+      // e.g. the reply was lost, or scan data keeps recv from timing out
+      commands_.cancel(id, sick_err_t::CustomErrorSocketRecv);
+      break;
+    }
+    if (receiving_.load()) {
+      // the receive thread passes the reply to commands_
+      const auto wait =
+          timeout_s_ > 0
+              ? std::min<std::chrono::steady_clock::duration>(poll_interval,
+                                                              deadline - now)
+              : poll_interval;
+      if (reply.wait_for(wait) == std::future_status::ready) {
+        break;
+      }
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(receive_mutex_);
+    if (reply.wait_for(std::chrono::seconds(0)) ==
+        std::future_status::ready) {
+      break;
+    }
+    // a receive thread may have started while waiting for the lock
+    if (receiving_.load()) {
+      continue;
+    }
+    // scan data received meanwhile is dropped
+    const int recv_result =
+        receive_sopas_reply(sock_fd_, buffer.data(), buffer.size());
+    if (recv_result > 0) {
+      commands_.add_data(buffer.data(), recv_result);
+    } else if (recv_result == 0) {
+      commands_.fail(sick_err_t::CustomErrorConnectionClosed);
+    } else {
+      commands_.fail(SickErr(errno));
+    }
+  }
+  return reply.get();
+}
+
+void SOPASProtocol::start_receiving() {
+  std::lock_guard<std::mutex> lock(receive_mutex_);
+  receiving_.store(true);
+}
+
 int receive_sopas_reply(int sock_fd, char *data_out, size_t len) {
   if (len < 1) {
     throw std::runtime_error("No data passed to receive_sopas_reply()");
@@ -106,7 +454,8 @@ int send_sopas_command(int sock_fd, const char *data, size_t len) {
 }
 
 SickErr send_sopas_command_and_check_answer(int sock_fd, const char *data,
-                                            size_t len) {
+                                            size_t len,
+                                            StatusParser parse_status) {
   int send_result = send_sopas_command(sock_fd, data, len);
   if (send_result < 0) {
     return SickErr(errno);
@@ -122,124 +471,287 @@ SickErr send_sopas_command_and_check_answer(int sock_fd, const char *data,
   } else if (recv_result == 0) {
     return sick_err_t::CustomErrorConnectionClosed;
   }
-  return status_from_bytes_ascii(recvbuf.data(), recv_result);
+  return parse_status(recvbuf.data(), recv_result);
+}
+
+/**
+ * @brief   Scan configuration in the units the scanner expects
+ */
+struct LMSScanConfig {
+  unsigned int hz_lms;            ///< frequency in 1/100 Hz
+  unsigned int ang_increment_lms; ///< resolution in 1/10000 degrees
+  int start_angle_lms;            ///< start angle in 1/10000 LMS degrees
+  int end_angle_lms;              ///< end angle in 1/10000 LMS degrees
+};
+
+static LMSScanConfig to_lms_units(const lms5xx::LMSConfigParams &params) {
+  const hz frequency = params.frequency;
+  const rad ang_increment = params.resolution;
+  return LMSScanConfig{
+      static_cast<unsigned int>(frequency * 100),
+      static_cast<unsigned int>(round(ang_increment * 10000)),
+      static_cast<int>(angle_to_lms(params.start_angle) * 10000),
+      static_cast<int>(angle_to_lms(params.end_angle) * 10000)};
 }
 
 SickErr SOPASProtocolASCII::set_access_mode(const uint8_t mode,
                                             const uint32_t pw_hash) {
-  std::array<char, 128> buffer;
   // authorized client mode with pw hash from telegram listing
-  int bytes_written = std::sprintf(
-      buffer.data(), command_masks_[SETACCESSMODE].c_str(), mode, pw_hash);
-  if (bytes_written < 0) {
-    return SickErr(errno);
+  const SickErr status = send_command<SETACCESSMODE>(mode, pw_hash);
+  if (status.ok()) {
+    session_.has_access_mode = true;
+    session_.access_mode = mode;
+    session_.pw_hash = pw_hash;
   }
-  return send_sopas_command_and_check_answer(sock_fd_, buffer.data(),
-                                             bytes_written);
+  return status;
 }
 
 SickErr SOPASProtocolASCII::configure_ntp_client(const std::string &ip) {
-  const SickErr role_res = send_command(TSCROLE, 1);
-  if (!role_res.ok()) {
-    return role_res;
-  }
-  const SickErr iface_res = send_command(TSCTCINTERFACE, 0);
-  if (!iface_res.ok()) {
-    return iface_res;
-  }
-  const SickErr srvaddr_res = send_command(
-      TSCTCSRVADDR,
-      ip_addr_to_hex_str(ip.c_str())
-          .c_str() /* convert to c str to pass to variadic std::sprintf */);
+  // independent writes, so send them all before waiting for the replies
+  std::array<std::future<SickErr>, 3> replies{
+      {send_command_async<TSCROLE>(1), send_command_async<TSCTCINTERFACE>(0),
+       send_command_async<TSCTCSRVADDR>(ntohl(ip_addr_to_int(ip)))}};
+  const SickErr srvaddr_res = first_error(replies);
+  if (srvaddr_res.ok()) {
+    session_.ntp_server = ip;
+  }
   return srvaddr_res;
 }
 
 SickErr
 SOPASProtocolASCII::set_scan_config(const lms5xx::LMSConfigParams &params) {
-  const hz frequency = params.frequency;
-  const unsigned int hz_Lms = static_cast<unsigned int>(frequency * 100);
-  const rad ang_increment = params.resolution;
-  const unsigned int ang_increment_lms =
-      static_cast<unsigned int>(round(ang_increment * 10000));
-  const int start_angle_lms =
-      static_cast<int>(angle_to_lms(params.start_angle) * 10000);
-  const int end_angle_lms =
-      static_cast<unsigned int>(angle_to_lms(params.end_angle) * 10000);
-
-  SickErr status = send_command(MLMPSETSCANCFG, hz_Lms, ang_increment_lms,
-                                start_angle_lms, end_angle_lms);
+  const LMSScanConfig cfg = to_lms_units(params);
+
+  // the output depends on the scan config, so it must be accepted first
+  SickErr status = send_command<MLMPSETSCANCFG>(
+      cfg.hz_lms, cfg.ang_increment_lms, cfg.start_angle_lms,
+      cfg.end_angle_lms);
   if (!status.ok()) {
     return status;
   }
-  status = send_command(LMDSCANDATACFG);
+  // independent writes, so send them all before waiting for the replies
+  std::array<std::future<SickErr>, 3> replies{
+      {send_command_async<LMDSCANDATACFG>(
+           echo_output_channels(params.echo_filter)),
+       send_command_async<FRECHOFILTER>(
+           static_cast<unsigned int>(params.echo_filter)),
+       send_command_async<LMPOUTPUTRANGE_WRITE>(
+           cfg.ang_increment_lms, cfg.start_angle_lms, cfg.end_angle_lms)}};
+  status = first_error(replies);
   if (!status.ok()) {
     return status;
   }
-  status = send_command(FRECHOFILTER, 2);
-  if (!status.ok()) {
-    return status;
+  status = send_command<LMCSTARTMEAS>();
+  if (status.ok()) {
+    session_.has_scan_config = true;
+    session_.scan_config = params;
   }
-  status = send_command(LMPOUTPUTRANGE_WRITE, ang_increment_lms,
-                        start_angle_lms, end_angle_lms);
-  if (!status.ok()) {
-    return status;
-  }
-  status = send_command(LMCSTARTMEAS);
   return status;
 }
 
-SickErr SOPASProtocolASCII::save_params() { return send_command(MEEWRITEALL); }
+SickErr SOPASProtocolASCII::save_params() {
+  return send_command<MEEWRITEALL>();
+}
 
-SickErr SOPASProtocolASCII::reboot() { return send_command(REBOOT); }
+SickErr SOPASProtocolASCII::reboot() { return send_command<REBOOT>(); }
 
 SickErr SOPASProtocolASCII::run() {
-  SickErr status = send_command(RUN);
+  // scan data is only requested once the scanner left the config mode
+  SickErr status = send_command<RUN>();
   if (!status.ok()) {
     return status;
   }
-  return send_command(LMDSCANDATA, 1);
+  status = send_command<LMDSCANDATA>(1);
+  if (status.ok()) {
+    session_.running = true;
+    data_requested_.store(true);
+  }
+  return status;
 }
 
 void SOPASProtocolASCII::stop(bool stop_laser) {
   SOPASProtocol::stop();
-
-  std::array<char, 4096> buffer;
-  int len = make_command_msg(buffer.data(), LMDSCANDATA, 0);
-  int bytes_sent = send_sopas_command(sock_fd_, buffer.data(), len);
-  if (bytes_sent < 0) {
-    throw std::runtime_error("Failed to send.");
+  if (connection_state() != ConnectionState::Connected) {
+    // nobody to tell
+    return;
   }
-  while (true) {
-    int bytes_received = receive_sopas_reply(sock_fd_, &buffer[0], 4096);
-    std::string answer(&buffer[0], bytes_received);
-    if (answer.find("LMDscandata") != std::string::npos) {
-      SickErr status = status_from_bytes_ascii(buffer.data(), bytes_received);
-      if (status.ok() && stop_laser) {
-        SickErr login_result = set_access_mode(3);
-        if (login_result.ok()) {
-          SickErr stop_meas_result = send_command(LMCSTOPMEAS);
-          if (stop_meas_result.ok()) {
-            /* std::cout << "Stopped measurements." << std::endl; */
-          } else {
-            // TODO: return an error here?
-            /* std::cout << "Failed to stop measurements." <<
-             * std::endl; */
-          }
-        } else {
-          // TODO: return an error here?
-          /* std::cout << "Login failed." << std::endl; */
-        }
+
+  // trailing lidar data is skipped while waiting for the reply
+  SickErr status = send_command<LMDSCANDATA>(0);
+  if (status.ok() && stop_laser) {
+    SickErr login_result = set_access_mode(3);
+    if (login_result.ok()) {
+      SickErr stop_meas_result = send_command<LMCSTOPMEAS>();
+      if (stop_meas_result.ok()) {
+        /* std::cout << "Stopped measurements." << std::endl; */
       } else {
         // TODO: return an error here?
-        /* std::cout << "Scan stop cmd failed: " <<
-         * sick_err_t_to_string(status)
-         */
-        /*           << std::endl; */
+        /* std::cout << "Failed to stop measurements." <<
+         * std::endl; */
       }
-      return;
     } else {
-      // trailing lidar data should be skipped
-      /* std::cout << "Skipping trailing data ..." << std::endl; */
+      // TODO: return an error here?
+      /* std::cout << "Login failed." << std::endl; */
+    }
+  } else {
+    // TODO: return an error here?
+    /* std::cout << "Scan stop cmd failed: " <<
+     * sick_err_t_to_string(status)
+     */
+    /*           << std::endl; */
+  }
+}
+
+size_t SOPASProtocolBinary::add_scan_data(const char *data, size_t len,
+                                          const ScanSink &sink) {
+  return binary_batcher_.add_data(data, len, sink);
+}
+
+void SOPASProtocolBinary::set_batcher_stats(PipelineStats *stats) {
+  binary_batcher_.set_stats(stats);
+}
+
+void SOPASProtocolBinary::reset_batcher() {
+  binary_batcher_ = BinaryScanBatcher();
+  binary_batcher_.set_stats(stats_.get());
+}
+
+SickErr SOPASProtocolBinary::send_command(BinaryCommand &cmd) {
+  return send_command_async(cmd).get();
+}
+
+std::future<SickErr>
+SOPASProtocolBinary::send_command_async(BinaryCommand &cmd) {
+  const char *data = cmd.data();
+  return send_telegram_async(data, cmd.size());
+}
+
+SickErr SOPASProtocolBinary::set_access_mode(const uint8_t mode,
+                                             const uint32_t pw_hash) {
+  BinaryCommand cmd("sMN SetAccessMode");
+  cmd.u8(mode).u32(pw_hash);
+  const SickErr status = send_command(cmd);
+  if (status.ok()) {
+    session_.has_access_mode = true;
+    session_.access_mode = mode;
+    session_.pw_hash = pw_hash;
+  }
+  return status;
+}
+
+SickErr SOPASProtocolBinary::configure_ntp_client(const std::string &ip) {
+  BinaryCommand role("sWN TSCRole");
+  role.u8(1);
+  BinaryCommand iface("sWN TSCTCInterface");
+  iface.u8(0);
+  BinaryCommand srvaddr("sWN TSCTCSrvAddr");
+  srvaddr.u32(ntohl(ip_addr_to_int(ip)));
+  // independent writes, so send them all before waiting for the replies
+  std::array<std::future<SickErr>, 3> replies{
+      {send_command_async(role), send_command_async(iface),
+       send_command_async(srvaddr)}};
+  const SickErr srvaddr_res = first_error(replies);
+  if (srvaddr_res.ok()) {
+    session_.ntp_server = ip;
+  }
+  return srvaddr_res;
+}
+
+SickErr
+SOPASProtocolBinary::set_scan_config(const lms5xx::LMSConfigParams &params) {
+  const LMSScanConfig cfg = to_lms_units(params);
+
+  BinaryCommand scancfg("sMN mLMPsetscancfg");
+  scancfg.u32(cfg.hz_lms)
+      .i16(1)
+      .u32(cfg.ang_increment_lms)
+      .i32(cfg.start_angle_lms)
+      .i32(cfg.end_angle_lms);
+  // the output depends on the scan config, so it must be accepted first
+  SickErr status = send_command(scancfg);
+  if (!status.ok()) {
+    return status;
+  }
+  // independent writes, so send them all before waiting for the replies
+  std::array<std::future<SickErr>, 3> replies;
+  // same values as the ascii LMDscandatacfg: echoes, remission on, 8 bit,
+  // time on. the echo mask is the first byte of the output channel
+  BinaryCommand datacfg("sWN LMDscandatacfg");
+  datacfg.u16(echo_output_channels(params.echo_filter) << 8)
+      .u8(1)
+      .u8(0)
+      .u8(0)
+      .u16(0)
+      .u8(0)
+      .u8(0)
+      .u8(0)
+      .u8(1)
+      .u16(1);
+  replies[0] = send_command_async(datacfg);
+  BinaryCommand echo("sWN FREchoFilter");
+  echo.u8(static_cast<uint8_t>(params.echo_filter));
+  replies[1] = send_command_async(echo);
+  BinaryCommand outputrange("sWN LMPoutputRange");
+  outputrange.u16(1)
+      .u32(cfg.ang_increment_lms)
+      .i32(cfg.start_angle_lms)
+      .i32(cfg.end_angle_lms);
+  replies[2] = send_command_async(outputrange);
+  status = first_error(replies);
+  if (!status.ok()) {
+    return status;
+  }
+  BinaryCommand startmeas("sMN LMCstartmeas");
+  status = send_command(startmeas);
+  if (status.ok()) {
+    session_.has_scan_config = true;
+    session_.scan_config = params;
+  }
+  return status;
+}
+
+SickErr SOPASProtocolBinary::save_params() {
+  BinaryCommand cmd("sMN mEEwriteall");
+  return send_command(cmd);
+}
+
+SickErr SOPASProtocolBinary::reboot() {
+  BinaryCommand cmd("sMN mSCreboot");
+  return send_command(cmd);
+}
+
+SickErr SOPASProtocolBinary::run() {
+  BinaryCommand run("sMN Run");
+  BinaryCommand scandata("sEN LMDscandata");
+  scandata.u8(1);
+  // scan data is only requested once the scanner left the config mode
+  SickErr status = send_command(run);
+  if (!status.ok()) {
+    return status;
+  }
+  status = send_command(scandata);
+  if (status.ok()) {
+    session_.running = true;
+    data_requested_.store(true);
+  }
+  return status;
+}
+
+void SOPASProtocolBinary::stop(bool stop_laser) {
+  SOPASProtocol::stop();
+  if (connection_state() != ConnectionState::Connected) {
+    return;
+  }
+
+  // trailing scan data is skipped while waiting for the acknowledgement
+  BinaryCommand scandata("sEN LMDscandata");
+  scandata.u8(0);
+  SickErr status = send_command(scandata);
+  if (status.ok() && stop_laser) {
+    SickErr login_result = set_access_mode(3);
+    if (login_result.ok()) {
+      BinaryCommand stopmeas("sMN LMCstopmeas");
+      send_command(stopmeas);
     }
   }
 }
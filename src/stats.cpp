@@ -0,0 +1,149 @@
+#include <cmath>
+#include <sick-lms5xx/stats.hpp>
+
+namespace sick {
+
+constexpr size_t LatencyHistogram::N_BUCKETS;
+
+static uint64_t elapsed_ns(PipelineStats::clock::time_point from,
+                           PipelineStats::clock::time_point to) {
+  const auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+}
+
+uint64_t LatencySnapshot::percentile_ns(double percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  // rank of the value, rounded up so that the 100th percentile is the max
+  uint64_t rank =
+      static_cast<uint64_t>(std::ceil(percentile / 100.0 * count_));
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t n = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    n += buckets_[i];
+    if (n >= rank) {
+      const uint64_t upper = LatencyHistogram::bucket_upper_bound(i);
+      return upper < max_ns_ ? upper : max_ns_;
+    }
+  }
+  return max_ns_;
+}
+
+LatencyHistogram::LatencyHistogram() : count_(0), sum_ns_(0), max_ns_(0) {
+  for (auto &bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t LatencyHistogram::bucket(uint64_t ns) {
+  static constexpr uint64_t n_sub_buckets = 1u << SUB_BUCKET_BITS;
+  if (ns < n_sub_buckets) {
+    return ns;
+  }
+  // position of the highest set bit
+  unsigned int exponent = 63 - __builtin_clzll(ns);
+  if (exponent >= MAX_EXPONENT) {
+    return N_BUCKETS - 1;
+  }
+  // the SUB_BUCKET_BITS bits after the highest one select the linear bucket
+  const uint64_t sub_bucket =
+      (ns >> (exponent - SUB_BUCKET_BITS)) & (n_sub_buckets - 1);
+  return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t idx) {
+  static constexpr uint64_t n_sub_buckets = 1u << SUB_BUCKET_BITS;
+  if (idx < n_sub_buckets) {
+    return idx;
+  }
+  const unsigned int exponent =
+      (idx >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+  const uint64_t sub_bucket = idx & (n_sub_buckets - 1);
+  const unsigned int shift = exponent - SUB_BUCKET_BITS;
+  return ((n_sub_buckets + sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+  uint64_t max = max_ns_.load(std::memory_order_relaxed);
+  while (ns > max &&
+         !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+  }
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const {
+  LatencySnapshot snapshot;
+  snapshot.buckets_.resize(N_BUCKETS);
+  // count the buckets rather than reading count_, so that the snapshot is
+  // consistent even while values are being recorded
+  for (size_t i = 0; i < N_BUCKETS; ++i) {
+    snapshot.buckets_[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot.count_ += snapshot.buckets_[i];
+  }
+  snapshot.sum_ns_ = sum_ns_.load(std::memory_order_relaxed);
+  snapshot.max_ns_ = max_ns_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+PipelineStats::PipelineStats()
+    : bytes_received_(0), chunks_received_(0), telegrams_(0), scans_(0),
+      parse_failures_(0), framing_errors_(0) {}
+
+void PipelineStats::chunk_received(size_t bytes) {
+  received_ = clock::now();
+  bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+  chunks_received_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::telegram_framed() {
+  framed_ = clock::now();
+  telegrams_.fetch_add(1, std::memory_order_relaxed);
+  recv_to_framed_.record(elapsed_ns(received_, framed_));
+}
+
+void PipelineStats::parse_started() {
+  parse_started_ = clock::now();
+  framed_to_parse_.record(elapsed_ns(framed_, parse_started_));
+}
+
+void PipelineStats::parse_finished(bool ok) {
+  const clock::time_point now = clock::now();
+  parse_.record(elapsed_ns(parse_started_, now));
+  if (ok) {
+    scans_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    parse_failures_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void PipelineStats::callback_started() { callback_started_ = clock::now(); }
+
+void PipelineStats::callback_finished() {
+  const clock::time_point now = clock::now();
+  callback_.record(elapsed_ns(callback_started_, now));
+  total_.record(elapsed_ns(received_, now));
+}
+
+ScanStats PipelineStats::snapshot() const {
+  ScanStats stats;
+  stats.bytes_received = bytes_received_.load(std::memory_order_relaxed);
+  stats.chunks_received = chunks_received_.load(std::memory_order_relaxed);
+  stats.telegrams = telegrams_.load(std::memory_order_relaxed);
+  stats.scans = scans_.load(std::memory_order_relaxed);
+  stats.parse_failures = parse_failures_.load(std::memory_order_relaxed);
+  stats.framing_errors = framing_errors_.load(std::memory_order_relaxed);
+  stats.recv_to_framed = recv_to_framed_.snapshot();
+  stats.framed_to_parse = framed_to_parse_.snapshot();
+  stats.parse = parse_.snapshot();
+  stats.callback = callback_.snapshot();
+  stats.total = total_.snapshot();
+  return stats;
+}
+
+} // namespace sick
@@ -0,0 +1,366 @@
+#include <array>
+#include <cstring>
+#include <sick-lms5xx/streaming.hpp>
+
+namespace sick {
+
+/// Header tokens after the command: version, device number, serial number,
+/// device status (2), telegram counter, scan counter, time since boot, time
+/// of transmission, inputs (2), outputs (2), layer angle, scan frequency,
+/// measurement frequency
+static constexpr unsigned int TIME_SINCE_BOOT_FIELD = 7;
+static constexpr unsigned int TIME_OF_TRANSMISSION_FIELD = 8;
+static constexpr unsigned int SCAN_FREQUENCY_FIELD = 14;
+static constexpr unsigned int MEASUREMENT_FREQUENCY_FIELD = 15;
+static constexpr unsigned int N_ENCODERS_FIELD = 16;
+/// Encoder position and speed follow the number of encoders
+static constexpr unsigned int N_16BIT_CHANNELS_FIELD = N_ENCODERS_FIELD + 3;
+/// Name block, if present, follows position and name flag
+static constexpr unsigned int NAME_EXISTS_FIELD = 1;
+static constexpr unsigned int TIME_EXISTS_FIELD = NAME_EXISTS_FIELD + 4;
+static constexpr unsigned int LAST_TIME_FIELD = TIME_EXISTS_FIELD + 7;
+
+/**
+ * @brief   Value of each character as hex digit, -1 for other characters
+ */
+static std::array<int8_t, 256> make_hex_table() {
+  std::array<int8_t, 256> table;
+  for (size_t c = 0; c < table.size(); ++c) {
+    table[c] = static_cast<int8_t>(hex_digit(static_cast<char>(c)));
+  }
+  return table;
+}
+
+static const std::array<int8_t, 256> HEX_TABLE = make_hex_table();
+
+/// Ranges are sent in mm, converted while decoding to leave no pass over the
+/// scan for ETX
+static constexpr float MM_PER_M = 1000;
+
+StreamingScanBatcher::StreamingScanBatcher()
+    : state_(State::Idle), field_(0), n_echoes_(1), echo_(0), value_idx_(0),
+      has_time_(false), scan_frequency_(0), measurement_frequency_(0),
+      pipeline_stats(nullptr) {
+  reset_token();
+}
+
+bool StreamingScanBatcher::token_is(const char *str) const {
+  const size_t len = strlen(str);
+  return token_len_ == len && len <= TOKEN_CAPACITY &&
+         std::memcmp(token_, str, len) == 0;
+}
+
+bool StreamingScanBatcher::token_contains(const char *needle) const {
+  const TokenView view{token_, token_len_ < TOKEN_CAPACITY ? token_len_
+                                                           : TOKEN_CAPACITY};
+  return view.contains(needle);
+}
+
+bool StreamingScanBatcher::channel_field(ChannelFields &fields) {
+  switch (field_) {
+  case 1:
+    fields.scale_factor = token_is("3F800000") ? 1 : 2;
+    break;
+  case 2:
+    fields.offset = token_value();
+    break;
+  case 3:
+    // start angle is a signed 32 bit value
+    fields.start_angle =
+        static_cast<int32_t>(static_cast<uint32_t>(token_value())) / 10000.0;
+    break;
+  case 4:
+    fields.ang_incr = token_value() / 10000.0;
+    break;
+  case 5:
+    fields.n_values = token_value();
+    return true;
+  default:
+    // description, checked by the caller
+    break;
+  }
+  ++field_;
+  return false;
+}
+
+void StreamingScanBatcher::end_channel() {
+  const bool ranges = state_ == State::Ranges;
+  field_ = 0;
+  if (++echo_ < n_echoes_) {
+    state_ = ranges ? State::RangeChannel : State::IntensityChannel;
+  } else {
+    state_ = ranges ? State::IntensityCount : State::Trailer;
+  }
+}
+
+void StreamingScanBatcher::end_token() {
+  switch (state_) {
+  case State::Method:
+    state_ = token_is("sSN") ? State::Command : State::Other;
+    return;
+  case State::Command:
+    state_ = token_is("LMDscandata") ? State::Header : State::Other;
+    field_ = 0;
+    has_time_ = false;
+    return;
+  case State::Header:
+    if (field_ == TIME_SINCE_BOOT_FIELD) {
+      s.time_since_boot_us = static_cast<uint32_t>(value_);
+    } else if (field_ == TIME_OF_TRANSMISSION_FIELD) {
+      s.time_of_transmission_us = static_cast<uint32_t>(value_);
+    } else if (field_ == SCAN_FREQUENCY_FIELD) {
+      scan_frequency_ = token_value() / 100.0;
+    } else if (field_ == MEASUREMENT_FREQUENCY_FIELD) {
+      // sent in units of 100 Hz
+      measurement_frequency_ = token_value() * 100.0;
+    }
+    if (field_ == N_ENCODERS_FIELD && token_value() == 0) {
+      // no encoder position and speed
+      field_ = N_16BIT_CHANNELS_FIELD;
+      return;
+    }
+    if (field_ == N_16BIT_CHANNELS_FIELD) {
+      // one distance channel per echo
+      const long n_channels = token_value();
+      state_ = n_channels >= 1 && n_channels <= MAX_ECHOES
+                   ? State::RangeChannel
+                   : State::Skip;
+      n_echoes_ = static_cast<unsigned int>(n_channels);
+      echo_ = 0;
+      field_ = 0;
+      return;
+    }
+    ++field_;
+    return;
+  case State::RangeChannel:
+    if (field_ == 0 && !token_contains("DIST")) {
+      state_ = State::Skip;
+      return;
+    }
+    if (channel_field(range_)) {
+      if (range_.n_values < 1 || range_.n_values > MAX_CHANNEL_VALUES ||
+          (echo_ > 0 && range_.n_values != static_cast<long>(s.size))) {
+        state_ = State::Skip;
+        return;
+      }
+      if (echo_ == 0) {
+        update_scan_geometry(s, range_.n_values, range_.start_angle,
+                             range_.ang_incr, n_echoes_);
+      }
+      s.range_scaling[echo_] =
+          ChannelScaling{range_.scale_factor / MM_PER_M,
+                         static_cast<float>(range_.offset) / MM_PER_M};
+      state_ = State::Ranges;
+      value_idx_ = 0;
+    }
+    return;
+  case State::Ranges:
+    s.ranges(echo_, value_idx_) =
+        static_cast<float>(range_.offset +
+                           range_.scale_factor * token_value()) /
+        MM_PER_M;
+    if (++value_idx_ == s.size) {
+      end_channel();
+    }
+    return;
+  case State::IntensityCount:
+    // one remission channel per echo
+    state_ = token_value() == n_echoes_ ? State::IntensityChannel
+                                        : State::Skip;
+    echo_ = 0;
+    field_ = 0;
+    return;
+  case State::IntensityChannel:
+    if (field_ == 0 && !token_contains("RSSI")) {
+      state_ = State::Skip;
+      return;
+    }
+    if (channel_field(intensity_)) {
+      if (intensity_.n_values != static_cast<long>(s.size)) {
+        state_ = State::Skip;
+        return;
+      }
+      s.intensity_scaling[echo_] =
+          ChannelScaling{static_cast<float>(intensity_.scale_factor),
+                         static_cast<float>(intensity_.offset)};
+      state_ = State::Intensities;
+      value_idx_ = 0;
+    }
+    return;
+  case State::Intensities:
+    s.intensities(echo_, value_idx_) =
+        intensity_.offset + intensity_.scale_factor * token_value();
+    if (++value_idx_ == s.size) {
+      end_channel();
+    }
+    return;
+  case State::Trailer:
+    if (field_ == NAME_EXISTS_FIELD && token_value() != 1) {
+      // no name block
+      field_ = TIME_EXISTS_FIELD - 1;
+      return;
+    }
+    if (field_ == TIME_EXISTS_FIELD) {
+      has_time_ = token_value() == 1;
+      if (!has_time_) {
+        // no time stamp, the receiver may stamp the scan
+        state_ = State::Done;
+        return;
+      }
+    }
+    if (field_ > TIME_EXISTS_FIELD) {
+      time_[field_ - TIME_EXISTS_FIELD - 1] = token_value();
+      if (field_ == LAST_TIME_FIELD) {
+        state_ = State::Done;
+        return;
+      }
+    }
+    ++field_;
+    return;
+  case State::Idle:
+  case State::Done:
+  case State::Skip:
+  case State::Other:
+    return;
+  }
+}
+
+bool StreamingScanBatcher::end_telegram(const ScanSink &sink) {
+  const bool ok = state_ == State::Done;
+  const bool scan = state_ != State::Other;
+  state_ = State::Idle;
+  if (pipeline_stats) {
+    pipeline_stats->telegram_framed();
+  }
+  if (!scan) {
+    // replies and events are no parse failures
+    return false;
+  }
+  if (pipeline_stats) {
+    pipeline_stats->parse_started();
+  }
+  if (ok) {
+    update_scan_timing(s, scan_frequency_, measurement_frequency_);
+  }
+  if (ok && has_time_) {
+    s.time = scan_time(time_[0], time_[1], time_[2], time_[3], time_[4],
+                       time_[5], time_[6]);
+    s.time_source = ScanTimeSource::Device;
+  } else if (ok) {
+    s.time = std::chrono::system_clock::time_point();
+    s.time_source = ScanTimeSource::None;
+  }
+  if (pipeline_stats) {
+    pipeline_stats->parse_finished(ok);
+  }
+  if (!ok) {
+    return false;
+  }
+  if (pipeline_stats) {
+    pipeline_stats->callback_started();
+  }
+  sink(s);
+  if (pipeline_stats) {
+    pipeline_stats->callback_finished();
+  }
+  return true;
+}
+
+const char *StreamingScanBatcher::decode_values(const char *pos,
+                                                const char *end) {
+  const bool ranges = state_ == State::Ranges;
+  float *out = ranges ? s.ranges.row(echo_).data()
+                      : s.intensities.row(echo_).data();
+  const ChannelFields &fields = ranges ? range_ : intensity_;
+  const float divisor = ranges ? MM_PER_M : 1;
+  if (hex_ended_) {
+    // digits after junk are ignored like in parse_hex(), until the next space
+    return pos;
+  }
+  while (pos < end) {
+    const int digit = HEX_TABLE[static_cast<uint8_t>(*pos)];
+    if (digit >= 0) {
+      value_ = (value_ << 4) | digit;
+      ++token_len_;
+      ++pos;
+      continue;
+    }
+    if (*pos != ' ' || token_len_ == 0 || negative_ || hex_ended_) {
+      // anything but a plain hex value is left to the general path
+      break;
+    }
+    const long value = fields.offset + fields.scale_factor * token_value();
+    out[value_idx_] = static_cast<float>(value) / divisor;
+    reset_token();
+    ++pos;
+    if (++value_idx_ == s.size) {
+      end_channel();
+      break;
+    }
+  }
+  return pos;
+}
+
+size_t StreamingScanBatcher::add_data(const char *data_new, size_t length,
+                                      const ScanSink &sink) {
+  size_t n_scans = 0;
+  const char *pos = data_new;
+  const char *const end = data_new + length;
+  while (pos < end) {
+    if (state_ == State::Idle) {
+      // skip anything between telegrams
+      const char *stx =
+          static_cast<const char *>(std::memchr(pos, STX, end - pos));
+      if (stx == nullptr) {
+        break;
+      }
+      pos = stx + 1;
+      state_ = State::Method;
+      reset_token();
+      continue;
+    }
+    if (state_ == State::Ranges || state_ == State::Intensities) {
+      const char *value_end = decode_values(pos, end);
+      if (value_end != pos) {
+        pos = value_end;
+        continue;
+      }
+    }
+    const char c = *pos++;
+    const int digit = HEX_TABLE[static_cast<uint8_t>(c)];
+    if (digit >= 0) {
+      if (!hex_ended_) {
+        value_ = (value_ << 4) | digit;
+      }
+    } else if (c == ' ' || c == ETX) {
+      if (token_len_ > 0) {
+        end_token();
+        reset_token();
+      }
+      if (c == ETX) {
+        n_scans += end_telegram(sink);
+      }
+      continue;
+    } else if (c == STX) {
+      // the previous telegram was not terminated, start over
+      if (pipeline_stats) {
+        pipeline_stats->framing_error();
+      }
+      state_ = State::Method;
+      reset_token();
+      continue;
+    } else if (token_len_ == 0 && (c == '-' || c == '+')) {
+      negative_ = c == '-';
+    } else {
+      // like parse_hex(), decoding stops at the first non-hex character
+      hex_ended_ = true;
+    }
+    if (token_len_ < TOKEN_CAPACITY) {
+      token_[token_len_] = c;
+    }
+    ++token_len_;
+  }
+  return n_scans;
+}
+
+} // namespace sick
@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sick-lms5xx/framing.hpp>
+#include <sick-lms5xx/hex.hpp>
+#include <sick-lms5xx/parsing.hpp>
+#include <sick-lms5xx/pool.hpp>
+#include <sick-lms5xx/ring.hpp>
+#include <sick-lms5xx/simulation.hpp>
+#include <sick-lms5xx/streaming.hpp>
+
+// Tests of the SIMD kernels of the receive path against their scalar
+// references: the hex decoding of channel values, also compared to strtol()
+// and through the bulk and streaming parsers, and the search for telegram
+// delimiters. Also the hand-off of scans between threads through ScanRing and
+// the reference counting of ScanPool.
+// Run by ctest; exits with 1 and prints the failed checks on mismatch.
+
+using namespace sick;
+
+static int n_failures = 0;
+
+/**
+ * @brief   Record a failed check unless \p ok
+ */
+static void check(bool ok, const char *what, const std::string &input) {
+  if (!ok) {
+    ++n_failures;
+    std::fprintf(stderr, "FAILED %s: \"%s\"\n", what, input.c_str());
+  }
+}
+
+/**
+ * @brief   Decode \p values with \ref decode_hex_values() and its scalar
+ * reference, and compare both to strtol(), which decoded channel values
+ * before
+ *
+ * @param values    Values separated by spaces
+ * @param n Maximum number of values to decode
+ * @param n_expected    Number of values which must be decoded, or -1 to not
+ * check it
+ */
+static void check_decode(const std::string &values, size_t n,
+                         long n_expected = -1) {
+  std::vector<uint32_t> simd(n), scalar(n);
+  size_t simd_len, scalar_len;
+  const size_t n_simd = decode_hex_values(values.data(), values.size(),
+                                          simd.data(), n, simd_len);
+  const size_t n_scalar = decode_hex_values_scalar(
+      values.data(), values.size(), scalar.data(), n, scalar_len);
+  check(n_simd == n_scalar && simd_len == scalar_len && simd == scalar,
+        "SIMD and scalar decoding differ", values);
+  check(n_expected < 0 || n_simd == static_cast<size_t>(n_expected),
+        "unexpected number of values", values);
+  // the copy is null-terminated, so strtol() stops at the end
+  const std::string copy(values);
+  const char *pos = copy.c_str();
+  for (size_t i = 0; i < n_simd; ++i) {
+    char *end;
+    if (std::strtol(pos, &end, 16) != simd[i] || *end != ' ') {
+      check(false, "value differs from strtol()", values);
+      return;
+    }
+    pos = end + 1;
+  }
+  check(pos == copy.c_str() + simd_len, "consumed bytes differ from strtol()",
+        values);
+}
+
+/**
+ * @brief   Random runs of values, mostly plain, with the odd sign, junk, long
+ * value or double space which end the run
+ */
+static void test_random_values() {
+  static const char DIGITS[] = "0123456789ABCDEFabcdef";
+  std::mt19937 rng(1);
+  for (int run = 0; run < 20000; ++run) {
+    std::string values;
+    const size_t n_tokens = rng() % 80;
+    for (size_t i = 0; i < n_tokens; ++i) {
+      const unsigned int oddity = rng() % 200;
+      if (oddity == 0) {
+        values += '-';
+      } else if (oddity == 1) {
+        values += 'x';
+      }
+      const size_t n_digits = oddity == 2 ? 9 + rng() % 4 : 1 + rng() % 8;
+      for (size_t d = 0; d < n_digits; ++d) {
+        values += DIGITS[rng() % (sizeof(DIGITS) - 1)];
+      }
+      values += oddity == 3 ? "  " : " ";
+    }
+    check_decode(values, n_tokens);
+  }
+}
+
+/**
+ * @brief   Values of more than 8 digits, which do not fit 32 bit, end the run
+ * wherever they are, also across the chunks of the SIMD path
+ */
+static void test_long_values() {
+  for (size_t n_before = 0; n_before < 40; ++n_before) {
+    for (size_t n_digits = 9; n_digits <= 17; n_digits += 4) {
+      std::string values;
+      for (size_t i = 0; i < n_before; ++i) {
+        values += "1A2 ";
+      }
+      values += std::string(n_digits, 'F') + " ";
+      for (size_t i = 0; i < 40; ++i) {
+        values += "3B ";
+      }
+      check_decode(values, n_before + 41, n_before);
+    }
+  }
+  // the longest value that fits
+  check_decode("FFFFFFFF 00000000 ", 2, 2);
+}
+
+/**
+ * @brief   Inputs of every length up to a few SIMD chunks, so that the tail
+ * left to the scalar path is shorter than a vector, and values straddle the
+ * chunk boundaries at every offset
+ */
+static void test_short_tails() {
+  std::mt19937 rng(2);
+  for (size_t len = 0; len <= 200; ++len) {
+    for (int run = 0; run < 50; ++run) {
+      std::string values;
+      while (values.size() < len) {
+        const size_t n_digits = 1 + rng() % 8;
+        for (size_t d = 0; d < n_digits; ++d) {
+          values += "0123456789ABCDEF"[rng() % 16];
+        }
+        values += ' ';
+      }
+      values.resize(len);
+      // truncated values and a missing final space end the run
+      check_decode(values, len);
+      // fewer values than available stop early
+      check_decode(values, len / 4);
+    }
+  }
+}
+
+/**
+ * @brief   Replace the \p idx th distance value of the first echo in an ASCII
+ * telegram by \p token
+ *
+ * @param offset    Output, offset of the distance channel
+ * @param scale_factor  Output, scale factor of the distance channel
+ */
+static void replace_distance(std::vector<char> &telegram, size_t idx,
+                             const std::string &token, long &offset,
+                             unsigned int &scale_factor) {
+  std::string text(telegram.begin(), telegram.end());
+  size_t pos = text.find(" DIST1 ") + 1;
+  // name, scale factor, offset, start angle, angular step, number of values
+  std::vector<size_t> starts;
+  for (size_t i = 0; i < 6 + idx; ++i) {
+    starts.push_back(pos);
+    pos = text.find(' ', pos) + 1;
+  }
+  scale_factor = text.compare(starts[1], 8, "3F800000") == 0 ? 1 : 2;
+  offset = std::strtol(text.c_str() + starts[2], nullptr, 16);
+  const size_t end = text.find(' ', pos);
+  text.replace(pos, end - pos, token);
+  telegram.assign(text.begin(), text.end());
+}
+
+/**
+ * @brief   Tokens with a sign or junk after the digits are decoded by the
+ * general path like strtol(), which the streaming parser tracks with
+ * `hex_ended_`. Both parsers must agree with it, also when the telegram
+ * arrives in small pieces that split the tokens.
+ */
+static void test_unusual_tokens() {
+  const char *TOKENS[] = {"1Ax", "12G4", "-5", "+7", "-1Az", "x", "123456789"};
+  const SimulationConfig config(25, 1);
+  for (const char *token : TOKENS) {
+    for (size_t idx : {0, 1, 17, 90}) {
+      std::vector<char> telegram;
+      synthesize_scan_ascii(config, 0, std::chrono::system_clock::now(),
+                            telegram);
+      long offset;
+      unsigned int scale_factor;
+      replace_distance(telegram, idx, token, offset, scale_factor);
+      const float expected =
+          (offset + scale_factor * std::strtol(token, nullptr, 16)) / 1000.0f;
+
+      Scan scan;
+      check(ScanBatcher::parse_scan_telegram(telegram.data(), telegram.size(),
+                                             scan),
+            "bulk parser rejected the telegram", token);
+      check(scan.ranges(0, idx) == expected,
+            "bulk parser value differs from strtol()", token);
+
+      for (size_t piece : {1, 3, 7, 4096}) {
+        StreamingScanBatcher streaming;
+        Scan streamed;
+        const ScanSink sink = [&streamed](Scan &s) { streamed = s; };
+        size_t n_scans = 0;
+        for (size_t pos = 0; pos < telegram.size(); pos += piece) {
+          n_scans += streaming.add_data(
+              telegram.data() + pos,
+              std::min(piece, telegram.size() - pos), sink);
+        }
+        check(n_scans == 1, "streaming parser rejected the telegram", token);
+        check(n_scans == 1 && streamed.ranges == scan.ranges,
+              "streaming and bulk parser differ", token);
+      }
+    }
+  }
+}
+
+/**
+ * @brief   Spans of \p data as \ref find_frames() documents them, computed
+ * independently of its implementation
+ */
+static std::vector<FrameSpan> expected_frames(const std::string &data) {
+  std::vector<FrameSpan> frames;
+  size_t begin = 0;
+  while (begin < data.size()) {
+    const size_t etx = data.find(ETX, begin);
+    const size_t end = etx == std::string::npos ? data.size() : etx + 1;
+    const size_t stx = data.find(STX, begin);
+    frames.push_back(FrameSpan{begin, stx < end ? stx : NO_STX, end,
+                               etx != std::string::npos});
+    begin = end;
+  }
+  return frames;
+}
+
+/**
+ * @return  Whether \p a and \p b hold the same spans
+ */
+static bool same_frames(const std::vector<FrameSpan> &a,
+                        const std::vector<FrameSpan> &b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(),
+                    [](const FrameSpan &x, const FrameSpan &y) {
+                      return x.begin == y.begin && x.stx == y.stx &&
+                             x.end == y.end && x.terminated == y.terminated;
+                    });
+}
+
+/**
+ * @brief   Compare \ref find_frames() and \ref count_delimiters() with their
+ * scalar references and the documented spans
+ */
+static void check_frames(const std::string &data, const std::string &what) {
+  std::vector<FrameSpan> simd, scalar;
+  find_frames(data.data(), data.size(), simd);
+  find_frames_scalar(data.data(), data.size(), scalar);
+  check(same_frames(simd, scalar), "SIMD and scalar frames differ", what);
+  check(same_frames(simd, expected_frames(data)),
+        "frames differ from the spans", what);
+  size_t n_stx, n_etx, n_stx_scalar, n_etx_scalar;
+  count_delimiters(data.data(), data.size(), n_stx, n_etx);
+  count_delimiters_scalar(data.data(), data.size(), n_stx_scalar,
+                          n_etx_scalar);
+  check(n_stx == n_stx_scalar && n_etx == n_etx_scalar &&
+            n_stx == static_cast<size_t>(
+                         std::count(data.begin(), data.end(), STX)) &&
+            n_etx == static_cast<size_t>(
+                         std::count(data.begin(), data.end(), ETX)),
+        "delimiter counts differ", what);
+}
+
+/**
+ * @brief   Inputs of every length across several SIMD blocks, with a single
+ * delimiter at every position, and random mixes with nested STX, ETX without
+ * STX and bytes above 0x7F, which must not be mistaken for delimiters by
+ * signed compares
+ */
+static void test_frames() {
+  static const char BYTES[] = {'a', ' ', '0', STX, ETX, '\x82', '\xFF'};
+  std::mt19937 rng(3);
+  for (size_t len = 0; len <= 200; ++len) {
+    const std::string what = "length " + std::to_string(len);
+    for (size_t pos = 0; pos < len; ++pos) {
+      for (char delimiter : {STX, ETX}) {
+        std::string data(len, 'a');
+        data[pos] = delimiter;
+        check_frames(data, what + ", delimiter at " + std::to_string(pos));
+      }
+    }
+    for (int run = 0; run < 50; ++run) {
+      std::string data(len, 'a');
+      for (char &byte : data) {
+        // mostly telegram contents, delimiters every few bytes
+        byte = BYTES[rng() % 3 == 0 ? rng() % sizeof(BYTES) : 0];
+      }
+      check_frames(data, what + ", random");
+    }
+  }
+  check_frames("\x02sSN \x02sRA LMDscandata 1\x03", "nested STX");
+  check_frames("N 1 0\x03\x02sEA LMDscandata 1\x03", "ETX without STX");
+  check_frames("\x03\x03\x02\x02", "only delimiters");
+}
+
+/**
+ * @brief   Push a scan marked with \p id, see \ref scan_id()
+ */
+static bool push_scan(ScanRing &ring, uint32_t id) {
+  Scan scan;
+  scan.time_since_boot_us = id;
+  return ring.push(scan);
+}
+
+/**
+ * @return  Mark of a scan from \ref push_scan(), or -1 for none
+ */
+static long scan_id(const Scan *scan) {
+  return scan == nullptr ? -1 : static_cast<long>(scan->time_since_boot_us);
+}
+
+/**
+ * @brief   A full ring drops the oldest scans and counts them, and the
+ * consumer gets the newest ones in order
+ */
+static void test_ring_drop_oldest() {
+  ScanRing ring(4);
+  for (uint32_t id = 0; id < 10; ++id) {
+    check(push_scan(ring, id), "push into a full ring failed", "drop oldest");
+  }
+  const ScanRingStats stats = ring.stats();
+  check(stats.pushed == 10 && stats.overruns == 6 && stats.blocked == 0 &&
+            ring.size() == 4,
+        "overruns not counted", "drop oldest");
+  for (long id = 6; id < 10; ++id) {
+    check(scan_id(ring.try_pop()) == id, "wrong scan popped", "drop oldest");
+  }
+  check(ring.try_pop() == nullptr && ring.stats().popped == 4,
+        "empty ring returned a scan", "drop oldest");
+  check(ring.pop(std::chrono::microseconds(1000)) == nullptr,
+        "pop returned a scan after the timeout", "drop oldest");
+}
+
+/**
+ * @brief   A producer blocked on a full ring continues once the consumer frees
+ * a slot, and gives up when the ring is closed
+ */
+static void test_ring_block() {
+  ScanRing ring(2, OverrunPolicy::Block);
+  push_scan(ring, 0);
+  push_scan(ring, 1);
+  std::atomic<int> result(-1);
+  std::thread producer([&ring, &result] { result = push_scan(ring, 2); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  check(result == -1, "push into a full ring did not block", "block");
+  check(scan_id(ring.try_pop()) == 0, "wrong scan popped", "block");
+  producer.join();
+  check(result == 1 && ring.stats().blocked == 1,
+        "blocked push did not continue", "block");
+
+  result = -1;
+  producer = std::thread([&ring, &result] { result = push_scan(ring, 3); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  check(result == -1, "push into a full ring did not block", "block");
+  ring.close();
+  producer.join();
+  check(result == 0, "closing did not wake the blocked push", "block");
+  check(!push_scan(ring, 4), "push into a closed ring succeeded", "block");
+  // queued scans survive closing
+  check(scan_id(ring.try_pop()) == 1 && scan_id(ring.try_pop()) == 2 &&
+            ring.pop(std::chrono::microseconds(1000000)) == nullptr,
+        "queued scans lost on close", "block");
+}
+
+/**
+ * @brief   Scans cross threads in order, each at most once, and with
+ * blocking none is lost
+ */
+static void test_ring_threads() {
+  static constexpr uint32_t N_SCANS = 100000;
+  for (OverrunPolicy policy :
+       {OverrunPolicy::DropOldest, OverrunPolicy::Block}) {
+    const std::string what =
+        policy == OverrunPolicy::Block ? "threads, block" : "threads, drop";
+    ScanRing ring(8, policy);
+    std::thread producer([&ring] {
+      for (uint32_t id = 0; id < N_SCANS; ++id) {
+        push_scan(ring, id);
+      }
+      ring.close();
+    });
+    long last = -1;
+    uint64_t n_popped = 0;
+    bool ordered = true;
+    while (const Scan *scan = ring.pop(std::chrono::microseconds(1000000))) {
+      ordered = ordered && scan_id(scan) > last;
+      last = scan_id(scan);
+      ++n_popped;
+    }
+    producer.join();
+    const ScanRingStats stats = ring.stats();
+    check(ordered, "scans out of order", what);
+    check(stats.pushed == N_SCANS && stats.popped == n_popped &&
+              n_popped + stats.overruns == N_SCANS,
+          "scans lost or duplicated", what);
+    check(policy == OverrunPolicy::DropOldest || n_popped == N_SCANS,
+          "blocking ring dropped scans", what);
+  }
+}
+
+/**
+ * @brief   Slots return to the pool with their last handle, and publishing
+ * into a pool without free slots fails and is counted
+ */
+static void test_pool_refcount() {
+  ScanPool pool(2);
+  Scan scan;
+  scan.time_since_boot_us = 1;
+  ScanPtr first = pool.publish(scan);
+  scan.time_since_boot_us = 2;
+  ScanPtr second = pool.publish(scan);
+  check(first && second && scan_id(first.get()) == 1 &&
+            scan_id(second.get()) == 2 && pool.available() == 0,
+        "published scans not in the pool", "pool");
+  check(!pool.publish(scan) && pool.exhausted() == 1,
+        "publish into a full pool not refused", "pool");
+
+  ScanPtr copy = first;
+  ScanPtr moved = std::move(copy);
+  first.reset();
+  check(!copy && !first && scan_id(moved.get()) == 1 && pool.available() == 0,
+        "slot freed while still referenced", "pool");
+  moved = second;
+  check(pool.available() == 1 && scan_id(moved.get()) == 2,
+        "slot not freed by overwriting its last handle", "pool");
+  moved.reset();
+  second = ScanPtr();
+  check(pool.available() == 2, "slot not freed by its last handle", "pool");
+  scan.time_since_boot_us = 3;
+  check(scan_id(pool.publish(scan).get()) == 3,
+        "freed slot not reused", "pool");
+}
+
+/**
+ * @brief   Handles copied and dropped on several threads free each slot
+ * exactly once
+ */
+static void test_pool_threads() {
+  static constexpr int N_THREADS = 4;
+  ScanPool pool(N_THREADS + 1);
+  for (int round = 0; round < 1000; ++round) {
+    Scan scan;
+    ScanPtr shared = pool.publish(scan);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < N_THREADS; ++i) {
+      threads.emplace_back([shared, &pool] {
+        for (int k = 0; k < 20; ++k) {
+          ScanPtr copy = shared;
+        }
+        Scan own;
+        pool.publish(own);
+      });
+    }
+    shared.reset();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    if (pool.available() != pool.size() || pool.exhausted() != 0) {
+      check(false, "slots leaked or shared", "pool threads");
+      return;
+    }
+  }
+}
+
+int main() {
+  test_random_values();
+  test_long_values();
+  test_short_tails();
+  test_unusual_tokens();
+  test_frames();
+  test_ring_drop_oldest();
+  test_ring_block();
+  test_ring_threads();
+  test_pool_refcount();
+  test_pool_threads();
+  if (n_failures > 0) {
+    std::fprintf(stderr, "%d checks failed\n", n_failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
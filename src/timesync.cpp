@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <sick-lms5xx/timesync.hpp>
+
+namespace sick {
+
+constexpr size_t DeviceClockEstimator::MIN_SAMPLES;
+
+/// A device clock this far behind the last sample means the scanner rebooted
+static constexpr int64_t MAX_BACKWARD_US = 1000000;
+/// Rise of the lower envelope per sample, so that it can follow an increase
+/// of the minimum delay, e.g. after a route change
+static constexpr double ENVELOPE_RISE_NS = 100;
+
+static int64_t to_ns(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+DeviceClockEstimator::DeviceClockEstimator(double forgetting)
+    : forgetting_(forgetting) {
+  reset();
+}
+
+void DeviceClockEstimator::reset() {
+  started_ = false;
+  last_raw_ = 0;
+  device_us_ = 0;
+  device0_us_ = 0;
+  host0_ns_ = 0;
+  n_samples_ = 0;
+  weight_ = 0;
+  mean_x_ = 0;
+  mean_y_ = 0;
+  cov_xx_ = 0;
+  cov_xy_ = 0;
+  min_residual_ns_ = 0;
+}
+
+double DeviceClockEstimator::model(double x) const {
+  const double slope = cov_xx_ > 0 ? cov_xy_ / cov_xx_ : 0;
+  return mean_y_ + slope * (x - mean_x_);
+}
+
+void DeviceClockEstimator::update(
+    uint32_t transmission_us, std::chrono::system_clock::time_point received) {
+  if (started_ && unwrap(transmission_us) < device_us_ - MAX_BACKWARD_US) {
+    reset();
+  }
+  const int64_t host_ns = to_ns(received);
+  if (!started_) {
+    started_ = true;
+    device_us_ = transmission_us;
+    device0_us_ = device_us_;
+    host0_ns_ = host_ns;
+  } else {
+    device_us_ = unwrap(transmission_us);
+  }
+  last_raw_ = transmission_us;
+  ++n_samples_;
+
+  // fit host minus device time over device time, relative to the first
+  // sample to keep the numbers small
+  const double x = static_cast<double>(device_us_ - device0_us_);
+  const double y = static_cast<double>(host_ns - host0_ns_ -
+                                       1000 * (device_us_ - device0_us_));
+  weight_ = forgetting_ * weight_ + 1;
+  const double dx = x - mean_x_;
+  mean_x_ += dx / weight_;
+  mean_y_ += (y - mean_y_) / weight_;
+  cov_xx_ = forgetting_ * cov_xx_ + dx * (x - mean_x_);
+  cov_xy_ = forgetting_ * cov_xy_ + dx * (y - mean_y_);
+
+  // delays are never negative, so the fastest deliveries define the offset
+  const double residual = y - model(x);
+  min_residual_ns_ =
+      n_samples_ == 1
+          ? residual
+          : std::min(residual, min_residual_ns_ + ENVELOPE_RISE_NS);
+}
+
+std::chrono::system_clock::time_point
+DeviceClockEstimator::to_host(uint32_t device_us) const {
+  const int64_t device = unwrap(device_us) - device0_us_;
+  const double offset_ns =
+      model(static_cast<double>(device)) + min_residual_ns_;
+  const int64_t host_ns =
+      host0_ns_ + 1000 * device + static_cast<int64_t>(offset_ns);
+  return std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(host_ns)));
+}
+
+double DeviceClockEstimator::skew_ppm() const {
+  // slope is in ns of host time per us of device time beyond 1000
+  return cov_xx_ > 0 ? cov_xy_ / cov_xx_ * 1000 : 0;
+}
+
+} // namespace sick